@@ -0,0 +1,79 @@
+#ifndef SLICE_SCHEDULE_H
+#define SLICE_SCHEDULE_H
+
+/*
+Scanout timing of the display slices for beam racing, as the sliced time warp of the
+VrApi schedules them.
+
+The portrait panel is used in landscape, so each refresh scans out from the left edge
+of the left eye to the right edge of the right eye. Beam racing splits the scanout into
+slices, and prepares each slice with a pose predicted for the moment it is displayed,
+starting PreScheduleSeconds before its scanout so it is done just in time. The warp or
+render of one slice must fit between its start and its scanout, or the slice tears.
+
+The application only turns the sliced time warp on and cannot change its schedule other
+than with dev_slicePreScheduleSeconds, so this is only used by the host scanout simulator,
+to pick that pre-schedule.
+*/
+
+#define SLICE_SCHEDULE_EYES						2
+#define SLICE_SCHEDULE_MIN_PRE_SCHEDULE_SECONDS	0.002	// the clamps of dev_slicePreScheduleSeconds
+#define SLICE_SCHEDULE_MAX_PRE_SCHEDULE_SECONDS	0.014
+#define SLICE_SCHEDULE_SCANOUT_FRACTION			0.95	// the rest of the refresh period is vertical blank
+
+typedef struct
+{
+	int		SliceCount;			// across both eyes, a multiple of SLICE_SCHEDULE_EYES
+	double	RefreshPeriod;		// seconds between vsyncs
+	double	ScanoutSeconds;		// the part of the refresh period spent scanning out
+	double	PreScheduleSeconds;	// how long before its scanout a slice is started
+} ovrSliceSchedule;
+
+static inline void ovrSliceSchedule_Create(ovrSliceSchedule * schedule, const int sliceCount, const float displayRefreshRate,
+	const double preScheduleSeconds)
+{
+	const int slicesPerEye = (sliceCount > SLICE_SCHEDULE_EYES) ? sliceCount / SLICE_SCHEDULE_EYES : 1;
+	schedule->SliceCount = slicesPerEye * SLICE_SCHEDULE_EYES;
+	schedule->RefreshPeriod = 1.0 / displayRefreshRate;
+	schedule->ScanoutSeconds = schedule->RefreshPeriod * SLICE_SCHEDULE_SCANOUT_FRACTION;
+	schedule->PreScheduleSeconds = (preScheduleSeconds < SLICE_SCHEDULE_MIN_PRE_SCHEDULE_SECONDS) ? SLICE_SCHEDULE_MIN_PRE_SCHEDULE_SECONDS :
+		((preScheduleSeconds > SLICE_SCHEDULE_MAX_PRE_SCHEDULE_SECONDS) ? SLICE_SCHEDULE_MAX_PRE_SCHEDULE_SECONDS : preScheduleSeconds);
+}
+
+// vrapi_GetPredictedDisplayTime() predicts the middle of the scanout, this is its start.
+static inline double ovrSliceSchedule_GetVsyncTime(const ovrSliceSchedule * schedule, const double predictedDisplayTime)
+{
+	return predictedDisplayTime - 0.5 * schedule->ScanoutSeconds;
+}
+
+static inline double ovrSliceSchedule_GetScanoutTime(const ovrSliceSchedule * schedule, const double vsyncTime, const int slice)
+{
+	return vsyncTime + schedule->ScanoutSeconds * slice / schedule->SliceCount;
+}
+
+// The middle of the scanout of the slice, which is the time to predict its pose for.
+static inline double ovrSliceSchedule_GetDisplayTime(const ovrSliceSchedule * schedule, const double vsyncTime, const int slice)
+{
+	return vsyncTime + schedule->ScanoutSeconds * (slice + 0.5) / schedule->SliceCount;
+}
+
+static inline double ovrSliceSchedule_GetStartTime(const ovrSliceSchedule * schedule, const double vsyncTime, const int slice)
+{
+	return ovrSliceSchedule_GetScanoutTime(schedule, vsyncTime, slice) - schedule->PreScheduleSeconds;
+}
+
+static inline int ovrSliceSchedule_GetEye(const ovrSliceSchedule * schedule, const int slice)
+{
+	return slice * SLICE_SCHEDULE_EYES / schedule->SliceCount;
+}
+
+// The columns of the eye image the slice covers, as fractions of the eye width.
+static inline void ovrSliceSchedule_GetEyeColumns(const ovrSliceSchedule * schedule, const int slice, float * left, float * right)
+{
+	const int slicesPerEye = schedule->SliceCount / SLICE_SCHEDULE_EYES;
+	const int eyeSlice = slice % slicesPerEye;
+	*left = (float)eyeSlice / slicesPerEye;
+	*right = (float)(eyeSlice + 1) / slicesPerEye;
+}
+
+#endif // SLICE_SCHEDULE_H
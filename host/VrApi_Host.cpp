@@ -0,0 +1,914 @@
+/*
+Linux stand-in for vrapi.so, so the renderer can be run, benchmarked and
+regression-tested on a workstation. See VrApi_Host.h for the configuration.
+
+The display is modelled as a vsync every refresh period, starting when VR mode is
+entered. The time warp latches the most recent frame halfway through each refresh
+period, and the latched frame is scanned out from the next vsync. A frame submitted
+after the halfway point of the refresh it was predicted for is shown a vsync later,
+and the previous frame is shown again. vrapi_SubmitFrame() blocks until the previous
+frame has been latched, and until MinimumVsyncs have passed since it last returned.
+
+The head follows a script. vrapi_GetPredictedTracking() samples the script at the
+current time and extrapolates with the angular velocity, like the device does with
+the sensor, so the prediction error of a frame can be measured against the script at
+the time the frame is displayed. The time warp samples the head again when the frame
+is latched, which leaves a smaller error.
+
+Texture swap chains are plain OpenGL ES textures.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <GLES3/gl3.h>
+
+#include "VrApi.h"
+#include "VrApi_Helpers.h"
+#include "VrApi_Android.h"
+#include "VrApi_LocalPrefs.h"
+#include "VrApi_Version.h"
+#include "VrApi_Host.h"
+
+#define HOST_LOG(...)	((void)fprintf(stderr, "VrApiHost: " __VA_ARGS__), (void)fputc('\n', stderr))
+
+#define HEAD_TRAJECTORY_LOG_ERROR(...)	HOST_LOG(__VA_ARGS__)
+#include "HeadTrajectory.h"
+
+#define HOST_DEFAULT_REFRESH_RATE		60.0f
+#define HOST_DEFAULT_EYE_RESOLUTION		1024
+#define HOST_EYE_FOV_DEGREES			90.0f
+#define HOST_MAX_PREDICTIONS			64		// frames in flight with a predicted display time
+#define HOST_MAX_LOCAL_PREFS			64
+
+#define MATH_PI							3.14159265358979323846
+
+static double GetMonotonicSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+//================================================================================
+//
+// ovrHostClock
+//
+//================================================================================
+
+/*
+With the virtual clock, blocking advances the time instead of sleeping, so a run of
+many frames takes only as long as the CPU work. The CPU work itself is still timed
+with the real clock.
+*/
+
+typedef struct
+{
+	bool	Virtual;
+	double	SkippedSeconds;		// slept on the virtual clock
+} ovrHostClock;
+
+static ovrHostClock Clock;
+
+static double ovrHostClock_GetTime()
+{
+	return GetMonotonicSeconds() + Clock.SkippedSeconds;
+}
+
+static void ovrHostClock_SleepUntil(const double time)
+{
+	const double now = ovrHostClock_GetTime();
+	if (time <= now)
+	{
+		return;
+	}
+	if (Clock.Virtual)
+	{
+		Clock.SkippedSeconds += time - now;
+		return;
+	}
+	const double realTime = time - Clock.SkippedSeconds;
+	struct timespec until;
+	until.tv_sec = (time_t)realTime;
+	until.tv_nsec = (long)((realTime - until.tv_sec) * 1e9);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0)
+	{
+	}
+}
+
+//================================================================================
+//
+// Quaternions
+//
+//================================================================================
+
+static ovrQuatf Quat_Multiply(const ovrQuatf * a, const ovrQuatf * b)
+{
+	ovrQuatf r;
+	r.x = a->w * b->x + a->x * b->w + a->y * b->z - a->z * b->y;
+	r.y = a->w * b->y - a->x * b->z + a->y * b->w + a->z * b->x;
+	r.z = a->w * b->z + a->x * b->y - a->y * b->x + a->z * b->w;
+	r.w = a->w * b->w - a->x * b->x - a->y * b->y - a->z * b->z;
+	return r;
+}
+
+static ovrQuatf Quat_CreateFromAxisAngle(const float x, const float y, const float z, const float radians)
+{
+	const float s = sinf(radians * 0.5f);
+	ovrQuatf r;
+	r.x = x * s;
+	r.y = y * s;
+	r.z = z * s;
+	r.w = cosf(radians * 0.5f);
+	return r;
+}
+
+static float Quat_AngleDegrees(const ovrQuatf * a, const ovrQuatf * b)
+{
+	const float dot = fabsf(a->x * b->x + a->y * b->y + a->z * b->z + a->w * b->w);
+	return (float)(2.0 * acos((dot < 1.0f) ? dot : 1.0f) * 180.0 / MATH_PI);
+}
+
+// Rotates the orientation by a world space angular velocity for the given time.
+static ovrQuatf Quat_Extrapolate(const ovrQuatf * orientation, const ovrVector3f * angularVelocity, const float seconds)
+{
+	const float speed = sqrtf(angularVelocity->x * angularVelocity->x + angularVelocity->y * angularVelocity->y +
+								angularVelocity->z * angularVelocity->z);
+	if (speed < 1e-6f)
+	{
+		return *orientation;
+	}
+	const ovrQuatf delta = Quat_CreateFromAxisAngle(angularVelocity->x / speed, angularVelocity->y / speed,
+														angularVelocity->z / speed, speed * seconds);
+	return Quat_Multiply(&delta, orientation);
+}
+
+//================================================================================
+//
+// ovrMobile
+//
+//================================================================================
+
+typedef struct
+{
+	long long	FrameIndex;
+	double		DisplayTime;
+} ovrPrediction;
+
+struct ovrMobile
+{
+	pthread_mutex_t		Mutex;
+	double				RefreshPeriod;
+	double				VsyncBase;				// time of vsync 0
+	ovrHeadTrajectory	Motion;
+	float				RecenterYaw;
+	ovrVector3f			RecenterPosition;
+	// Frame pacing.
+	int					MinimumVsyncs;			// of the last submitted frame
+	long long			LastFrameIndex;
+	long long			LastLatch;				// halfway point at which the last frame is latched
+	double				LastReleaseTime;
+	bool				Submitted;
+	ovrPrediction		Predictions[HOST_MAX_PREDICTIONS];
+};
+
+static bool Initialized;
+
+// The frame records outlive VR mode, so they can be checked after the app has left it.
+typedef struct
+{
+	pthread_mutex_t		Mutex;
+	ovrHostFrameRecord *Records;
+	int					RecordCount;
+	ovrHostStats		Stats;
+} ovrHostFrameLog;
+
+static ovrHostFrameLog FrameLog = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, {} };
+
+// Halfway point of refresh period k, which ends with vsync k + 1.
+static double ovrMobile_GetHalfwayTime(const ovrMobile * ovr, const long long k)
+{
+	return ovr->VsyncBase + (k + 0.5) * ovr->RefreshPeriod;
+}
+
+// The first halfway point at or after the time.
+static long long ovrMobile_GetNextHalfway(const ovrMobile * ovr, const double time)
+{
+	return (long long)ceil((time - ovr->VsyncBase) / ovr->RefreshPeriod - 0.5 - 1e-9);
+}
+
+// Middle of the display period of a frame latched at halfway point k.
+static double ovrMobile_GetDisplayTime(const ovrMobile * ovr, const long long k, const int minimumVsyncs)
+{
+	return ovr->VsyncBase + (k + 1) * ovr->RefreshPeriod + 0.5 * minimumVsyncs * ovr->RefreshPeriod;
+}
+
+static ovrRigidBodyPosef ovrMobile_GetScriptedPose(const ovrMobile * ovr, const double time)
+{
+	const double scriptTime = time - ovr->VsyncBase;
+	const ovrHeadKeyPose key = ovrHeadTrajectory_GetKeyPose(&ovr->Motion, scriptTime);
+	const ovrHeadKeyPose next = ovrHeadTrajectory_GetKeyPose(&ovr->Motion, scriptTime + HEAD_TRAJECTORY_VELOCITY_SECONDS);
+
+	ovrRigidBodyPosef pose;
+	memset(&pose, 0, sizeof(pose));
+	pose.Pose.Orientation = QuatFromYawPitchRoll(key.Yaw - ovr->RecenterYaw, key.Pitch, key.Roll);
+	const ovrQuatf nextOrientation = QuatFromYawPitchRoll(next.Yaw - ovr->RecenterYaw, next.Pitch, next.Roll);
+	pose.AngularVelocity = AngularVelocityBetween(&pose.Pose.Orientation, &nextOrientation, HEAD_TRAJECTORY_VELOCITY_SECONDS);
+
+	// The position relative to the recentered pose, rotated with the recentered yaw.
+	const float c = cosf(ovr->RecenterYaw * (float)(MATH_PI / 180.0));
+	const float s = sinf(ovr->RecenterYaw * (float)(MATH_PI / 180.0));
+	const float x = key.Position.x - ovr->RecenterPosition.x;
+	const float z = key.Position.z - ovr->RecenterPosition.z;
+	pose.Pose.Position.x = c * x - s * z;
+	pose.Pose.Position.y = key.Position.y - ovr->RecenterPosition.y;
+	pose.Pose.Position.z = s * x + c * z;
+	pose.TimeInSeconds = time;
+	return pose;
+}
+
+// Samples the head at sampleTime and predicts the orientation at predictedTime with the angular velocity.
+static ovrRigidBodyPosef ovrMobile_PredictPose(const ovrMobile * ovr, const double sampleTime, const double predictedTime)
+{
+	ovrRigidBodyPosef pose = ovrMobile_GetScriptedPose(ovr, sampleTime);
+	pose.Pose.Orientation = Quat_Extrapolate(&pose.Pose.Orientation, &pose.AngularVelocity, (float)(predictedTime - sampleTime));
+	pose.TimeInSeconds = predictedTime;
+	pose.PredictionInSeconds = predictedTime - sampleTime;
+	return pose;
+}
+
+//================================================================================
+//
+// vrapi
+//
+//================================================================================
+
+extern "C" {
+
+const char * vrapi_GetVersionString()
+{
+	static char version[64];
+	snprintf(version, sizeof(version), "VrApi %d.%d.%d.%d host", VRAPI_PRODUCT_VERSION, VRAPI_MAJOR_VERSION,
+				VRAPI_MINOR_VERSION, VRAPI_PATCH_VERSION);
+	return version;
+}
+
+double vrapi_GetTimeInSeconds()
+{
+	return ovrHostClock_GetTime();
+}
+
+void vrapi_Initialize(const ovrInitParms * initParms)
+{
+	if (initParms->MajorVersion != VRAPI_MAJOR_VERSION || initParms->MinorVersion != VRAPI_MINOR_VERSION)
+	{
+		HOST_LOG("initialized with version %d.%d instead of %d.%d", initParms->MajorVersion, initParms->MinorVersion,
+					VRAPI_MAJOR_VERSION, VRAPI_MINOR_VERSION);
+	}
+	const char * clock = getenv("VRAPI_HOST_CLOCK");
+	Clock.Virtual = (clock != NULL && strcasecmp(clock, "virtual") == 0);
+	Initialized = true;
+	HOST_LOG("%s, %s clock", vrapi_GetVersionString(), Clock.Virtual ? "virtual" : "real");
+}
+
+void vrapi_Shutdown()
+{
+	Initialized = false;
+}
+
+ovrHmdInfo vrapi_GetHmdInfo(const ovrJava * java)
+{
+	VRAPI_UNUSED(java);
+	const char * refreshRate = getenv("VRAPI_HOST_REFRESH_RATE");
+	const char * eyeResolution = getenv("VRAPI_HOST_EYE_RESOLUTION");
+
+	ovrHmdInfo info;
+	info.DisplayPixelsWide = 2560;
+	info.DisplayPixelsHigh = 1440;
+	info.DisplayRefreshRate = (refreshRate != NULL && atof(refreshRate) > 0.0) ? (float)atof(refreshRate) : HOST_DEFAULT_REFRESH_RATE;
+	info.SuggestedEyeResolutionWidth = (eyeResolution != NULL && atoi(eyeResolution) > 0) ? atoi(eyeResolution) : HOST_DEFAULT_EYE_RESOLUTION;
+	info.SuggestedEyeResolutionHeight = info.SuggestedEyeResolutionWidth;
+	info.SuggestedEyeFovDegreesX = HOST_EYE_FOV_DEGREES;
+	info.SuggestedEyeFovDegreesY = HOST_EYE_FOV_DEGREES;
+	return info;
+}
+
+//================================================================================
+//
+// ovrTextureSwapChain
+//
+//================================================================================
+
+#define HOST_MAX_SWAP_CHAIN_LENGTH		3
+
+struct ovrTextureSwapChain
+{
+	int		Length;
+	GLuint	Textures[HOST_MAX_SWAP_CHAIN_LENGTH];
+	GLenum	Target;
+	GLenum	InternalFormat;
+	int		Width;
+	int		Height;
+};
+
+// The default swap chains of vrapi_DefaultFrameParms() are small integers instead of pointers.
+static bool IsDefaultSwapChain(const ovrTextureSwapChain * chain)
+{
+	return (size_t)chain == (size_t)VRAPI_DEFAULT_TEXTURE_SWAPCHAIN_BLACK ||
+			(size_t)chain == (size_t)VRAPI_DEFAULT_TEXTURE_SWAPCHAIN_LOADING_ICON;
+}
+
+static GLenum GetInternalFormat(const ovrTextureFormat format)
+{
+	switch (format)
+	{
+		case VRAPI_TEXTURE_FORMAT_565:					return GL_RGB565;
+		case VRAPI_TEXTURE_FORMAT_5551:					return GL_RGB5_A1;
+		case VRAPI_TEXTURE_FORMAT_4444:					return GL_RGBA4;
+		case VRAPI_TEXTURE_FORMAT_8888:					return GL_RGBA8;
+		case VRAPI_TEXTURE_FORMAT_8888_sRGB:			return GL_SRGB8_ALPHA8;
+		case VRAPI_TEXTURE_FORMAT_RGBA16F:				return GL_RGBA16F;
+		case VRAPI_TEXTURE_FORMAT_DEPTH_16:				return GL_DEPTH_COMPONENT16;
+		case VRAPI_TEXTURE_FORMAT_DEPTH_24:				return GL_DEPTH_COMPONENT24;
+		case VRAPI_TEXTURE_FORMAT_DEPTH_24_STENCIL_8:	return GL_DEPTH24_STENCIL8;
+		default:										return GL_RGBA8;
+	}
+}
+
+ovrTextureSwapChain * vrapi_CreateTextureSwapChain(ovrTextureType type, ovrTextureFormat format,
+													int width, int height, int levels, bool buffered)
+{
+	if (type == VRAPI_TEXTURE_TYPE_2D_EXTERNAL)
+	{
+		HOST_LOG("external texture swap chains are not supported");
+		return NULL;
+	}
+	if (levels == VRAPI_TEXTURE_SWAPCHAIN_FULL_MIP_CHAIN)
+	{
+		levels = 1;
+		while ((width >> levels) > 0 || (height >> levels) > 0)
+		{
+			levels++;
+		}
+	}
+	const GLenum target = (type == VRAPI_TEXTURE_TYPE_CUBE) ? GL_TEXTURE_CUBE_MAP :
+							((type == VRAPI_TEXTURE_TYPE_2D_ARRAY) ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D);
+	const GLenum internalFormat = GetInternalFormat(format);
+
+	ovrTextureSwapChain * chain = (ovrTextureSwapChain *)malloc(sizeof(ovrTextureSwapChain));
+	chain->Length = buffered ? HOST_MAX_SWAP_CHAIN_LENGTH : 1;
+	chain->Target = target;
+	chain->InternalFormat = internalFormat;
+	chain->Width = width;
+	chain->Height = height;
+	glGenTextures(chain->Length, chain->Textures);
+	for (int i = 0; i < chain->Length; i++)
+	{
+		glBindTexture(target, chain->Textures[i]);
+		if (target == GL_TEXTURE_2D_ARRAY)
+		{
+			glTexStorage3D(target, levels, internalFormat, width, height, VRAPI_FRAME_LAYER_EYE_MAX);
+		}
+		else
+		{
+			glTexStorage2D(target, levels, internalFormat, width, height);
+		}
+	}
+	glBindTexture(target, 0);
+	return chain;
+}
+
+void vrapi_DestroyTextureSwapChain(ovrTextureSwapChain * chain)
+{
+	if (chain == NULL)
+	{
+		return;
+	}
+	glDeleteTextures(chain->Length, chain->Textures);
+	free(chain);
+}
+
+int vrapi_GetTextureSwapChainLength(ovrTextureSwapChain * chain)
+{
+	return chain->Length;
+}
+
+unsigned int vrapi_GetTextureSwapChainHandle(ovrTextureSwapChain * chain, int index)
+{
+	return chain->Textures[index];
+}
+
+void vrapi_SetTextureSwapChainHandle(ovrTextureSwapChain * chain, int index, unsigned int handle)
+{
+	chain->Textures[index] = handle;
+}
+
+//================================================================================
+//
+// ovrHostCapture
+//
+//================================================================================
+
+/*
+VRAPI_HOST_CAPTURE_FRAME=<n> writes the eye images of the n-th rendered frame, the
+left eye next to the right eye, to VRAPI_HOST_CAPTURE_FILE as a binary PPM, so a
+headless run can be compared against a reference image.
+*/
+
+typedef struct
+{
+	int		RenderedFrame;		// 0 when capture is disabled
+	char	FileName[256];
+} ovrHostCapture;
+
+static ovrHostCapture Capture;
+
+static void ovrHostCapture_Create()
+{
+	const char * frame = getenv("VRAPI_HOST_CAPTURE_FRAME");
+	const char * fileName = getenv("VRAPI_HOST_CAPTURE_FILE");
+	Capture.RenderedFrame = (frame != NULL) ? atoi(frame) : 0;
+	snprintf(Capture.FileName, sizeof(Capture.FileName), "%s", (fileName != NULL) ? fileName : "capture.ppm");
+}
+
+static void ovrHostCapture_Write(const ovrFrameParms * parms)
+{
+	const ovrFrameLayer * layer = &parms->Layers[VRAPI_FRAME_LAYER_TYPE_WORLD];
+	const ovrTextureSwapChain * chains[VRAPI_FRAME_LAYER_EYE_MAX];
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		chains[eye] = layer->Textures[eye].ColorTextureSwapChain;
+		if (chains[eye] == NULL || IsDefaultSwapChain(chains[eye]) || chains[eye]->Target == GL_TEXTURE_CUBE_MAP || chains[eye]->InternalFormat == GL_RGBA16F ||
+			chains[eye]->Width != chains[0]->Width || chains[eye]->Height != chains[0]->Height)
+		{
+			HOST_LOG("cannot capture the eye images of frame %lld", parms->FrameIndex);
+			return;
+		}
+	}
+	const int width = chains[0]->Width;
+	const int height = chains[0]->Height;
+	unsigned char * pixels = (unsigned char *)malloc(VRAPI_FRAME_LAYER_EYE_MAX * width * height * 4);
+
+	GLint readFrameBuffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFrameBuffer);
+	GLuint frameBuffer = 0;
+	glGenFramebuffers(1, &frameBuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBuffer);
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		const GLuint texture = chains[eye]->Textures[layer->Textures[eye].TextureSwapChainIndex % chains[eye]->Length];
+		if (chains[eye]->Target == GL_TEXTURE_2D_ARRAY)
+		{
+			glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, eye);
+		}
+		else
+		{
+			glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		}
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels + eye * width * height * 4);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFrameBuffer);
+	glDeleteFramebuffers(1, &frameBuffer);
+
+	FILE * file = fopen(Capture.FileName, "wb");
+	if (file == NULL)
+	{
+		HOST_LOG("failed to open %s", Capture.FileName);
+		free(pixels);
+		return;
+	}
+	// The rows of the eye images are bottom up.
+	fprintf(file, "P6\n%d %d\n255\n", VRAPI_FRAME_LAYER_EYE_MAX * width, height);
+	for (int y = height - 1; y >= 0; y--)
+	{
+		for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+		{
+			const unsigned char * row = pixels + (eye * height + y) * width * 4;
+			for (int x = 0; x < width; x++)
+			{
+				fwrite(row + x * 4, 1, 3, file);
+			}
+		}
+	}
+	fclose(file);
+	free(pixels);
+	HOST_LOG("captured frame %lld to %s", parms->FrameIndex, Capture.FileName);
+}
+
+//================================================================================
+//
+// VR mode, tracking and frame submission
+//
+//================================================================================
+
+ovrMobile * vrapi_EnterVrMode(const ovrModeParms * parms)
+{
+	VRAPI_UNUSED(parms);
+	if (!Initialized)
+	{
+		HOST_LOG("vrapi_EnterVrMode() called before vrapi_Initialize()");
+		return NULL;
+	}
+	const ovrHmdInfo info = vrapi_GetHmdInfo(NULL);
+	ovrMobile * ovr = (ovrMobile *)calloc(1, sizeof(ovrMobile));
+	pthread_mutex_init(&ovr->Mutex, NULL);
+	ovr->RefreshPeriod = 1.0 / info.DisplayRefreshRate;
+	ovr->VsyncBase = ovrHostClock_GetTime();
+	// The script time is relative to entering VR mode. Without a usable script the head is still.
+	const char * motion = getenv("VRAPI_HOST_HEAD_MOTION");
+	if (!ovrHeadTrajectory_Create(&ovr->Motion, (motion != NULL) ? motion : "sine"))
+	{
+		ovr->Motion.Type = HEAD_TRAJECTORY_STILL;
+	}
+	else if (ovr->Motion.Type == HEAD_TRAJECTORY_FILE)
+	{
+		HOST_LOG("%d key poses over %1.2f seconds from %s", ovr->Motion.KeyPoseCount,
+					ovr->Motion.KeyPoses[ovr->Motion.KeyPoseCount - 1].Time, motion);
+	}
+	ovr->MinimumVsyncs = 1;
+	ovrHostCapture_Create();
+	pthread_mutex_lock(&FrameLog.Mutex);
+	if (FrameLog.Records == NULL)
+	{
+		FrameLog.Records = (ovrHostFrameRecord *)malloc(VRAPI_HOST_MAX_FRAME_RECORDS * sizeof(ovrHostFrameRecord));
+	}
+	pthread_mutex_unlock(&FrameLog.Mutex);
+	return ovr;
+}
+
+void vrapi_LeaveVrMode(ovrMobile * ovr)
+{
+	if (ovr == NULL)
+	{
+		return;
+	}
+	ovrHost_PrintStats();
+	ovrHeadTrajectory_Destroy(&ovr->Motion);
+	pthread_mutex_destroy(&ovr->Mutex);
+	free(ovr);
+}
+
+double vrapi_GetPredictedDisplayTime(ovrMobile * ovr, long long frameIndex)
+{
+	pthread_mutex_lock(&ovr->Mutex);
+	// Assume the frame is submitted within MinimumVsyncs, and after the frames before it.
+	const double now = ovrHostClock_GetTime();
+	long long latch = ovrMobile_GetNextHalfway(ovr, now) + ovr->MinimumVsyncs;
+	if (ovr->Submitted)
+	{
+		const long long queued = ovr->LastLatch + (frameIndex - ovr->LastFrameIndex) * ovr->MinimumVsyncs;
+		latch = (queued > latch) ? queued : latch;
+	}
+	const double displayTime = ovrMobile_GetDisplayTime(ovr, latch, ovr->MinimumVsyncs);
+	ovrPrediction * prediction = &ovr->Predictions[frameIndex % HOST_MAX_PREDICTIONS];
+	prediction->FrameIndex = frameIndex;
+	prediction->DisplayTime = displayTime;
+	pthread_mutex_unlock(&ovr->Mutex);
+	return displayTime;
+}
+
+ovrTracking vrapi_GetPredictedTracking(ovrMobile * ovr, double absTimeInSeconds)
+{
+	pthread_mutex_lock(&ovr->Mutex);
+	const double now = ovrHostClock_GetTime();
+	ovrTracking tracking;
+	tracking.Status = VRAPI_TRACKING_STATUS_ORIENTATION_TRACKED | VRAPI_TRACKING_STATUS_HMD_CONNECTED;
+	if (ovr->Motion.HasPosition)
+	{
+		tracking.Status |= VRAPI_TRACKING_STATUS_POSITION_TRACKED;
+	}
+	tracking.HeadPose = ovrMobile_PredictPose(ovr, now, (absTimeInSeconds > 0.0) ? absTimeInSeconds : now);
+	pthread_mutex_unlock(&ovr->Mutex);
+	return tracking;
+}
+
+void vrapi_RecenterPose(ovrMobile * ovr)
+{
+	pthread_mutex_lock(&ovr->Mutex);
+	const ovrHeadKeyPose pose = ovrHeadTrajectory_GetKeyPose(&ovr->Motion, ovrHostClock_GetTime() - ovr->VsyncBase);
+	ovr->RecenterYaw = pose.Yaw;
+	ovr->RecenterPosition = pose.Position;
+	pthread_mutex_unlock(&ovr->Mutex);
+}
+
+void vrapi_SubmitFrame(ovrMobile * ovr, const ovrFrameParms * parms)
+{
+	// The time warp waits on a fence for the eye images, here the frame is complete when the GPU is done.
+	glFinish();
+
+	pthread_mutex_lock(&ovr->Mutex);
+	const int minimumVsyncs = (parms->MinimumVsyncs > 1) ? parms->MinimumVsyncs : 1;
+	const double submitTime = ovrHostClock_GetTime();
+
+	// The frame is latched at the first halfway point after it is complete, but not before the last frame has
+	// been shown for MinimumVsyncs.
+	long long latch = ovrMobile_GetNextHalfway(ovr, submitTime);
+	if (ovr->Submitted && latch < ovr->LastLatch + minimumVsyncs)
+	{
+		latch = ovr->LastLatch + minimumVsyncs;
+	}
+	const int droppedVsyncs = (ovr->Submitted && latch > ovr->LastLatch + ovr->MinimumVsyncs) ?
+								(int)(latch - ovr->LastLatch - ovr->MinimumVsyncs) : 0;
+
+	// Block until the last frame has been latched, and until MinimumVsyncs have passed since the last release.
+	double releaseTime = submitTime;
+	if (ovr->Submitted)
+	{
+		const double lastLatchTime = ovrMobile_GetHalfwayTime(ovr, ovr->LastLatch);
+		const long long lastReleaseHalfway = ovrMobile_GetNextHalfway(ovr, ovr->LastReleaseTime + 1e-6) - 1;
+		const double minimumTime = ovrMobile_GetHalfwayTime(ovr, lastReleaseHalfway + minimumVsyncs);
+		releaseTime = (lastLatchTime > releaseTime) ? lastLatchTime : releaseTime;
+		releaseTime = (minimumTime > releaseTime) ? minimumTime : releaseTime;
+	}
+
+	pthread_mutex_lock(&FrameLog.Mutex);
+	ovrHostFrameRecord * record = &FrameLog.Records[FrameLog.RecordCount % VRAPI_HOST_MAX_FRAME_RECORDS];
+	record->FrameIndex = parms->FrameIndex;
+	record->SubmitTime = submitTime;
+	record->ReleaseTime = releaseTime;
+	record->DisplayTime = ovrMobile_GetDisplayTime(ovr, latch, minimumVsyncs);
+	const ovrPrediction * prediction = &ovr->Predictions[parms->FrameIndex % HOST_MAX_PREDICTIONS];
+	record->PredictedDisplayTime = (prediction->FrameIndex == parms->FrameIndex) ? prediction->DisplayTime : record->DisplayTime;
+	const double late = record->DisplayTime - record->PredictedDisplayTime;
+	record->MissedVsyncs = (late > 0.5 * ovr->RefreshPeriod) ? (int)floor(late / ovr->RefreshPeriod + 0.5) : 0;
+
+	// The errors of the world layer, or the first layer, against the head when the frame is displayed.
+	const ovrRigidBodyPosef * headPose = &parms->Layers[0].Textures[0].HeadPose;
+	record->Rendered = !IsDefaultSwapChain(parms->Layers[0].Textures[0].ColorTextureSwapChain) &&
+						parms->WarpProgram != VRAPI_FRAME_PROGRAM_LOADING_ICON;
+	const ovrRigidBodyPosef actualPose = ovrMobile_GetScriptedPose(ovr, record->DisplayTime);
+	const ovrRigidBodyPosef warpPose = ovrMobile_PredictPose(ovr, ovrMobile_GetHalfwayTime(ovr, latch), record->DisplayTime);
+	record->PoseLatency = record->DisplayTime - (headPose->TimeInSeconds - headPose->PredictionInSeconds);
+	record->RenderErrorDegrees = Quat_AngleDegrees(&headPose->Pose.Orientation, &actualPose.Pose.Orientation);
+	record->WarpErrorDegrees = Quat_AngleDegrees(&warpPose.Pose.Orientation, &actualPose.Pose.Orientation);
+	record->Parms = *parms;
+
+	ovrHostStats * stats = &FrameLog.Stats;
+	stats->FrameCount++;
+	stats->LateFrames += (record->MissedVsyncs > 0) ? 1 : 0;
+	stats->MissedVsyncs += record->MissedVsyncs;
+	stats->DroppedVsyncs += droppedVsyncs;
+	stats->BlockedSeconds += releaseTime - submitTime;
+	// Black and the loading icon do not depend on the head pose.
+	if (record->Rendered)
+	{
+		stats->RenderedFrames++;
+		stats->PoseLatencySum += record->PoseLatency;
+		stats->RenderErrorSum += record->RenderErrorDegrees;
+		stats->RenderErrorMax = (record->RenderErrorDegrees > stats->RenderErrorMax) ? record->RenderErrorDegrees : stats->RenderErrorMax;
+		stats->WarpErrorSum += record->WarpErrorDegrees;
+		stats->WarpErrorMax = (record->WarpErrorDegrees > stats->WarpErrorMax) ? record->WarpErrorDegrees : stats->WarpErrorMax;
+	}
+	FrameLog.RecordCount++;
+	const bool capture = record->Rendered && stats->RenderedFrames == Capture.RenderedFrame;
+	pthread_mutex_unlock(&FrameLog.Mutex);
+
+	if (capture)
+	{
+		ovrHostCapture_Write(parms);
+	}
+
+	ovr->MinimumVsyncs = minimumVsyncs;
+	ovr->LastFrameIndex = parms->FrameIndex;
+	ovr->LastLatch = latch;
+	ovr->LastReleaseTime = releaseTime;
+	ovr->Submitted = true;
+	pthread_mutex_unlock(&ovr->Mutex);
+
+	ovrHostClock_SleepUntil(releaseTime);
+}
+
+//================================================================================
+//
+// Frame records
+//
+//================================================================================
+
+int ovrHost_GetFrameRecordCount()
+{
+	pthread_mutex_lock(&FrameLog.Mutex);
+	const int count = FrameLog.RecordCount;
+	pthread_mutex_unlock(&FrameLog.Mutex);
+	return count;
+}
+
+const ovrHostFrameRecord * ovrHost_GetFrameRecord(int index)
+{
+	pthread_mutex_lock(&FrameLog.Mutex);
+	const ovrHostFrameRecord * record = (index >= 0 && index < FrameLog.RecordCount && index >= FrameLog.RecordCount - VRAPI_HOST_MAX_FRAME_RECORDS) ?
+											&FrameLog.Records[index % VRAPI_HOST_MAX_FRAME_RECORDS] : NULL;
+	pthread_mutex_unlock(&FrameLog.Mutex);
+	return record;
+}
+
+void ovrHost_GetStats(ovrHostStats * stats)
+{
+	pthread_mutex_lock(&FrameLog.Mutex);
+	*stats = FrameLog.Stats;
+	pthread_mutex_unlock(&FrameLog.Mutex);
+}
+
+void ovrHost_PrintStats()
+{
+	ovrHostStats stats;
+	ovrHost_GetStats(&stats);
+	if (stats.FrameCount == 0)
+	{
+		HOST_LOG("no frames submitted");
+		return;
+	}
+	HOST_LOG("%d frames, %d rendered, %d late with %d missed vsyncs, %d vsyncs repeated an old frame",
+				stats.FrameCount, stats.RenderedFrames, stats.LateFrames, stats.MissedVsyncs, stats.DroppedVsyncs);
+	if (stats.RenderedFrames > 0)
+	{
+		HOST_LOG("%1.2f ms pose latency, %1.3f degrees render error (%1.3f max), %1.3f after time warp (%1.3f max)",
+					stats.PoseLatencySum * 1000.0 / stats.RenderedFrames, stats.RenderErrorSum / stats.RenderedFrames,
+					stats.RenderErrorMax, stats.WarpErrorSum / stats.RenderedFrames, stats.WarpErrorMax);
+	}
+	HOST_LOG("%1.2f ms blocked in vrapi_SubmitFrame() per frame", stats.BlockedSeconds * 1000.0 / stats.FrameCount);
+}
+
+//================================================================================
+//
+// VrApi_Android.h
+//
+//================================================================================
+
+int ovr_GetSystemProperty(const ovrJava * java, const ovrSystemProperty prop)
+{
+	VRAPI_UNUSED(java);
+	switch (prop)
+	{
+		case VRAPI_SYS_PROP_DEVICE_TYPE:						return VRAPI_DEVICE_TYPE_NOTE4;
+		case VRAPI_SYS_PROP_GPU_TYPE:							return VRAPI_GPU_TYPE_ADRENO_420;
+		case VRAPI_SYS_PROP_EXTERNAL_SDCARD:					return 0;
+		case VRAPI_SYS_PROP_MAX_FULLSPEED_FRAMEBUFFER_SAMPLES:	return 4;
+		default:												return 0;
+	}
+}
+
+bool ovr_DeviceIsDocked() { return true; }
+bool ovr_HeadsetIsMounted() { return true; }
+bool ovr_GetPowerLevelStateThrottled() { return false; }
+bool ovr_GetPowerLevelStateMinimum() { return false; }
+
+int ovr_GetSystemBrightness(const ovrJava * java) { VRAPI_UNUSED(java); return 255; }
+void ovr_SetSystemBrightness(const ovrJava * java, int const brightness) { VRAPI_UNUSED(java); VRAPI_UNUSED(brightness); }
+bool ovr_GetComfortMode(const ovrJava * java) { VRAPI_UNUSED(java); return false; }
+void ovr_SetComfortMode(const ovrJava * java, bool const enable) { VRAPI_UNUSED(java); VRAPI_UNUSED(enable); }
+bool ovr_GetDoNotDisturbMode(const ovrJava * java) { VRAPI_UNUSED(java); return false; }
+void ovr_SetDoNotDisturbMode(const ovrJava * java, bool const enable) { VRAPI_UNUSED(java); VRAPI_UNUSED(enable); }
+
+void ovr_SendIntent(const ovrJava * java, const char * actionName, const char * toPackageName, const char * toClassName,
+					const char * command, const char * uri)
+{
+	VRAPI_UNUSED(java);
+	VRAPI_UNUSED(toClassName);
+	VRAPI_UNUSED(command);
+	VRAPI_UNUSED(uri);
+	HOST_LOG("intent %s to %s ignored", actionName, toPackageName);
+}
+
+void ovr_SendLaunchIntent(const ovrJava * java, const char * toPackageName, const char * command, const char * uri)
+{
+	VRAPI_UNUSED(java);
+	VRAPI_UNUSED(command);
+	VRAPI_UNUSED(uri);
+	HOST_LOG("launch intent to %s ignored", toPackageName);
+}
+
+void ovr_FinishActivity(const ovrJava * java, ovrFinishType type)
+{
+	VRAPI_UNUSED(java);
+	VRAPI_UNUSED(type);
+}
+
+void ovr_ReturnToHome(const ovrJava * java)
+{
+	VRAPI_UNUSED(java);
+}
+
+bool ovr_StartSystemActivity(const ovrJava * java, const char * command, const char * jsonText)
+{
+	VRAPI_UNUSED(java);
+	VRAPI_UNUSED(jsonText);
+	HOST_LOG("system activity %s ignored", command);
+	return true;
+}
+
+void ovr_DisplaySystemActivityError(const ovrJava * java, const ovrError error, const char * fileName, const char * messageFormat, ...)
+{
+	VRAPI_UNUSED(java);
+	VRAPI_UNUSED(error);
+	VRAPI_UNUSED(fileName);
+	va_list args;
+	va_start(args, messageFormat);
+	fprintf(stderr, "VrApiHost: system activity error: ");
+	vfprintf(stderr, messageFormat, args);
+	fputc('\n', stderr);
+	va_end(args);
+}
+
+bool ovr_CreateSystemActivityIntent(const char * command, const char * extraJsonText,
+		char * outBuffer, unsigned long long const outBufferSize, unsigned long long * outRequiredBufferSize)
+{
+	const int length = snprintf(outBuffer, (size_t)outBufferSize, "{\"Command\":\"%s\",\"PlatformUIVersion\":%d%s%s}",
+								command, PLATFORM_UI_VERSION, (extraJsonText != NULL) ? ",\"Extra\":" : "",
+								(extraJsonText != NULL) ? extraJsonText : "");
+	*outRequiredBufferSize = (unsigned long long)length + 1;
+	return *outRequiredBufferSize <= outBufferSize;
+}
+
+void ovr_BroadcastSystemActivityEvent(const ovrJava * java, const char * actionName, const char * toPackageName,
+										const char * toClassName, const char * command, const char * jsonExtra, const char * uri)
+{
+	VRAPI_UNUSED(java);
+	VRAPI_UNUSED(actionName);
+	VRAPI_UNUSED(toPackageName);
+	VRAPI_UNUSED(toClassName);
+	VRAPI_UNUSED(command);
+	VRAPI_UNUSED(jsonExtra);
+	VRAPI_UNUSED(uri);
+}
+
+eVrApiEventStatus ovr_GetNextPendingEvent(char * buffer, unsigned int const bufferSize)
+{
+	if (buffer == NULL || bufferSize == 0)
+	{
+		return VRAPI_EVENT_ERROR_INVALID_BUFFER;
+	}
+	buffer[0] = '\0';
+	return VRAPI_EVENT_NOT_PENDING;
+}
+
+bool ovr_FindEmbeddedImage(const char * imageName, void ** buffer, int * bufferSize)
+{
+	VRAPI_UNUSED(imageName);
+	*buffer = NULL;
+	*bufferSize = 0;
+	return false;
+}
+
+//================================================================================
+//
+// VrApi_LocalPrefs.h
+//
+//================================================================================
+
+/*
+Values set with ovr_SetLocalPreferenceValueForKey() come first, then VRAPI_PREF_<key>
+from the environment, instead of /sdcard/.oculusprefs.
+*/
+
+typedef struct
+{
+	char	Key[64];
+	char	Value[256];
+} ovrLocalPref;
+
+static ovrLocalPref LocalPrefs[HOST_MAX_LOCAL_PREFS];
+static int LocalPrefCount;
+static pthread_mutex_t LocalPrefMutex = PTHREAD_MUTEX_INITIALIZER;
+
+const char * ovr_GetLocalPreferenceValueForKey(const char * keyName, const char * defaultKeyValue)
+{
+	pthread_mutex_lock(&LocalPrefMutex);
+	for (int i = 0; i < LocalPrefCount; i++)
+	{
+		if (strcasecmp(LocalPrefs[i].Key, keyName) == 0)
+		{
+			pthread_mutex_unlock(&LocalPrefMutex);
+			return LocalPrefs[i].Value;
+		}
+	}
+	pthread_mutex_unlock(&LocalPrefMutex);
+	char name[96];
+	snprintf(name, sizeof(name), "VRAPI_PREF_%s", keyName);
+	const char * value = getenv(name);
+	return (value != NULL) ? value : defaultKeyValue;
+}
+
+void ovr_SetLocalPreferenceValueForKey(const char * keyName, const char * keyValue)
+{
+	pthread_mutex_lock(&LocalPrefMutex);
+	int index = 0;
+	while (index < LocalPrefCount && strcasecmp(LocalPrefs[index].Key, keyName) != 0)
+	{
+		index++;
+	}
+	if (index < HOST_MAX_LOCAL_PREFS)
+	{
+		snprintf(LocalPrefs[index].Key, sizeof(LocalPrefs[index].Key), "%s", keyName);
+		snprintf(LocalPrefs[index].Value, sizeof(LocalPrefs[index].Value), "%s", keyValue);
+		LocalPrefCount = (index == LocalPrefCount) ? LocalPrefCount + 1 : LocalPrefCount;
+	}
+	pthread_mutex_unlock(&LocalPrefMutex);
+}
+
+}	// extern "C"
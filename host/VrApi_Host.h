@@ -0,0 +1,76 @@
+#ifndef VRAPI_HOST_H
+#define VRAPI_HOST_H
+
+/*
+Host-only additions of the vrapi stand-in in VrApi_Host.cpp.
+
+The stand-in implements VrApi.h, VrApi_Android.h and VrApi_LocalPrefs.h on Linux.
+Every vrapi_SubmitFrame() is recorded with its parms and the simulated timing, so a
+test or benchmark can check the frame pacing after, or while, the renderer runs.
+
+It is configured with environment variables:
+
+	VRAPI_HOST_CLOCK			"real" (default) sleeps in vrapi_SubmitFrame() like the device,
+								"virtual" skips the sleeps by advancing vrapi_GetTimeInSeconds()
+	VRAPI_HOST_HEAD_MOTION		"sine" (default), "still", "turn", or the name of a file with
+								one "time yaw pitch roll x y z" key pose per line, in seconds,
+								degrees and meters, which is looped (see jni/HeadTrajectory.h)
+	VRAPI_HOST_REFRESH_RATE		display refresh rate in Hz, default 60
+	VRAPI_HOST_EYE_RESOLUTION	suggested eye resolution, default 1024
+	VRAPI_HOST_CAPTURE_FRAME	write the eye images of this rendered frame, counted from 1,
+	VRAPI_HOST_CAPTURE_FILE		to this PPM file, default "capture.ppm"
+	VRAPI_PREF_<key>			value of the local preference <key>
+*/
+
+#include "VrApi_Types.h"
+
+#define VRAPI_HOST_MAX_FRAME_RECORDS	4096	// the most recent frames that are kept
+
+typedef struct
+{
+	long long		FrameIndex;
+	bool			Rendered;				// not black or the loading icon
+	double			SubmitTime;				// when vrapi_SubmitFrame() was called
+	double			ReleaseTime;			// when vrapi_SubmitFrame() returned
+	double			PredictedDisplayTime;	// from vrapi_GetPredictedDisplayTime() for FrameIndex
+	double			DisplayTime;			// the middle of the display period the frame was shown in
+	int				MissedVsyncs;			// how many vsyncs after the predicted one the frame was shown
+	double			PoseLatency;			// from sampling the head pose of the frame to DisplayTime
+	float			RenderErrorDegrees;		// between the head pose of the frame and the head at DisplayTime
+	float			WarpErrorDegrees;		// what is left after the time warp re-predicts the head pose
+	ovrFrameParms	Parms;
+} ovrHostFrameRecord;
+
+typedef struct
+{
+	int				FrameCount;
+	int				RenderedFrames;			// the pose latency and errors are averaged over these
+	int				LateFrames;				// frames shown after their predicted display time
+	int				MissedVsyncs;
+	int				DroppedVsyncs;			// vsyncs that showed an old frame again
+	double			PoseLatencySum;
+	float			RenderErrorSum;
+	float			RenderErrorMax;
+	float			WarpErrorSum;
+	float			WarpErrorMax;
+	double			BlockedSeconds;			// time spent blocked in vrapi_SubmitFrame()
+} ovrHostStats;
+
+#if defined( __cplusplus )
+extern "C" {
+#endif
+
+// Number of frames submitted since vrapi_EnterVrMode().
+int							ovrHost_GetFrameRecordCount();
+
+// Returns NULL if the frame is not one of the VRAPI_HOST_MAX_FRAME_RECORDS most recent.
+const ovrHostFrameRecord *	ovrHost_GetFrameRecord( int index );
+
+void						ovrHost_GetStats( ovrHostStats * stats );
+void						ovrHost_PrintStats();
+
+#if defined( __cplusplus )
+}	// extern "C"
+#endif
+
+#endif // VRAPI_HOST_H
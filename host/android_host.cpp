@@ -0,0 +1,218 @@
+/*
+Runs android_main() of jni/main.cpp as a Linux program, on top of the vrapi stand-in
+in VrApi_Host.cpp, with the headless EGL path of ovrEgl.
+
+This replaces native_app_glue/android_native_app_glue.c. There is no activity thread:
+ALooper_pollAll() plays the activity life cycle of a launch, resumes the app with a
+window, and after VRAPI_HOST_FRAMES submitted frames, or when the app calls
+ANativeActivity_finish(), pauses it, takes the window away and requests the destroy,
+so android_main() leaves VR mode and returns normally.
+
+	VRAPI_HOST_FRAMES		frames to run, default 300
+	VRAPI_HOST_DATA_PATH	internal data path for the program cache, disabled by default
+	VRAPI_HOST_LOG			"error", "warn" or "info" (default), the lowest priority printed
+	VRAPI_HOST_FULL_QUALITY	"1" fails the run if any rendered frame was submitted below the display
+							rate or with a smaller eye viewport than the first rendered frame
+
+Returns non-zero if android_main() logged any errors, or did not render a frame.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+
+#include <android/log.h>
+#include <android/looper.h>
+#include "../native_app_glue/android_native_app_glue.h"
+
+#include "VrApi.h"
+#include "VrApi_Host.h"
+
+#define HOST_DEFAULT_FRAMES		300
+
+typedef struct
+{
+	android_app *			App;
+	android_poll_source		CmdSource;
+	int						Commands[8];
+	int						CommandCount;
+	int						NextCommand;
+	int						FrameCount;
+	bool					Finishing;
+	bool					Stopping;
+	int						LogPriority;
+	int						Errors;
+} ovrHostActivity;
+
+static ovrHostActivity Activity;
+
+static void ovrHostActivity_PushCommand(ovrHostActivity * activity, const int cmd)
+{
+	activity->Commands[activity->CommandCount++] = cmd;
+}
+
+// Does what android_app_pre_exec_cmd() and android_app_post_exec_cmd() do around the app callback.
+static void ovrHostActivity_ProcessCommand(android_app * app, android_poll_source * source)
+{
+	(void)source;
+	const int cmd = Activity.Commands[Activity.NextCommand++];
+	static int windowHandle;
+	switch (cmd)
+	{
+		case APP_CMD_INIT_WINDOW:	app->window = (ANativeWindow *)&windowHandle; break;
+		case APP_CMD_START:			app->activityState = cmd; break;
+		case APP_CMD_RESUME:		app->activityState = cmd; break;
+		case APP_CMD_PAUSE:			app->activityState = cmd; break;
+		case APP_CMD_STOP:			app->activityState = cmd; break;
+		case APP_CMD_DESTROY:		app->destroyRequested = 1; break;
+	}
+	if (app->onAppCmd != NULL)
+	{
+		app->onAppCmd(app, cmd);
+	}
+	if (cmd == APP_CMD_TERM_WINDOW)
+	{
+		app->window = NULL;
+	}
+}
+
+extern "C" {
+
+int __android_log_print(int prio, const char * tag, const char * fmt, ...)
+{
+	if (prio >= ANDROID_LOG_ERROR)
+	{
+		Activity.Errors++;
+	}
+	if (prio < Activity.LogPriority)
+	{
+		return 0;
+	}
+	static const char priorities[] = "??VDIWEF";
+	FILE * file = (prio >= ANDROID_LOG_WARN) ? stderr : stdout;
+	va_list args;
+	va_start(args, fmt);
+	fprintf(file, "%c/%s: ", priorities[(prio >= 0 && prio <= ANDROID_LOG_FATAL) ? prio : 0], tag);
+	const int length = vfprintf(file, fmt, args);
+	fputc('\n', file);
+	va_end(args);
+	return length;
+}
+
+int ALooper_pollAll(int timeoutMillis, int * outFd, int * outEvents, void ** outData)
+{
+	(void)timeoutMillis;
+	if (outFd != NULL)
+	{
+		*outFd = -1;
+	}
+	if (outEvents != NULL)
+	{
+		*outEvents = 0;
+	}
+	if (!Activity.Stopping && (Activity.Finishing || ovrHost_GetFrameRecordCount() >= Activity.FrameCount))
+	{
+		Activity.Stopping = true;
+		ovrHostActivity_PushCommand(&Activity, APP_CMD_PAUSE);
+		ovrHostActivity_PushCommand(&Activity, APP_CMD_TERM_WINDOW);
+		ovrHostActivity_PushCommand(&Activity, APP_CMD_STOP);
+		ovrHostActivity_PushCommand(&Activity, APP_CMD_DESTROY);
+	}
+	if (Activity.NextCommand < Activity.CommandCount)
+	{
+		*outData = &Activity.CmdSource;
+		return LOOPER_ID_MAIN;
+	}
+	*outData = NULL;
+	return ALOOPER_POLL_TIMEOUT;
+}
+
+void ANativeActivity_finish(ANativeActivity * activity)
+{
+	(void)activity;
+	Activity.Finishing = true;
+}
+
+// There is no input on the host.
+int32_t AInputEvent_getType(const AInputEvent * event) { (void)event; return 0; }
+int32_t AInputEvent_getSource(const AInputEvent * event) { (void)event; return 0; }
+int32_t AKeyEvent_getKeyCode(const AInputEvent * keyEvent) { (void)keyEvent; return 0; }
+int32_t AKeyEvent_getAction(const AInputEvent * keyEvent) { (void)keyEvent; return 0; }
+float AMotionEvent_getRawX(const AInputEvent * motionEvent, size_t pointerIndex) { (void)motionEvent; (void)pointerIndex; return 0.0f; }
+float AMotionEvent_getRawY(const AInputEvent * motionEvent, size_t pointerIndex) { (void)motionEvent; (void)pointerIndex; return 0.0f; }
+
+}	// extern "C"
+
+void app_dummy()
+{
+}
+
+// Counts the rendered frames with more MinimumVsyncs than one, or a smaller eye viewport than the first rendered frame.
+static int CountDegradedFrames()
+{
+	int degradedFrames = 0;
+	float fullWidth = 0.0f;
+	const int frameCount = ovrHost_GetFrameRecordCount();
+	for (int i = 0; i < frameCount; i++)
+	{
+		const ovrHostFrameRecord * record = ovrHost_GetFrameRecord(i);
+		if (record == NULL || !record->Rendered)
+		{
+			continue;
+		}
+		const float width = record->Parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[0].TextureRect.width;
+		fullWidth = (fullWidth == 0.0f) ? width : fullWidth;
+		if (record->Parms.MinimumVsyncs > 1 || width < fullWidth)
+		{
+			degradedFrames++;
+		}
+	}
+	return degradedFrames;
+}
+
+int main(int argc, char * argv[])
+{
+	(void)argc;
+	(void)argv;
+
+	const char * frames = getenv("VRAPI_HOST_FRAMES");
+	const char * log = getenv("VRAPI_HOST_LOG");
+	Activity.FrameCount = (frames != NULL && atoi(frames) > 0) ? atoi(frames) : HOST_DEFAULT_FRAMES;
+	Activity.LogPriority = (log == NULL) ? ANDROID_LOG_INFO :
+							((strcasecmp(log, "error") == 0) ? ANDROID_LOG_ERROR :
+							((strcasecmp(log, "warn") == 0) ? ANDROID_LOG_WARN : ANDROID_LOG_INFO));
+
+	static JavaVM vm;
+	static ANativeActivity nativeActivity;
+	nativeActivity.vm = &vm;
+	nativeActivity.internalDataPath = getenv("VRAPI_HOST_DATA_PATH");
+	nativeActivity.externalDataPath = nativeActivity.internalDataPath;
+	nativeActivity.sdkVersion = 21;
+
+	static android_app app;
+	app.activity = &nativeActivity;
+	Activity.App = &app;
+	Activity.CmdSource.id = LOOPER_ID_MAIN;
+	Activity.CmdSource.app = &app;
+	Activity.CmdSource.process = ovrHostActivity_ProcessCommand;
+	ovrHostActivity_PushCommand(&Activity, APP_CMD_START);
+	ovrHostActivity_PushCommand(&Activity, APP_CMD_RESUME);
+	ovrHostActivity_PushCommand(&Activity, APP_CMD_INIT_WINDOW);
+	ovrHostActivity_PushCommand(&Activity, APP_CMD_GAINED_FOCUS);
+
+	android_main(&app);
+
+	ovrHostStats stats;
+	ovrHost_GetStats(&stats);
+	printf("%d of %d frames rendered, %d errors logged\n", stats.RenderedFrames, stats.FrameCount, Activity.Errors);
+
+	const char * fullQuality = getenv("VRAPI_HOST_FULL_QUALITY");
+	const int degradedFrames = (fullQuality != NULL && atoi(fullQuality) != 0) ? CountDegradedFrames() : 0;
+	if (degradedFrames > 0)
+	{
+		printf("%d frames submitted below the display rate or the eye resolution\n", degradedFrames);
+	}
+	return (Activity.Errors > 0 || stats.RenderedFrames == 0 || degradedFrames > 0) ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+/*
+Compares two benchmark reports of jni/main.cpp (see ovrBenchmark) and fails if a frame
+stage got slower by more than its threshold.
+
+	make bench_compare
+	./bench_compare [-t thresholds] [-update] baseline candidate.json
+
+The baseline is either a report, or a directory with one report per device profile,
+named <profile>.json after the profile in the candidate report. With -update the
+candidate becomes the baseline of its profile instead of being compared.
+
+Each line of the thresholds file, bench_thresholds.txt by default, gates one stage:
+
+	# stage			percentile	relative	absolute ms
+	eye_render		95			5			0.20
+
+The percentile of every stage is bootstrapped from the frame samples of both runs. The
+frame times are correlated from frame to frame, so the samples are resampled in blocks of
+consecutive frames rather than one by one. A stage regressed if the whole 95% confidence
+interval of the candidate minus the baseline percentile is above the larger of the
+relative threshold, in percent of the baseline, and the absolute threshold.
+
+The baseline must have the same profile and config as the candidate, and both must have
+samples of every gated stage, or the runs cannot be compared.
+
+Returns 1 if any stage regressed, 2 if the reports or the thresholds cannot be read, or
+the reports cannot be compared.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#define COMPARE_MAX_STAGES			16
+#define COMPARE_MAX_NAME			64
+#define BOOTSTRAP_ITERATIONS		2000
+#define BOOTSTRAP_BLOCK_FRAMES		30		// about the longest stretch of correlated frame times
+#define BOOTSTRAP_CONFIDENCE		0.95
+
+typedef struct
+{
+	char		Name[COMPARE_MAX_NAME];
+	float *		Samples;		// milliseconds
+	int			SampleCount;
+} ovrReportStage;
+
+typedef struct
+{
+	char *			Text;
+	char			Profile[COMPARE_MAX_NAME];
+	char			Config[1024];
+	int				MissedVsyncs;
+	ovrReportStage	Stages[COMPARE_MAX_STAGES];
+	int				StageCount;
+} ovrReport;
+
+typedef struct
+{
+	char	Stage[COMPARE_MAX_NAME];
+	float	Percentile;
+	float	Relative;		// percent of the baseline
+	float	Absolute;		// milliseconds
+} ovrThreshold;
+
+static char * ReadFile(const char * fileName)
+{
+	FILE * file = fopen(fileName, "rb");
+	if (file == NULL)
+	{
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	const long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char * text = (char *)malloc(length + 1);
+	const bool ok = (fread(text, 1, length, file) == (size_t)length);
+	fclose(file);
+	if (!ok)
+	{
+		free(text);
+		return NULL;
+	}
+	text[length] = '\0';
+	return text;
+}
+
+// Returns a pointer just past the colon of "key": at or after start, or NULL.
+static const char * FindKey(const char * start, const char * key)
+{
+	char pattern[COMPARE_MAX_NAME + 4];
+	snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+	const char * found = strstr(start, pattern);
+	return (found != NULL) ? found + strlen(pattern) : NULL;
+}
+
+static bool ReadString(const char * value, char * string, const size_t size)
+{
+	value = (value != NULL) ? strchr(value, '"') : NULL;
+	const char * end = (value != NULL) ? strchr(value + 1, '"') : NULL;
+	if (end == NULL || (size_t)(end - value - 1) >= size)
+	{
+		return false;
+	}
+	memcpy(string, value + 1, end - value - 1);
+	string[end - value - 1] = '\0';
+	return true;
+}
+
+// Reads the report written by ovrBenchmark_WriteReport. Only the members the comparison
+// needs are read, and the layout of that writer is assumed.
+static bool ovrReport_Load(ovrReport * report, const char * fileName)
+{
+	memset(report, 0, sizeof(ovrReport));
+	report->Text = ReadFile(fileName);
+	if (report->Text == NULL)
+	{
+		printf("failed to read %s\n", fileName);
+		return false;
+	}
+	const char * version = FindKey(report->Text, "version");
+	if (version == NULL || atoi(version) != 1)
+	{
+		printf("%s is not a version 1 benchmark report\n", fileName);
+		return false;
+	}
+	const char * config = FindKey(report->Text, "config");
+	const char * configEnd = (config != NULL) ? strchr(config, '}') : NULL;
+	if (!ReadString(FindKey(report->Text, "profile"), report->Profile, sizeof(report->Profile)) ||
+		configEnd == NULL || (size_t)(configEnd - config) >= sizeof(report->Config))
+	{
+		printf("%s has no profile or config\n", fileName);
+		return false;
+	}
+	memcpy(report->Config, config, configEnd + 1 - config);
+	report->Config[configEnd + 1 - config] = '\0';
+	const char * missedVsyncs = FindKey(report->Text, "missed_vsyncs");
+	report->MissedVsyncs = (missedVsyncs != NULL) ? atoi(missedVsyncs) : 0;
+
+	// Every stage is a line of the form "name": { ..., "samples": [ ... ] }
+	const char * stages = FindKey(report->Text, "stages");
+	const char * line = (stages != NULL) ? strchr(stages, '\n') : NULL;
+	while (line != NULL && report->StageCount < COMPARE_MAX_STAGES)
+	{
+		ovrReportStage * stage = &report->Stages[report->StageCount];
+		const char * samples = strstr(line, "\"samples\": [");
+		const char * lineEnd = strchr(line + 1, '\n');
+		if (samples == NULL || (lineEnd != NULL && samples > lineEnd) || !ReadString(line, stage->Name, sizeof(stage->Name)))
+		{
+			break;
+		}
+		const int capacity = (int)(((lineEnd != NULL) ? lineEnd : samples + strlen(samples)) - samples) / 2 + 1;
+		stage->Samples = (float *)malloc(capacity * sizeof(float));
+		char * next = (char *)strchr(samples, '[') + 1;
+		for (;;)
+		{
+			char * end = NULL;
+			const float sample = strtof(next, &end);
+			if (end == next || stage->SampleCount >= capacity)
+			{
+				break;
+			}
+			stage->Samples[stage->SampleCount++] = sample;
+			next = end + strspn(end, ", ");
+		}
+		report->StageCount++;
+		line = lineEnd;
+	}
+	if (report->StageCount == 0)
+	{
+		printf("%s has no stages\n", fileName);
+		return false;
+	}
+	return true;
+}
+
+static void ovrReport_Destroy(ovrReport * report)
+{
+	for (int i = 0; i < report->StageCount; i++)
+	{
+		free(report->Stages[i].Samples);
+	}
+	free(report->Text);
+	memset(report, 0, sizeof(ovrReport));
+}
+
+static const ovrReportStage * ovrReport_FindStage(const ovrReport * report, const char * name)
+{
+	for (int i = 0; i < report->StageCount; i++)
+	{
+		if (strcmp(report->Stages[i].Name, name) == 0)
+		{
+			return &report->Stages[i];
+		}
+	}
+	return NULL;
+}
+
+static int LoadThresholds(const char * fileName, ovrThreshold * thresholds, const int maxThresholds)
+{
+	FILE * file = fopen(fileName, "r");
+	if (file == NULL)
+	{
+		printf("failed to read %s\n", fileName);
+		return -1;
+	}
+	int count = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL && count < maxThresholds)
+	{
+		ovrThreshold * threshold = &thresholds[count];
+		if (line[0] == '#' || sscanf(line, "%63s %f %f %f", threshold->Stage, &threshold->Percentile,
+			&threshold->Relative, &threshold->Absolute) != 4)
+		{
+			continue;
+		}
+		count++;
+	}
+	fclose(file);
+	return count;
+}
+
+// The same pseudo random sequence on every run, so the verdict does not flicker.
+static unsigned int Random = 1;
+
+static int RandomInt(const int range)
+{
+	Random = 1664525U * Random + 1013904223U;
+	return (int)(((unsigned long long)(Random >> 8) * range) >> 24);
+}
+
+static int CompareFloats(const void * a, const void * b)
+{
+	const float fa = *(const float *)a;
+	const float fb = *(const float *)b;
+	return (fa < fb) ? -1 : ((fa > fb) ? 1 : 0);
+}
+
+// Nearest rank percentile, which sorts the samples.
+static float Percentile(float * samples, const int count, const float percent)
+{
+	qsort(samples, count, sizeof(float), CompareFloats);
+	int rank = (int)ceilf(percent * 0.01f * count);
+	rank = (rank < 1) ? 1 : ((rank > count) ? count : rank);
+	return samples[rank - 1];
+}
+
+// Percentile of one moving block bootstrap resample of the stage.
+static float ResamplePercentile(const ovrReportStage * stage, float * resample, const float percent)
+{
+	const int count = stage->SampleCount;
+	const int block = (count < BOOTSTRAP_BLOCK_FRAMES) ? count : BOOTSTRAP_BLOCK_FRAMES;
+	for (int i = 0; i < count; i += block)
+	{
+		const int start = RandomInt(count - block + 1);
+		for (int j = 0; j < block && i + j < count; j++)
+		{
+			resample[i + j] = stage->Samples[start + j];
+		}
+	}
+	return Percentile(resample, count, percent);
+}
+
+typedef struct
+{
+	float	Baseline;
+	float	Candidate;
+	float	Low;		// confidence interval of the candidate minus the baseline
+	float	High;
+} ovrDelta;
+
+static ovrDelta BootstrapDelta(const ovrReportStage * baseline, const ovrReportStage * candidate, const float percent)
+{
+	ovrDelta delta;
+	float * baselineResample = (float *)malloc(baseline->SampleCount * sizeof(float));
+	float * candidateResample = (float *)malloc(candidate->SampleCount * sizeof(float));
+	memcpy(baselineResample, baseline->Samples, baseline->SampleCount * sizeof(float));
+	memcpy(candidateResample, candidate->Samples, candidate->SampleCount * sizeof(float));
+	delta.Baseline = Percentile(baselineResample, baseline->SampleCount, percent);
+	delta.Candidate = Percentile(candidateResample, candidate->SampleCount, percent);
+
+	float * deltas = (float *)malloc(BOOTSTRAP_ITERATIONS * sizeof(float));
+	for (int i = 0; i < BOOTSTRAP_ITERATIONS; i++)
+	{
+		deltas[i] = ResamplePercentile(candidate, candidateResample, percent) - ResamplePercentile(baseline, baselineResample, percent);
+	}
+	const float tail = (float)(100.0 * (1.0 - BOOTSTRAP_CONFIDENCE) * 0.5);
+	delta.Low = Percentile(deltas, BOOTSTRAP_ITERATIONS, tail);
+	delta.High = Percentile(deltas, BOOTSTRAP_ITERATIONS, 100.0f - tail);
+
+	free(deltas);
+	free(candidateResample);
+	free(baselineResample);
+	return delta;
+}
+
+static bool CopyFile(const char * from, const char * to)
+{
+	char * text = ReadFile(from);
+	FILE * file = (text != NULL) ? fopen(to, "wb") : NULL;
+	const bool ok = (file != NULL) && fwrite(text, 1, strlen(text), file) == strlen(text);
+	if (file != NULL)
+	{
+		fclose(file);
+	}
+	free(text);
+	return ok;
+}
+
+int main(int argc, char * argv[])
+{
+	const char * thresholdsFile = "bench_thresholds.txt";
+	bool update = false;
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc)
+		{
+			thresholdsFile = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "-update") == 0)
+		{
+			update = true;
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (argc - arg != 2)
+	{
+		printf("usage: %s [-t thresholds] [-update] baseline.json|baseline-directory candidate.json\n", argv[0]);
+		return 2;
+	}
+	const char * baselineArg = argv[arg];
+	const char * candidateFile = argv[arg + 1];
+
+	ovrReport candidate;
+	if (!ovrReport_Load(&candidate, candidateFile))
+	{
+		return 2;
+	}
+
+	// A directory holds the baselines of all device profiles.
+	char baselineFile[1024];
+	struct stat baselineStat;
+	if (stat(baselineArg, &baselineStat) == 0 && S_ISDIR(baselineStat.st_mode))
+	{
+		snprintf(baselineFile, sizeof(baselineFile), "%s/%s.json", baselineArg, candidate.Profile);
+	}
+	else
+	{
+		snprintf(baselineFile, sizeof(baselineFile), "%s", baselineArg);
+	}
+
+	if (update)
+	{
+		const bool ok = CopyFile(candidateFile, baselineFile);
+		printf("%s %s as the %s baseline\n", ok ? "stored" : "failed to store", candidateFile, candidate.Profile);
+		ovrReport_Destroy(&candidate);
+		return ok ? 0 : 2;
+	}
+
+	ovrReport baseline;
+	ovrThreshold thresholds[COMPARE_MAX_STAGES];
+	const int thresholdCount = LoadThresholds(thresholdsFile, thresholds, COMPARE_MAX_STAGES);
+	if (thresholdCount < 0 || !ovrReport_Load(&baseline, baselineFile))
+	{
+		ovrReport_Destroy(&candidate);
+		return 2;
+	}
+
+	printf("%s against %s\n", candidateFile, baselineFile);
+
+	// Runs of another device, resolution, MSAA or GPU timer measure different work.
+	const bool sameProfile = (strcmp(baseline.Profile, candidate.Profile) == 0);
+	const bool sameConfig = (strcmp(baseline.Config, candidate.Config) == 0);
+	if (!sameProfile)
+	{
+		printf("the profiles differ, %s and %s\n", baseline.Profile, candidate.Profile);
+	}
+	if (!sameConfig)
+	{
+		printf("the configs differ\n  baseline:  %s\n  candidate: %s\n", baseline.Config, candidate.Config);
+	}
+	if (!sameProfile || !sameConfig)
+	{
+		ovrReport_Destroy(&baseline);
+		ovrReport_Destroy(&candidate);
+		return 2;
+	}
+	printf("missed vsyncs: %d -> %d\n", baseline.MissedVsyncs, candidate.MissedVsyncs);
+	printf("%-16s %4s %10s %10s %10s %22s %10s\n", "stage", "pct", "base ms", "cand ms", "delta", "95% interval", "limit");
+
+	// A gated stage without samples, for instance the GPU time of a run on the fence timer,
+	// cannot be compared any more than runs of another config.
+	int regressions = 0;
+	int incomparable = 0;
+	for (int i = 0; i < thresholdCount; i++)
+	{
+		const ovrThreshold * threshold = &thresholds[i];
+		const ovrReportStage * baselineStage = ovrReport_FindStage(&baseline, threshold->Stage);
+		const ovrReportStage * candidateStage = ovrReport_FindStage(&candidate, threshold->Stage);
+		if (baselineStage == NULL || candidateStage == NULL || baselineStage->SampleCount == 0 || candidateStage->SampleCount == 0)
+		{
+			printf("%-16s no samples in %s  MISSING\n", threshold->Stage, (baselineStage == NULL || baselineStage->SampleCount == 0) ? "baseline" : "candidate");
+			incomparable++;
+			continue;
+		}
+		const ovrDelta delta = BootstrapDelta(baselineStage, candidateStage, threshold->Percentile);
+		const float relativeLimit = delta.Baseline * threshold->Relative * 0.01f;
+		const float limit = (relativeLimit > threshold->Absolute) ? relativeLimit : threshold->Absolute;
+		const char * verdict = "ok";
+		if (delta.Low > limit)
+		{
+			verdict = "REGRESSED";
+			regressions++;
+		}
+		else if (delta.High < -limit)
+		{
+			verdict = "improved";
+		}
+		printf("%-16s p%-3.0f %10.3f %10.3f %+10.3f   [%+8.3f, %+8.3f] %+10.3f  %s\n", threshold->Stage, threshold->Percentile,
+			delta.Baseline, delta.Candidate, delta.Candidate - delta.Baseline, delta.Low, delta.High, limit, verdict);
+	}
+	printf("%d of %d stages regressed, %d could not be compared\n", regressions, thresholdCount, incomparable);
+
+	ovrReport_Destroy(&baseline);
+	ovrReport_Destroy(&candidate);
+	return (incomparable > 0) ? 2 : ((regressions > 0) ? 1 : 0);
+}
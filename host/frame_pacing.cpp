@@ -0,0 +1,102 @@
+/*
+Drives the host vrapi stand-in like the render loop of jni/main.cpp, without
+rendering, to check the frame pacing and the display time prediction.
+
+Each frame takes the given amount of CPU time between vrapi_GetPredictedDisplayTime()
+and vrapi_SubmitFrame(). A frame that fits in the refresh period times MinimumVsyncs
+must be displayed at its predicted time, and a frame that takes longer must not be.
+
+	make frame_pacing
+	VRAPI_HOST_CLOCK=virtual ./frame_pacing [frame ms] [minimum vsyncs] [frames]
+
+Returns non-zero if the frames are not displayed when they should be.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "VrApi.h"
+#include "VrApi_Helpers.h"
+#include "VrApi_Host.h"
+
+static void BusyWait(const double seconds)
+{
+	const double start = vrapi_GetTimeInSeconds();
+	while (vrapi_GetTimeInSeconds() - start < seconds)
+	{
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	const double frameSeconds = (argc > 1) ? atof(argv[1]) * 0.001 : 0.008;
+	const int minimumVsyncs = (argc > 2) ? atoi(argv[2]) : 1;
+	const int frameCount = (argc > 3) ? atoi(argv[3]) : 300;
+
+	// There is no Java VM on the host.
+	ovrJava java;
+	java.Vm = NULL;
+	java.Env = NULL;
+	java.ActivityObject = NULL;
+
+	const ovrInitParms initParms = vrapi_DefaultInitParms(&java);
+	vrapi_Initialize(&initParms);
+	const ovrHmdInfo hmdInfo = vrapi_GetHmdInfo(&java);
+	const double budgetSeconds = minimumVsyncs / hmdInfo.DisplayRefreshRate;
+
+	const ovrModeParms modeParms = vrapi_DefaultModeParms(&java);
+	ovrMobile * ovr = vrapi_EnterVrMode(&modeParms);
+
+	printf("%d frames of %1.2f ms with %d minimum vsyncs at %1.0f Hz\n", frameCount, frameSeconds * 1000.0,
+			minimumVsyncs, hmdInfo.DisplayRefreshRate);
+
+	for (long long frameIndex = 1; frameIndex <= frameCount; frameIndex++)
+	{
+		const double predictedDisplayTime = vrapi_GetPredictedDisplayTime(ovr, frameIndex);
+		const ovrTracking tracking = vrapi_GetPredictedTracking(ovr, predictedDisplayTime);
+
+		BusyWait(frameSeconds);
+
+		ovrFrameParms parms = vrapi_DefaultFrameParms(&java, VRAPI_FRAME_INIT_DEFAULT, NULL);
+		parms.FrameIndex = frameIndex;
+		parms.MinimumVsyncs = minimumVsyncs;
+		for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+		{
+			parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].HeadPose = tracking.HeadPose;
+		}
+		vrapi_SubmitFrame(ovr, &parms);
+	}
+
+	// The first frames are displayed early, while the pipeline fills up.
+	int errors = 0;
+	int lateFrames = 0;
+	for (int index = 2; index < ovrHost_GetFrameRecordCount(); index++)
+	{
+		const ovrHostFrameRecord * record = ovrHost_GetFrameRecord(index);
+		if (record == NULL)
+		{
+			continue;
+		}
+		lateFrames += (record->MissedVsyncs > 0) ? 1 : 0;
+		if (record->DisplayTime < record->PredictedDisplayTime - 1e-6)
+		{
+			printf("frame %lld displayed %1.2f ms before its predicted time\n", record->FrameIndex,
+					(record->PredictedDisplayTime - record->DisplayTime) * 1000.0);
+			errors++;
+		}
+	}
+	if (frameSeconds < budgetSeconds * 0.9 && lateFrames > 0)
+	{
+		printf("%d frames were late while they fit in the %1.2f ms budget\n", lateFrames, budgetSeconds * 1000.0);
+		errors++;
+	}
+	if (frameSeconds > budgetSeconds * 1.1 && lateFrames == 0)
+	{
+		printf("no frames were late while they took longer than the %1.2f ms budget\n", budgetSeconds * 1000.0);
+		errors++;
+	}
+
+	vrapi_LeaveVrMode(ovr);
+	vrapi_Shutdown();
+	return (errors > 0) ? 1 : 0;
+}
@@ -0,0 +1,8 @@
+#ifndef HOST_ANDROID_CONFIGURATION_H
+#define HOST_ANDROID_CONFIGURATION_H
+
+// Host stand-in.
+
+typedef struct AConfiguration AConfiguration;
+
+#endif // HOST_ANDROID_CONFIGURATION_H
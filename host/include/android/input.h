@@ -0,0 +1,53 @@
+#ifndef HOST_ANDROID_INPUT_H
+#define HOST_ANDROID_INPUT_H
+
+// Host stand-in, implemented in host/android_host.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct AInputEvent AInputEvent;
+typedef struct AInputQueue AInputQueue;
+
+enum
+{
+	AINPUT_EVENT_TYPE_KEY = 1,
+	AINPUT_EVENT_TYPE_MOTION = 2
+};
+
+enum
+{
+	AINPUT_SOURCE_TOUCHSCREEN = 0x00001002,
+	AINPUT_SOURCE_MOUSE = 0x00002002,
+	AINPUT_SOURCE_JOYSTICK = 0x01000010
+};
+
+enum
+{
+	AKEYCODE_BACK = 4
+};
+
+enum
+{
+	AKEY_EVENT_ACTION_DOWN = 0,
+	AKEY_EVENT_ACTION_UP = 1
+};
+
+enum
+{
+	AMOTION_EVENT_ACTION_MASK = 0xff,
+	AMOTION_EVENT_ACTION_DOWN = 0,
+	AMOTION_EVENT_ACTION_UP = 1
+};
+
+extern "C"
+{
+int32_t AInputEvent_getType(const AInputEvent * event);
+int32_t AInputEvent_getSource(const AInputEvent * event);
+int32_t AKeyEvent_getKeyCode(const AInputEvent * keyEvent);
+int32_t AKeyEvent_getAction(const AInputEvent * keyEvent);
+float AMotionEvent_getRawX(const AInputEvent * motionEvent, size_t pointerIndex);
+float AMotionEvent_getRawY(const AInputEvent * motionEvent, size_t pointerIndex);
+}
+
+#endif // HOST_ANDROID_INPUT_H
@@ -0,0 +1,18 @@
+#ifndef HOST_ANDROID_LOOPER_H
+#define HOST_ANDROID_LOOPER_H
+
+// Host stand-in, implemented in host/android_host.cpp.
+
+typedef struct ALooper ALooper;
+
+enum
+{
+	ALOOPER_POLL_WAKE = -1,
+	ALOOPER_POLL_CALLBACK = -2,
+	ALOOPER_POLL_TIMEOUT = -3,
+	ALOOPER_POLL_ERROR = -4
+};
+
+extern "C" int ALooper_pollAll(int timeoutMillis, int * outFd, int * outEvents, void ** outData);
+
+#endif // HOST_ANDROID_LOOPER_H
@@ -0,0 +1,27 @@
+#ifndef HOST_ANDROID_NATIVE_ACTIVITY_H
+#define HOST_ANDROID_NATIVE_ACTIVITY_H
+
+// Host stand-in, filled in by host/android_host.cpp.
+
+#include <stdint.h>
+#include <jni.h>
+#include <android/input.h>
+#include <android/native_window.h>
+
+typedef struct ANativeActivity
+{
+	void *			callbacks;
+	JavaVM *		vm;
+	JNIEnv *		env;
+	jobject			clazz;
+	const char *	internalDataPath;
+	const char *	externalDataPath;
+	int32_t			sdkVersion;
+	void *			instance;
+	void *			assetManager;
+	const char *	obbPath;
+} ANativeActivity;
+
+extern "C" void ANativeActivity_finish(ANativeActivity * activity);
+
+#endif // HOST_ANDROID_NATIVE_ACTIVITY_H
@@ -0,0 +1,10 @@
+#ifndef HOST_ANDROID_NATIVE_WINDOW_H
+#define HOST_ANDROID_NATIVE_WINDOW_H
+
+// Host stand-in. The headless build renders to pbuffers, so a window is only a handle.
+
+#include <android/rect.h>
+
+typedef struct ANativeWindow ANativeWindow;
+
+#endif // HOST_ANDROID_NATIVE_WINDOW_H
@@ -0,0 +1,9 @@
+#ifndef HOST_ANDROID_NATIVE_WINDOW_JNI_H
+#define HOST_ANDROID_NATIVE_WINDOW_JNI_H
+
+// Host stand-in.
+
+#include <jni.h>
+#include <android/native_window.h>
+
+#endif // HOST_ANDROID_NATIVE_WINDOW_JNI_H
@@ -0,0 +1,10 @@
+#ifndef HOST_ANDROID_SENSOR_H
+#define HOST_ANDROID_SENSOR_H
+
+// Host stand-in. The sensors are not used on the host.
+
+typedef struct ASensor ASensor;
+typedef struct ASensorManager ASensorManager;
+typedef struct ASensorEventQueue ASensorEventQueue;
+
+#endif // HOST_ANDROID_SENSOR_H
@@ -0,0 +1,25 @@
+#ifndef HOST_JNI_H
+#define HOST_JNI_H
+
+/*
+Host stand-in for the JNI types the native activity uses. There is no Java VM on the
+host, so attaching a thread always succeeds with a NULL environment.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t jint;
+typedef class _jobject * jobject;
+typedef struct _JNIEnv JNIEnv;
+
+#define JNI_OK		0
+
+struct _JavaVM
+{
+	jint AttachCurrentThread(JNIEnv ** env, void * args) { (void)args; *env = NULL; return JNI_OK; }
+	jint DetachCurrentThread() { return JNI_OK; }
+};
+typedef struct _JavaVM JavaVM;
+
+#endif // HOST_JNI_H
@@ -0,0 +1,207 @@
+/*
+Simulates vsync and scanout on the host to check the beam racing schedule of
+SliceSchedule.h against warping the whole frame at once.
+
+A scripted head turns with a mix of sine waves. For every slice of every frame the
+simulator samples the pose when the slice is started, predicts it for the display
+time of the slice with the angular velocity, like vrapi_GetPredictedTracking, and
+compares the prediction with where the head really is when the slice is displayed.
+The warp of each slice takes a jittered amount of GPU time, and a slice that is not
+done by its scanout is counted as torn.
+
+	g++ -O2 -o scanout_sim scanout_sim.cpp -lm
+	./scanout_sim [slices] [pre-schedule ms] [slice warp ms] [frames]
+
+The default pre-schedule of 4 ms leaves room for four slice warps. The VrApi default of
+14 ms gives the slices more latency than warping the whole frame.
+
+Returns non-zero if the schedule is inconsistent, slices tear, or the slices do not have
+less latency than the full frame.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "SliceSchedule.h"
+
+#define SIM_REFRESH_RATE		60.0f
+#define SIM_MAX_SLICES			64
+#define SIM_WARP_JITTER			0.25	// the slice warp time varies up to this fraction
+#define SIM_FRAME_WARP_LEAD		0.004	// a full frame warp starts this long before vsync
+
+#define MATH_PI					3.14159265358979323846
+
+// Head yaw in degrees over time, two sine waves for smooth turns with some quick ones.
+static double HeadYaw(const double time)
+{
+	return 40.0 * sin(2.0 * MATH_PI * 0.3 * time) + 8.0 * sin(2.0 * MATH_PI * 2.1 * time);
+}
+
+static double HeadYawVelocity(const double time)
+{
+	return 40.0 * 2.0 * MATH_PI * 0.3 * cos(2.0 * MATH_PI * 0.3 * time) + 8.0 * 2.0 * MATH_PI * 2.1 * cos(2.0 * MATH_PI * 2.1 * time);
+}
+
+// Samples the pose at sampleTime and predicts it for displayTime, then returns the error in degrees.
+static double PredictionError(const double sampleTime, const double displayTime)
+{
+	const double predicted = HeadYaw(sampleTime) + HeadYawVelocity(sampleTime) * (displayTime - sampleTime);
+	return fabs(predicted - HeadYaw(displayTime));
+}
+
+static unsigned int Random = 1;
+
+static double RandomDouble()
+{
+	Random = 1664525U * Random + 1013904223U;
+	return (Random >> 8) * (1.0 / 16777216.0);
+}
+
+typedef struct
+{
+	double	LatencySum;			// from pose sample to display
+	double	ErrorSum;
+	double	MaxError;
+	int		Count;
+	int		Torn;
+} ovrSliceStats;
+
+static void ovrSliceStats_Add(ovrSliceStats * stats, const double sampleTime, const double displayTime)
+{
+	const double error = PredictionError(sampleTime, displayTime);
+	stats->LatencySum += displayTime - sampleTime;
+	stats->ErrorSum += error;
+	stats->MaxError = (error > stats->MaxError) ? error : stats->MaxError;
+	stats->Count++;
+}
+
+// The slices have to tile the scanout of both eyes in order, and start before they are scanned out.
+static int CheckSchedule(const ovrSliceSchedule * schedule)
+{
+	int errors = 0;
+	const double vsyncTime = 1.0;
+	for (int slice = 0; slice < schedule->SliceCount; slice++)
+	{
+		const double scanoutTime = ovrSliceSchedule_GetScanoutTime(schedule, vsyncTime, slice);
+		const double nextScanoutTime = ovrSliceSchedule_GetScanoutTime(schedule, vsyncTime, slice + 1);
+		const double displayTime = ovrSliceSchedule_GetDisplayTime(schedule, vsyncTime, slice);
+		const double startTime = ovrSliceSchedule_GetStartTime(schedule, vsyncTime, slice);
+		if (!(startTime < scanoutTime && scanoutTime < displayTime && displayTime < nextScanoutTime))
+		{
+			printf("slice %d: out of order, start %1.3f scanout %1.3f display %1.3f next %1.3f ms\n", slice,
+				(startTime - vsyncTime) * 1000.0, (scanoutTime - vsyncTime) * 1000.0,
+				(displayTime - vsyncTime) * 1000.0, (nextScanoutTime - vsyncTime) * 1000.0);
+			errors++;
+		}
+		float left;
+		float right;
+		ovrSliceSchedule_GetEyeColumns(schedule, slice, &left, &right);
+		const int eye = ovrSliceSchedule_GetEye(schedule, slice);
+		const int expectedEye = (slice < schedule->SliceCount / SLICE_SCHEDULE_EYES) ? 0 : 1;
+		if (eye != expectedEye || left >= right || (slice % (schedule->SliceCount / SLICE_SCHEDULE_EYES) == 0 && left != 0.0f))
+		{
+			printf("slice %d: eye %d columns %1.3f - %1.3f\n", slice, eye, left, right);
+			errors++;
+		}
+	}
+	const double lastEnd = ovrSliceSchedule_GetScanoutTime(schedule, vsyncTime, schedule->SliceCount);
+	if (fabs(lastEnd - vsyncTime - schedule->ScanoutSeconds) > 1e-9)
+	{
+		printf("the slices end %1.3f ms after vsync instead of %1.3f ms\n", (lastEnd - vsyncTime) * 1000.0, schedule->ScanoutSeconds * 1000.0);
+		errors++;
+	}
+	return errors;
+}
+
+int main(int argc, char * argv[])
+{
+	const int sliceCount = (argc > 1) ? atoi(argv[1]) : 8;
+	const double preScheduleSeconds = (argc > 2) ? atof(argv[2]) * 0.001 : 0.004;
+	const double sliceWarpSeconds = (argc > 3) ? atof(argv[3]) * 0.001 : 0.0008;
+	const int frameCount = (argc > 4) ? atoi(argv[4]) : 600;
+
+	ovrSliceSchedule schedule;
+	ovrSliceSchedule_Create(&schedule, (sliceCount < SIM_MAX_SLICES) ? sliceCount : SIM_MAX_SLICES, SIM_REFRESH_RATE, preScheduleSeconds);
+
+	printf("%d slices of %1.2f ms at %1.0f Hz, started %1.1f ms ahead, %1.2f ms warp per slice, %d frames\n",
+		schedule.SliceCount, schedule.ScanoutSeconds * 1000.0 / schedule.SliceCount, SIM_REFRESH_RATE,
+		schedule.PreScheduleSeconds * 1000.0, sliceWarpSeconds * 1000.0, frameCount);
+
+	int errors = CheckSchedule(&schedule);
+
+	ovrSliceStats sliced[SIM_MAX_SLICES] = {};
+	ovrSliceStats full[SIM_MAX_SLICES] = {};
+	for (int frame = 0; frame < frameCount; frame++)
+	{
+		const double vsyncTime = 1.0 + frame * schedule.RefreshPeriod;
+
+		// The whole frame is warped with one pose predicted for the middle of the scanout.
+		const double frameSampleTime = vsyncTime - SIM_FRAME_WARP_LEAD;
+		const double frameDisplayTime = vsyncTime + 0.5 * schedule.ScanoutSeconds;
+		const double frameYaw = HeadYaw(frameSampleTime) + HeadYawVelocity(frameSampleTime) * (frameDisplayTime - frameSampleTime);
+
+		// The slices are warped one after the other on the GPU, each as soon as it is scheduled.
+		double gpuFreeTime = 0.0;
+		for (int slice = 0; slice < schedule.SliceCount; slice++)
+		{
+			const double startTime = ovrSliceSchedule_GetStartTime(&schedule, vsyncTime, slice);
+			const double scanoutTime = ovrSliceSchedule_GetScanoutTime(&schedule, vsyncTime, slice);
+			const double displayTime = ovrSliceSchedule_GetDisplayTime(&schedule, vsyncTime, slice);
+
+			const double warpStart = (startTime > gpuFreeTime) ? startTime : gpuFreeTime;
+			gpuFreeTime = warpStart + sliceWarpSeconds * (1.0 + SIM_WARP_JITTER * RandomDouble());
+			if (gpuFreeTime > scanoutTime)
+			{
+				sliced[slice].Torn++;
+			}
+			ovrSliceStats_Add(&sliced[slice], startTime, displayTime);
+
+			full[slice].LatencySum += displayTime - frameSampleTime;
+			const double error = fabs(frameYaw - HeadYaw(displayTime));
+			full[slice].ErrorSum += error;
+			full[slice].MaxError = (error > full[slice].MaxError) ? error : full[slice].MaxError;
+			full[slice].Count++;
+		}
+	}
+
+	printf("slice eye  columns      |  sliced latency  error  max   torn |  full frame latency  error  max\n");
+	ovrSliceStats slicedTotal = {};
+	ovrSliceStats fullTotal = {};
+	for (int slice = 0; slice < schedule.SliceCount; slice++)
+	{
+		float left;
+		float right;
+		ovrSliceSchedule_GetEyeColumns(&schedule, slice, &left, &right);
+		printf("%5d %3d  %1.3f-%1.3f  |  %7.2f ms %6.3f %6.3f %5d |  %10.2f ms %6.3f %6.3f\n", slice,
+			ovrSliceSchedule_GetEye(&schedule, slice), left, right,
+			sliced[slice].LatencySum * 1000.0 / sliced[slice].Count, sliced[slice].ErrorSum / sliced[slice].Count,
+			sliced[slice].MaxError, sliced[slice].Torn,
+			full[slice].LatencySum * 1000.0 / full[slice].Count, full[slice].ErrorSum / full[slice].Count, full[slice].MaxError);
+		slicedTotal.LatencySum += sliced[slice].LatencySum;
+		slicedTotal.ErrorSum += sliced[slice].ErrorSum;
+		slicedTotal.MaxError = (sliced[slice].MaxError > slicedTotal.MaxError) ? sliced[slice].MaxError : slicedTotal.MaxError;
+		slicedTotal.Count += sliced[slice].Count;
+		slicedTotal.Torn += sliced[slice].Torn;
+		fullTotal.LatencySum += full[slice].LatencySum;
+		fullTotal.ErrorSum += full[slice].ErrorSum;
+		fullTotal.MaxError = (full[slice].MaxError > fullTotal.MaxError) ? full[slice].MaxError : fullTotal.MaxError;
+		fullTotal.Count += full[slice].Count;
+	}
+	printf("sliced:     %1.2f ms latency, %1.3f degrees error on average, %1.3f at most, %d of %d slices torn\n",
+		slicedTotal.LatencySum * 1000.0 / slicedTotal.Count, slicedTotal.ErrorSum / slicedTotal.Count, slicedTotal.MaxError,
+		slicedTotal.Torn, slicedTotal.Count);
+	printf("full frame: %1.2f ms latency, %1.3f degrees error on average, %1.3f at most\n",
+		fullTotal.LatencySum * 1000.0 / fullTotal.Count, fullTotal.ErrorSum / fullTotal.Count, fullTotal.MaxError);
+
+	if (errors > 0)
+	{
+		printf("%d schedule errors\n", errors);
+	}
+	const bool slower = slicedTotal.LatencySum / slicedTotal.Count >= fullTotal.LatencySum / fullTotal.Count;
+	if (slower)
+	{
+		printf("the slices have more latency than the full frame, lower the pre-schedule\n");
+	}
+	return (errors > 0 || slicedTotal.Torn > 0 || slower) ? 1 : 0;
+}
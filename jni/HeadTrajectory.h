@@ -0,0 +1,226 @@
+#ifndef HEAD_TRAJECTORY_H
+#define HEAD_TRAJECTORY_H
+
+/*
+Scripted head motion, shared by the benchmark of main.cpp and the host vrapi stand-in, so
+the benchmark renders the same head motion that the host simulates.
+
+A trajectory is "still", a slow look around with a fast jitter ("sine", the same sine
+waves as the host scanout_sim), a constant turn to the left ("turn"), or a file with one
+"time yaw pitch roll x y z" key pose per line, in seconds, degrees and meters, which is
+looped. Lines that start with '#' are skipped, and the position may be left out.
+
+The includer may define HEAD_TRAJECTORY_LOG_ERROR(...) to report files that cannot be
+loaded, it prints to stderr otherwise.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "VrApi_Types.h"
+
+#ifndef HEAD_TRAJECTORY_LOG_ERROR
+#define HEAD_TRAJECTORY_LOG_ERROR(...)		((void)fprintf(stderr, __VA_ARGS__), (void)fputc('\n', stderr))
+#endif
+
+#define HEAD_TRAJECTORY_MAX_KEY_POSES		(60 * 60 * 10)	// ten minutes at 60 Hz
+#define HEAD_TRAJECTORY_VELOCITY_SECONDS	0.001			// between the samples the angular velocity is taken from
+#define HEAD_TRAJECTORY_PI					3.14159265358979323846
+
+typedef enum
+{
+	HEAD_TRAJECTORY_TRACKED,		// leave the tracked head pose alone, the same as still where there is no tracking
+	HEAD_TRAJECTORY_STILL,
+	HEAD_TRAJECTORY_SINE,
+	HEAD_TRAJECTORY_TURN,
+	HEAD_TRAJECTORY_FILE
+} ovrHeadTrajectoryType;
+
+typedef struct
+{
+	float		Time;
+	float		Yaw;		// degrees
+	float		Pitch;
+	float		Roll;
+	ovrVector3f	Position;	// meters
+} ovrHeadKeyPose;
+
+typedef struct
+{
+	ovrHeadTrajectoryType	Type;
+	ovrHeadKeyPose *		KeyPoses;
+	int						KeyPoseCount;
+	bool					HasPosition;	// the file has positions
+} ovrHeadTrajectory;
+
+static inline void ovrHeadTrajectory_Clear(ovrHeadTrajectory * trajectory)
+{
+	trajectory->Type = HEAD_TRAJECTORY_TRACKED;
+	trajectory->KeyPoses = NULL;
+	trajectory->KeyPoseCount = 0;
+	trajectory->HasPosition = false;
+}
+
+static inline bool ovrHeadTrajectory_Load(ovrHeadTrajectory * trajectory, const char * fileName)
+{
+	FILE * file = fopen(fileName, "r");
+	if (file == NULL)
+	{
+		HEAD_TRAJECTORY_LOG_ERROR("ovrHeadTrajectory_Load: failed to open %s", fileName);
+		return false;
+	}
+	trajectory->KeyPoses = (ovrHeadKeyPose *)malloc(HEAD_TRAJECTORY_MAX_KEY_POSES * sizeof(ovrHeadKeyPose));
+	trajectory->KeyPoseCount = 0;
+	trajectory->HasPosition = false;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL && trajectory->KeyPoseCount < HEAD_TRAJECTORY_MAX_KEY_POSES)
+	{
+		if (line[0] == '#')
+		{
+			continue;
+		}
+		ovrHeadKeyPose * pose = &trajectory->KeyPoses[trajectory->KeyPoseCount];
+		memset(pose, 0, sizeof(ovrHeadKeyPose));
+		const int count = sscanf(line, "%f %f %f %f %f %f %f", &pose->Time, &pose->Yaw, &pose->Pitch, &pose->Roll,
+			&pose->Position.x, &pose->Position.y, &pose->Position.z);
+		if (count < 2)
+		{
+			continue;
+		}
+		if (trajectory->KeyPoseCount > 0 && pose->Time <= trajectory->KeyPoses[trajectory->KeyPoseCount - 1].Time)
+		{
+			HEAD_TRAJECTORY_LOG_ERROR("ovrHeadTrajectory_Load: key pose times must increase in %s, stopped at %1.3f", fileName, pose->Time);
+			break;
+		}
+		trajectory->HasPosition |= (count > 4);
+		trajectory->KeyPoseCount++;
+	}
+	fclose(file);
+	if (trajectory->KeyPoseCount == 0)
+	{
+		HEAD_TRAJECTORY_LOG_ERROR("ovrHeadTrajectory_Load: no key poses in %s", fileName);
+		free(trajectory->KeyPoses);
+		trajectory->KeyPoses = NULL;
+		return false;
+	}
+	return true;
+}
+
+// Returns false if the name is neither a known trajectory nor a file with key poses.
+static inline bool ovrHeadTrajectory_Create(ovrHeadTrajectory * trajectory, const char * name)
+{
+	ovrHeadTrajectory_Clear(trajectory);
+	if (strcasecmp(name, "tracked") == 0)
+	{
+		trajectory->Type = HEAD_TRAJECTORY_TRACKED;
+	}
+	else if (strcasecmp(name, "still") == 0)
+	{
+		trajectory->Type = HEAD_TRAJECTORY_STILL;
+	}
+	else if (strcasecmp(name, "sine") == 0)
+	{
+		trajectory->Type = HEAD_TRAJECTORY_SINE;
+	}
+	else if (strcasecmp(name, "turn") == 0)
+	{
+		trajectory->Type = HEAD_TRAJECTORY_TURN;
+	}
+	else if (ovrHeadTrajectory_Load(trajectory, name))
+	{
+		trajectory->Type = HEAD_TRAJECTORY_FILE;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+static inline void ovrHeadTrajectory_Destroy(ovrHeadTrajectory * trajectory)
+{
+	free(trajectory->KeyPoses);
+	ovrHeadTrajectory_Clear(trajectory);
+}
+
+// The time is relative to the start of the trajectory.
+static inline ovrHeadKeyPose ovrHeadTrajectory_GetKeyPose(const ovrHeadTrajectory * trajectory, const double time)
+{
+	ovrHeadKeyPose pose;
+	memset(&pose, 0, sizeof(pose));
+	switch (trajectory->Type)
+	{
+		case HEAD_TRAJECTORY_TRACKED:
+		case HEAD_TRAJECTORY_STILL:
+			break;
+		case HEAD_TRAJECTORY_SINE:
+			pose.Yaw = (float)(40.0 * sin(2.0 * HEAD_TRAJECTORY_PI * 0.3 * time) + 8.0 * sin(2.0 * HEAD_TRAJECTORY_PI * 2.1 * time));
+			pose.Pitch = (float)(10.0 * sin(2.0 * HEAD_TRAJECTORY_PI * 0.17 * time));
+			break;
+		case HEAD_TRAJECTORY_TURN:
+			pose.Yaw = (float)fmod(30.0 * time, 360.0);
+			break;
+		case HEAD_TRAJECTORY_FILE:
+		{
+			const ovrHeadKeyPose * keys = trajectory->KeyPoses;
+			const int last = trajectory->KeyPoseCount - 1;
+			const double t = (keys[last].Time > 0.0f) ? fmod(time, (double)keys[last].Time) : 0.0;
+			if (last == 0 || t <= keys[0].Time)
+			{
+				return keys[0];
+			}
+			int key = 1;
+			while (key < last && keys[key].Time < t)
+			{
+				key++;
+			}
+			const ovrHeadKeyPose * a = &keys[key - 1];
+			const ovrHeadKeyPose * b = &keys[key];
+			const float f = (float)((t - a->Time) / (b->Time - a->Time));
+			pose.Yaw = a->Yaw + (b->Yaw - a->Yaw) * f;
+			pose.Pitch = a->Pitch + (b->Pitch - a->Pitch) * f;
+			pose.Roll = a->Roll + (b->Roll - a->Roll) * f;
+			pose.Position.x = a->Position.x + (b->Position.x - a->Position.x) * f;
+			pose.Position.y = a->Position.y + (b->Position.y - a->Position.y) * f;
+			pose.Position.z = a->Position.z + (b->Position.z - a->Position.z) * f;
+			break;
+		}
+	}
+	pose.Time = (float)time;
+	return pose;
+}
+
+// Yaw around +Y, then pitch around +X, then roll around +Z, in degrees.
+static inline ovrQuatf QuatFromYawPitchRoll(const float yaw, const float pitch, const float roll)
+{
+	const float toHalfRadians = (float)(HEAD_TRAJECTORY_PI / 360.0);
+	const float cy = cosf(yaw * toHalfRadians), sy = sinf(yaw * toHalfRadians);
+	const float cp = cosf(pitch * toHalfRadians), sp = sinf(pitch * toHalfRadians);
+	const float cr = cosf(roll * toHalfRadians), sr = sinf(roll * toHalfRadians);
+	ovrQuatf q;
+	q.x = cy * sp * cr + sy * cp * sr;
+	q.y = sy * cp * cr - cy * sp * sr;
+	q.z = cy * cp * sr - sy * sp * cr;
+	q.w = cy * cp * cr + sy * sp * sr;
+	return q;
+}
+
+// The world space angular velocity that rotates orientation a into b in the given time, as a small angle.
+static inline ovrVector3f AngularVelocityBetween(const ovrQuatf * a, const ovrQuatf * b, const double seconds)
+{
+	const float dx = b->w * -a->x + b->x * a->w + b->y * -a->z - b->z * -a->y;
+	const float dy = b->w * -a->y - b->x * -a->z + b->y * a->w + b->z * -a->x;
+	const float dz = b->w * -a->z + b->x * -a->y - b->y * -a->x + b->z * a->w;
+	const float dw = b->w * a->w - b->x * -a->x - b->y * -a->y - b->z * -a->z;
+	const float scale = ((dw < 0.0f) ? -2.0f : 2.0f) / (float)seconds;
+	ovrVector3f velocity;
+	velocity.x = dx * scale;
+	velocity.y = dy * scale;
+	velocity.z = dz * scale;
+	return velocity;
+}
+
+#endif // HEAD_TRAJECTORY_H
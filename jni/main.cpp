@@ -6,7 +6,9 @@
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
-//#include <pthread.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -17,11 +19,27 @@
 #define EGL_OPENGL_ES3_BIT_KHR		0x0040
 #endif
 
+#if !defined( EGL_MESA_platform_surfaceless )
+#define EGL_PLATFORM_SURFACELESS_MESA	0x31DD
+#endif
+
 #if !defined( GL_EXT_multisampled_render_to_texture )
 typedef void (GL_APIENTRY* PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC) (GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height);
 typedef void (GL_APIENTRY* PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC) (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level, GLsizei samples);
 #endif
 
+#if !defined( GL_KHR_parallel_shader_compile )
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR	0x91B0
+#define GL_COMPLETION_STATUS_KHR			0x91B1
+typedef void (GL_APIENTRY* PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) (GLuint count);
+#endif
+
+// GL_EXT_disjoint_timer_query adds these to the OpenGL-ES 3.0 query objects.
+#if !defined( GL_EXT_disjoint_timer_query )
+#define GL_TIME_ELAPSED_EXT			0x88BF
+#define GL_GPU_DISJOINT_EXT			0x8FBB
+#endif
+
 #include <android/sensor.h>
 #include <android/log.h>
 #include <android/native_window_jni.h>	// for native window JNI
@@ -30,11 +48,15 @@ typedef void (GL_APIENTRY* PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC) (GLenum
 #include "VrApi.h"
 #include "VrApi_Helpers.h"
 #include "VrApi_Android.h"
+#include "VrApi_LocalPrefs.h"
 
 #define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, "native-activity", __VA_ARGS__))
 #define LOGW(...) ((void)__android_log_print(ANDROID_LOG_WARN, "native-activity", __VA_ARGS__))
 #define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, "native-activity", __VA_ARGS__))
 
+#define HEAD_TRAJECTORY_LOG_ERROR(...) LOGE(__VA_ARGS__)
+#include "HeadTrajectory.h"
+
 #define LOG_ACCELEROMETER false
 
 static const int CPU_LEVEL = 2;
@@ -46,7 +68,7 @@ static const int GPU_LEVEL = 3;
 //
 //================================================================================
 
-#if 0
+#if CHECK_GL_ERRORS
 #define GL( func )		func; GLCheckErrors();
 #else
 #define GL( func )		func;
@@ -115,6 +137,214 @@ static void GLCheckErrors()
 	}
 }
 
+static bool GlExtensionAvailable(const char * name)
+{
+	const char * extensions = (const char *)glGetString(GL_EXTENSIONS);
+	const size_t length = strlen(name);
+	for (const char * ext = extensions; ext != NULL && (ext = strstr(ext, name)) != NULL; ext += length)
+	{
+		// Make sure this is not just the prefix of a longer extension name.
+		if ((ext == extensions || ext[-1] == ' ') && (ext[length] == ' ' || ext[length] == '\0'))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//================================================================================
+//
+// ovrProfiler
+//
+//================================================================================
+
+/*
+A scoped zone CPU profiler, compiled in with PROFILER=1. Every thread records the zones
+it closes into its own ring buffer, so recording takes no locks; only the first zone of
+a thread takes one, to register its ring. The timestamps are from the monotonic clock,
+which is the one vrapi_GetTimeInSeconds() is based on. The rings are written out as
+Chrome trace JSON, which chrome://tracing and the Perfetto UI open, when android_main()
+returns. Rings are never freed, and must not be written while they are exported.
+
+	PROFILE_ZONE( "name" );		// from here to the end of the scope
+	PROFILE_BEGIN( "name" );	// or up to the matching PROFILE_END()
+	PROFILE_END();
+
+The name must be a string literal, or at least live until the trace is written.
+*/
+
+#if PROFILER
+
+#define LOCAL_PREF_PROFILER_TRACE		"dev_profilerTrace"		// default PROFILER_TRACE_FILE
+#define PROFILER_TRACE_FILE				"/sdcard/vrsample_trace.json"
+#define PROFILER_THREAD_EVENTS			16384	// per thread, the oldest events are overwritten
+#define PROFILER_MAX_THREADS			16
+#define PROFILER_MAX_DEPTH				32
+
+typedef struct
+{
+	const char *		Name;
+	unsigned long long	Start;		// nanoseconds
+	unsigned long long	End;
+} ovrProfilerEvent;
+
+typedef struct
+{
+	char				Name[32];
+	int					ThreadId;
+	ovrProfilerEvent	Events[PROFILER_THREAD_EVENTS];
+	unsigned int		EventCount;				// events ever recorded, the ring holds the latest
+	const char *		OpenNames[PROFILER_MAX_DEPTH];
+	unsigned long long	OpenStarts[PROFILER_MAX_DEPTH];
+	int					Depth;					// zones still open, may exceed PROFILER_MAX_DEPTH
+} ovrProfilerThread;
+
+typedef struct
+{
+	pthread_mutex_t		Mutex;
+	ovrProfilerThread *	Threads[PROFILER_MAX_THREADS];
+	int					ThreadCount;
+} ovrProfiler;
+
+static ovrProfiler Profiler = { PTHREAD_MUTEX_INITIALIZER, { NULL }, 0 };
+static __thread ovrProfilerThread * ProfilerThread;
+
+static unsigned long long ovrProfiler_GetTime()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Returns the ring of the calling thread, or NULL if there are too many threads.
+static ovrProfilerThread * ovrProfiler_GetThread()
+{
+	if (ProfilerThread == NULL)
+	{
+		pthread_mutex_lock(&Profiler.Mutex);
+		if (Profiler.ThreadCount < PROFILER_MAX_THREADS)
+		{
+			ProfilerThread = (ovrProfilerThread *)calloc(1, sizeof(ovrProfilerThread));
+			ProfilerThread->ThreadId = gettid();
+			snprintf(ProfilerThread->Name, sizeof(ProfilerThread->Name), "thread %d", ProfilerThread->ThreadId);
+			Profiler.Threads[Profiler.ThreadCount++] = ProfilerThread;
+		}
+		pthread_mutex_unlock(&Profiler.Mutex);
+	}
+	return ProfilerThread;
+}
+
+static void ovrProfiler_SetThreadName(const char * name)
+{
+	ovrProfilerThread * thread = ovrProfiler_GetThread();
+	if (thread != NULL)
+	{
+		snprintf(thread->Name, sizeof(thread->Name), "%s", name);
+	}
+}
+
+static void ovrProfiler_BeginZone(const char * name)
+{
+	ovrProfilerThread * thread = ovrProfiler_GetThread();
+	if (thread == NULL)
+	{
+		return;
+	}
+	if (thread->Depth < PROFILER_MAX_DEPTH)
+	{
+		thread->OpenNames[thread->Depth] = name;
+		thread->OpenStarts[thread->Depth] = ovrProfiler_GetTime();
+	}
+	thread->Depth++;
+}
+
+static void ovrProfiler_EndZone()
+{
+	ovrProfilerThread * thread = ProfilerThread;
+	if (thread == NULL || thread->Depth == 0)
+	{
+		return;
+	}
+	thread->Depth--;
+	if (thread->Depth < PROFILER_MAX_DEPTH)
+	{
+		ovrProfilerEvent * event = &thread->Events[thread->EventCount % PROFILER_THREAD_EVENTS];
+		event->Name = thread->OpenNames[thread->Depth];
+		event->Start = thread->OpenStarts[thread->Depth];
+		event->End = ovrProfiler_GetTime();
+		thread->EventCount++;
+	}
+}
+
+typedef struct ovrProfilerScope
+{
+	ovrProfilerScope(const char * name) { ovrProfiler_BeginZone(name); }
+	~ovrProfilerScope() { ovrProfiler_EndZone(); }
+} ovrProfilerScope;
+
+// Writes the events of all threads as complete events, in microseconds since the earliest one.
+static bool ovrProfiler_WriteTrace(const char * fileName)
+{
+	FILE * file = fopen(fileName, "w");
+	if (file == NULL)
+	{
+		LOGE("ovrProfiler_WriteTrace: failed to open %s", fileName);
+		return false;
+	}
+	pthread_mutex_lock(&Profiler.Mutex);
+	unsigned long long startTime = ~0ULL;
+	for (int i = 0; i < Profiler.ThreadCount; i++)
+	{
+		const ovrProfilerThread * thread = Profiler.Threads[i];
+		const unsigned int first = (thread->EventCount > PROFILER_THREAD_EVENTS) ? thread->EventCount - PROFILER_THREAD_EVENTS : 0;
+		for (unsigned int e = first; e < thread->EventCount; e++)
+		{
+			const unsigned long long start = thread->Events[e % PROFILER_THREAD_EVENTS].Start;
+			startTime = (start < startTime) ? start : startTime;
+		}
+	}
+	const int pid = getpid();
+	int eventCount = 0;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (int i = 0; i < Profiler.ThreadCount; i++)
+	{
+		const ovrProfilerThread * thread = Profiler.Threads[i];
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			(i > 0) ? ",\n" : "", pid, thread->ThreadId, thread->Name);
+		const unsigned int first = (thread->EventCount > PROFILER_THREAD_EVENTS) ? thread->EventCount - PROFILER_THREAD_EVENTS : 0;
+		for (unsigned int e = first; e < thread->EventCount; e++)
+		{
+			const ovrProfilerEvent * event = &thread->Events[e % PROFILER_THREAD_EVENTS];
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%1.3f,\"dur\":%1.3f}",
+				event->Name, pid, thread->ThreadId, (event->Start - startTime) * 1e-3, (event->End - event->Start) * 1e-3);
+			eventCount++;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	const int threadCount = Profiler.ThreadCount;
+	pthread_mutex_unlock(&Profiler.Mutex);
+	const bool ok = (ferror(file) == 0);
+	fclose(file);
+	LOGI("ovrProfiler_WriteTrace: %s %d events of %d threads to %s", ok ? "wrote" : "failed to write", eventCount, threadCount, fileName);
+	return ok;
+}
+
+#define PROFILE_CONCAT_( a, b )		a##b
+#define PROFILE_CONCAT( a, b )		PROFILE_CONCAT_( a, b )
+#define PROFILE_ZONE( name )		ovrProfilerScope PROFILE_CONCAT( profilerScope, __LINE__ )( name )
+#define PROFILE_BEGIN( name )		ovrProfiler_BeginZone( name )
+#define PROFILE_END()				ovrProfiler_EndZone()
+#define PROFILE_THREAD_NAME( name )	ovrProfiler_SetThreadName( name )
+
+#else
+
+#define PROFILE_ZONE( name )
+#define PROFILE_BEGIN( name )
+#define PROFILE_END()
+#define PROFILE_THREAD_NAME( name )
+
+#endif // PROFILER
+
 //================================================================================
 //
 // OpenGL-ES Utility Functions
@@ -143,6 +373,29 @@ static void ovrEgl_Clear(ovrEgl * egl)
 	egl->Context = EGL_NO_CONTEXT;
 }
 
+#if HEADLESS
+/*
+The headless host build has no window system and may have no GPU. It renders on a
+surfaceless display, like Mesa llvmpipe provides, with pbuffers instead of windows.
+The renderer only draws to framebuffer objects, so nothing else changes.
+*/
+static EGLDisplay ovrEgl_GetHeadlessDisplay()
+{
+	typedef EGLDisplay (EGLAPIENTRY* PFNEGLGETPLATFORMDISPLAYEXTPROC) (EGLenum platform, void * nativeDisplay, const EGLint * attribs);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (eglGetPlatformDisplayEXT != NULL)
+	{
+		EGLDisplay display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display != EGL_NO_DISPLAY)
+		{
+			return display;
+		}
+	}
+	LOGW("        No surfaceless display, using the default display");
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+#endif
+
 static void ovrEgl_CreateContext(ovrEgl * egl, const ovrEgl * shareEgl)
 {
 	if (egl->Display != 0)
@@ -150,7 +403,11 @@ static void ovrEgl_CreateContext(ovrEgl * egl, const ovrEgl * shareEgl)
 		return;
 	}
 
+#if HEADLESS
+	egl->Display = ovrEgl_GetHeadlessDisplay();
+#else
 	egl->Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+#endif
 	LOGI("        eglInitialize( Display, &MajorVersion, &MinorVersion )");
 	eglInitialize(egl->Display, &egl->MajorVersion, &egl->MinorVersion);
 	// Do NOT use eglChooseConfig, because the Android EGL code pushes in multisample
@@ -187,8 +444,13 @@ static void ovrEgl_CreateContext(ovrEgl * egl, const ovrEgl * shareEgl)
 
 		// The pbuffer config also needs to be compatible with normal window rendering
 		// so it can share textures with the window context.
+#if HEADLESS
+		const EGLint surfaceTypeBits = EGL_PBUFFER_BIT;
+#else
+		const EGLint surfaceTypeBits = EGL_WINDOW_BIT | EGL_PBUFFER_BIT;
+#endif
 		eglGetConfigAttrib(egl->Display, configs[i], EGL_SURFACE_TYPE, &value);
-		if ((value & (EGL_WINDOW_BIT | EGL_PBUFFER_BIT)) != (EGL_WINDOW_BIT | EGL_PBUFFER_BIT))
+		if ((value & surfaceTypeBits) != surfaceTypeBits)
 		{
 			continue;
 		}
@@ -255,7 +517,7 @@ static void ovrEgl_DestroyContext(ovrEgl * egl)
 {
 	if (egl->Display != 0)
 	{
-		LOGE("        eglMakeCurrent( Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT )");
+		LOGI("        eglMakeCurrent( Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT )");
 		if (eglMakeCurrent(egl->Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) == EGL_FALSE)
 		{
 			LOGE("        eglMakeCurrent() failed: %s", EglErrorString(eglGetError()));
@@ -263,7 +525,7 @@ static void ovrEgl_DestroyContext(ovrEgl * egl)
 	}
 	if (egl->Context != EGL_NO_CONTEXT)
 	{
-		LOGE("        eglDestroyContext( Display, Context )");
+		LOGI("        eglDestroyContext( Display, Context )");
 		if (eglDestroyContext(egl->Display, egl->Context) == EGL_FALSE)
 		{
 			LOGE("        eglDestroyContext() failed: %s", EglErrorString(eglGetError()));
@@ -272,7 +534,7 @@ static void ovrEgl_DestroyContext(ovrEgl * egl)
 	}
 	if (egl->TinySurface != EGL_NO_SURFACE)
 	{
-		LOGE("        eglDestroySurface( Display, TinySurface )");
+		LOGI("        eglDestroySurface( Display, TinySurface )");
 		if (eglDestroySurface(egl->Display, egl->TinySurface) == EGL_FALSE)
 		{
 			LOGE("        eglDestroySurface() failed: %s", EglErrorString(eglGetError()));
@@ -281,7 +543,7 @@ static void ovrEgl_DestroyContext(ovrEgl * egl)
 	}
 	if (egl->Display != 0)
 	{
-		LOGE("        eglTerminate( Display )");
+		LOGI("        eglTerminate( Display )");
 		if (eglTerminate(egl->Display) == EGL_FALSE)
 		{
 			LOGE("        eglTerminate() failed: %s", EglErrorString(eglGetError()));
@@ -296,6 +558,18 @@ static void ovrEgl_CreateSurface(ovrEgl * egl, ANativeWindow * nativeWindow)
 	{
 		return;
 	}
+#if HEADLESS
+	// The window is only a handle, the time warp stand-in does not draw to it.
+	(void)nativeWindow;
+	LOGI("        MainSurface = eglCreatePbufferSurface( Display, Config, attribs )");
+	const EGLint surfaceAttribs[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+	egl->MainSurface = eglCreatePbufferSurface(egl->Display, egl->Config, surfaceAttribs);
+	if (egl->MainSurface == EGL_NO_SURFACE)
+	{
+		LOGE("        eglCreatePbufferSurface() failed: %s", EglErrorString(eglGetError()));
+		return;
+	}
+#else
 	LOGI("        MainSurface = eglCreateWindowSurface( Display, Config, nativeWindow, attribs )");
 	const EGLint surfaceAttribs[] = { EGL_NONE };
 	egl->MainSurface = eglCreateWindowSurface(egl->Display, egl->Config, nativeWindow, surfaceAttribs);
@@ -304,6 +578,7 @@ static void ovrEgl_CreateSurface(ovrEgl * egl, ANativeWindow * nativeWindow)
 		LOGE("        eglCreateWindowSurface() failed: %s", EglErrorString(eglGetError()));
 		return;
 	}
+#endif
 	LOGI("        eglMakeCurrent( display, MainSurface, MainSurface, Context )");
 	if (eglMakeCurrent(egl->Display, egl->MainSurface, egl->MainSurface, egl->Context) == EGL_FALSE)
 	{
@@ -478,7 +753,7 @@ static void ovrGeometry_CreateVAO(ovrGeometry * geometry)
 
 	for (int i = 0; i < MAX_VERTEX_ATTRIB_POINTERS; i++)
 	{
-		if (geometry->VertexAttribs[i].Index != -1)
+		if (geometry->VertexAttribs[i].Index != (GLuint)-1)
 		{
 			GL(glEnableVertexAttribArray(geometry->VertexAttribs[i].Index));
 			GL(glVertexAttribPointer(geometry->VertexAttribs[i].Index, geometry->VertexAttribs[i].Size,
@@ -497,6 +772,215 @@ static void ovrGeometry_DestroyVAO(ovrGeometry * geometry)
 	GL(glDeleteVertexArrays(1, &geometry->VertexArrayObject));
 }
 
+//================================================================================
+//
+// ovrProgramCache
+//
+//================================================================================
+
+/*
+Linked program binaries are stored in the application's internal data directory,
+one file per program. The file name is a hash of the driver vendor, renderer and
+version strings and of the complete shader sources, including any defines at the
+start of the sources, so a driver update or a shader change never picks up a stale
+binary. The driver may still reject a binary, in which case the program is compiled
+from source and the file is replaced.
+*/
+
+#define PROGRAM_CACHE_MAGIC		0x4250564F	// "OVPB"
+#define PROGRAM_CACHE_VERSION	1
+
+typedef struct
+{
+	char				Directory[256];		// empty when the cache is disabled
+	unsigned long long	DriverHash;
+	// Programs may be created on a loader thread, so the statistics are protected by a mutex.
+	pthread_mutex_t		Mutex;
+	int					Loaded;				// programs loaded from the cache
+	int					Compiled;			// programs compiled from source
+	double				Seconds;			// time spent creating programs
+} ovrProgramCache;
+
+typedef struct
+{
+	unsigned int		Magic;
+	unsigned int		Version;
+	unsigned long long	Key;
+	unsigned int		BinaryFormat;
+	unsigned int		BinaryLength;
+} ovrProgramCacheHeader;
+
+static unsigned long long Fnv1a64(unsigned long long hash, const void * data, const size_t length)
+{
+	const unsigned char * bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+static unsigned long long Fnv1a64String(const unsigned long long hash, const char * string)
+{
+	// Include the terminator so "ab" + "c" and "a" + "bc" hash differently.
+	return (string != NULL) ? Fnv1a64(hash, string, strlen(string) + 1) : Fnv1a64(hash, "", 1);
+}
+
+static void ovrProgramCache_Clear(ovrProgramCache * cache)
+{
+	cache->Directory[0] = '\0';
+	cache->DriverHash = 0;
+	cache->Loaded = 0;
+	cache->Compiled = 0;
+	cache->Seconds = 0.0;
+}
+
+// Requires a current context. A NULL directory disables the cache.
+static void ovrProgramCache_Create(ovrProgramCache * cache, const char * directory)
+{
+	ovrProgramCache_Clear(cache);
+	pthread_mutex_init(&cache->Mutex, NULL);
+
+	GLint binaryFormats = 0;
+	GL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats));
+	if (directory == NULL || binaryFormats == 0)
+	{
+		LOGW("Program cache disabled: %s", (directory == NULL) ? "no data directory" : "no program binary formats");
+		return;
+	}
+
+	snprintf(cache->Directory, sizeof(cache->Directory), "%s", directory);
+	cache->DriverHash = 0xCBF29CE484222325ULL;
+	cache->DriverHash = Fnv1a64String(cache->DriverHash, (const char *)glGetString(GL_VENDOR));
+	cache->DriverHash = Fnv1a64String(cache->DriverHash, (const char *)glGetString(GL_RENDERER));
+	cache->DriverHash = Fnv1a64String(cache->DriverHash, (const char *)glGetString(GL_VERSION));
+	LOGI("Program cache: %s", cache->Directory);
+}
+
+static void ovrProgramCache_Destroy(ovrProgramCache * cache)
+{
+	pthread_mutex_destroy(&cache->Mutex);
+	ovrProgramCache_Clear(cache);
+}
+
+static void ovrProgramCache_AddStats(ovrProgramCache * cache, const bool loaded, const double seconds)
+{
+	pthread_mutex_lock(&cache->Mutex);
+	cache->Seconds += seconds;
+	cache->Loaded += loaded ? 1 : 0;
+	cache->Compiled += loaded ? 0 : 1;
+	pthread_mutex_unlock(&cache->Mutex);
+}
+
+static unsigned long long ovrProgramCache_GetKey(const ovrProgramCache * cache, const char * vertexSource, const char * fragmentSource)
+{
+	unsigned long long key = cache->DriverHash;
+	key = Fnv1a64String(key, vertexSource);
+	key = Fnv1a64String(key, fragmentSource);
+	return key;
+}
+
+static void ovrProgramCache_GetFileName(const ovrProgramCache * cache, const unsigned long long key, char * fileName, const size_t fileNameSize)
+{
+	snprintf(fileName, fileNameSize, "%s/program_%016llx.bin", cache->Directory, key);
+}
+
+// Returns true if the program was successfully linked from a cached binary.
+static bool ovrProgramCache_Load(const ovrProgramCache * cache, const unsigned long long key, const GLuint program)
+{
+	if (cache->Directory[0] == '\0')
+	{
+		return false;
+	}
+
+	char fileName[512];
+	ovrProgramCache_GetFileName(cache, key, fileName, sizeof(fileName));
+	FILE * file = fopen(fileName, "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	ovrProgramCacheHeader header;
+	void * binary = NULL;
+	bool read = (fread(&header, sizeof(header), 1, file) == 1 &&
+				header.Magic == PROGRAM_CACHE_MAGIC &&
+				header.Version == PROGRAM_CACHE_VERSION &&
+				header.Key == key);
+	if (read)
+	{
+		binary = malloc(header.BinaryLength);
+		read = (fread(binary, 1, header.BinaryLength, file) == header.BinaryLength);
+	}
+	fclose(file);
+
+	GLint linked = GL_FALSE;
+	if (read)
+	{
+		GL(glProgramBinary(program, header.BinaryFormat, binary, header.BinaryLength));
+		GL(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+	}
+	free(binary);
+
+	if (linked == GL_FALSE)
+	{
+		LOGW("Program cache: rejected %s", fileName);
+		return false;
+	}
+	return true;
+}
+
+static void ovrProgramCache_Store(const ovrProgramCache * cache, const unsigned long long key, const GLuint program)
+{
+	if (cache->Directory[0] == '\0')
+	{
+		return;
+	}
+
+	GLint length = 0;
+	GL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+	if (length <= 0)
+	{
+		return;
+	}
+
+	ovrProgramCacheHeader header;
+	header.Magic = PROGRAM_CACHE_MAGIC;
+	header.Version = PROGRAM_CACHE_VERSION;
+	header.Key = key;
+	void * binary = malloc(length);
+	GLenum binaryFormat = 0;
+	GL(glGetProgramBinary(program, length, NULL, &binaryFormat, binary));
+	header.BinaryFormat = binaryFormat;
+	header.BinaryLength = length;
+
+	char fileName[512];
+	ovrProgramCache_GetFileName(cache, key, fileName, sizeof(fileName));
+	FILE * file = fopen(fileName, "wb");
+	if (file != NULL)
+	{
+		const bool written = (fwrite(&header, sizeof(header), 1, file) == 1 &&
+								fwrite(binary, 1, length, file) == (size_t)length);
+		if (fclose(file) != 0 || !written)
+		{
+			LOGW("Program cache: failed to write %s", fileName);
+			remove(fileName);
+		}
+	}
+	free(binary);
+}
+
+// Logs how long creating all programs so far took, and how many came from the cache.
+static void ovrProgramCache_LogStats(ovrProgramCache * cache)
+{
+	pthread_mutex_lock(&cache->Mutex);
+	LOGI("Program cache: %d programs loaded, %d compiled in %1.2f ms (%s start)",
+		cache->Loaded, cache->Compiled, cache->Seconds * 1000.0,
+		(cache->Compiled == 0) ? "warm" : ((cache->Loaded == 0) ? "cold" : "partially warm"));
+	pthread_mutex_unlock(&cache->Mutex);
+}
+
 //================================================================================
 //
 // ovrProgram
@@ -514,13 +998,24 @@ typedef struct
 	// These will be -1 if not used by the program.
 	GLint	Uniforms[MAX_PROGRAM_UNIFORMS];		// ProgramUniforms[].name
 	GLint	Textures[MAX_PROGRAM_TEXTURES];		// Texture%i
+	// Set from ovrProgram_Begin until ovrProgram_End.
+	bool				Pending;
+	bool				ParallelCompile;	// the driver compiles in the background
+	bool				Loaded;				// linked from a cached binary
+	unsigned long long	CacheKey;
+	double				StartTime;
+	const char *		VertexSource;
+	const char *		FragmentSource;
 } ovrProgram;
 
 enum
 {
 	UNIFORM_MODEL_MATRIX,
 	UNIFORM_VIEW_MATRIX,
-	UNIFORM_PROJECTION_MATRIX
+	UNIFORM_PROJECTION_MATRIX,
+	UNIFORM_VIEW_PROJECTION_MATRIX,
+	UNIFORM_ANIMATION_ROTATION,
+	UNIFORM_TEXCOORD_SCALE
 };
 
 enum
@@ -540,7 +1035,32 @@ static ovrUniform ProgramUniforms[] =
 {
 	{ UNIFORM_MODEL_MATRIX, UNIFORM_TYPE_MATRIX4X4, "ModelMatrix" },
 	{ UNIFORM_VIEW_MATRIX, UNIFORM_TYPE_MATRIX4X4, "ViewMatrix" },
-	{ UNIFORM_PROJECTION_MATRIX, UNIFORM_TYPE_MATRIX4X4, "ProjectionMatrix" }
+	{ UNIFORM_PROJECTION_MATRIX, UNIFORM_TYPE_MATRIX4X4, "ProjectionMatrix" },
+	{ UNIFORM_VIEW_PROJECTION_MATRIX, UNIFORM_TYPE_MATRIX4X4, "ViewProjectionMatrix" },
+	{ UNIFORM_ANIMATION_ROTATION, UNIFORM_TYPE_VECTOR4, "AnimationRotation" },
+	{ UNIFORM_TEXCOORD_SCALE, UNIFORM_TYPE_VECTOR4, "TexCoordScale" }
+};
+
+// Uniform blocks are bound to the same binding point in every program that uses them,
+// so a buffer bound to that point serves all programs. OpenGL-ES 3.0 shaders cannot
+// declare the binding themselves.
+enum
+{
+	UNIFORM_BLOCK_SCENE_VIEW,
+	UNIFORM_BLOCK_SCENE_STATIC,
+	UNIFORM_BLOCK_MAX
+};
+
+typedef struct
+{
+	int				binding;
+	const char *	name;
+} ovrUniformBlock;
+
+static ovrUniformBlock ProgramUniformBlocks[] =
+{
+	{ UNIFORM_BLOCK_SCENE_VIEW, "SceneView" },
+	{ UNIFORM_BLOCK_SCENE_STATIC, "SceneStatic" }
 };
 
 static void ovrProgram_Clear(ovrProgram * program)
@@ -550,83 +1070,216 @@ static void ovrProgram_Clear(ovrProgram * program)
 	program->FragmentShader = 0;
 	memset(program->Uniforms, 0, sizeof(program->Uniforms));
 	memset(program->Textures, 0, sizeof(program->Textures));
+	program->Pending = false;
+	program->ParallelCompile = false;
+	program->Loaded = false;
+	program->CacheKey = 0;
+	program->StartTime = 0.0;
+	program->VertexSource = NULL;
+	program->FragmentSource = NULL;
+}
+
+/*
+Querying the compile or link status right after compiling or linking forces the driver
+to finish that work before anything else is submitted. Instead, ovrProgram_Begin submits
+the work, ovrProgram_IsComplete polls it without blocking if the driver supports
+GL_KHR_parallel_shader_compile, and ovrProgram_End checks the results. Beginning a batch
+of programs before ending any of them lets the driver compile them in parallel.
+*/
+
+// Lets the driver use as many threads as it likes for compiling programs on the current context.
+static void ovrProgram_EnableParallelCompile()
+{
+	if (!GlExtensionAvailable("GL_KHR_parallel_shader_compile"))
+	{
+		LOGI("GL_KHR_parallel_shader_compile is not available");
+		return;
+	}
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR =
+		(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)eglGetProcAddress("glMaxShaderCompilerThreadsKHR");
+	if (glMaxShaderCompilerThreadsKHR != NULL)
+	{
+		GL(glMaxShaderCompilerThreadsKHR(0xFFFFFFFF));
+	}
 }
 
-static bool ovrProgram_Create(ovrProgram * program, const char * vertexSource, const char * fragmentSource)
+// Starts loading the program from the cache, or compiling and linking it from source,
+// without waiting for the driver. The sources must stay valid until ovrProgram_End.
+// The cache may be NULL.
+static void ovrProgram_Begin(ovrProgram * program, ovrProgramCache * cache, const char * vertexSource, const char * fragmentSource)
 {
-	GLint r;
+	PROFILE_ZONE("ovrProgram_Begin");
+
+	program->Pending = true;
+	program->ParallelCompile = GlExtensionAvailable("GL_KHR_parallel_shader_compile");
+	program->Loaded = false;
+	program->CacheKey = (cache != NULL) ? ovrProgramCache_GetKey(cache, vertexSource, fragmentSource) : 0;
+	program->StartTime = vrapi_GetTimeInSeconds();
+	program->VertexSource = vertexSource;
+	program->FragmentSource = fragmentSource;
+
+	if (cache != NULL)
+	{
+		GL(program->Program = glCreateProgram());
+		program->Loaded = ovrProgramCache_Load(cache, program->CacheKey, program->Program);
+		if (program->Loaded)
+		{
+			return;
+		}
+		GL(glDeleteProgram(program->Program));
+		program->Program = 0;
+	}
 
 	GL(program->VertexShader = glCreateShader(GL_VERTEX_SHADER));
 	GL(glShaderSource(program->VertexShader, 1, &vertexSource, 0));
 	GL(glCompileShader(program->VertexShader));
-	GL(glGetShaderiv(program->VertexShader, GL_COMPILE_STATUS, &r));
-	if (r == GL_FALSE)
-	{
-		GLchar msg[4096];
-		GL(glGetShaderInfoLog(program->VertexShader, sizeof(msg), 0, msg));
-		LOGE("%s\n%s\n", vertexSource, msg);
-		return false;
-	}
 
 	GL(program->FragmentShader = glCreateShader(GL_FRAGMENT_SHADER));
 	GL(glShaderSource(program->FragmentShader, 1, &fragmentSource, 0));
 	GL(glCompileShader(program->FragmentShader));
-	GL(glGetShaderiv(program->FragmentShader, GL_COMPILE_STATUS, &r));
-	if (r == GL_FALSE)
-	{
-		GLchar msg[4096];
-		GL(glGetShaderInfoLog(program->FragmentShader, sizeof(msg), 0, msg));
-		LOGE("%s\n%s\n", fragmentSource, msg);
-		return false;
-	}
 
 	GL(program->Program = glCreateProgram());
 	GL(glAttachShader(program->Program, program->VertexShader));
 	GL(glAttachShader(program->Program, program->FragmentShader));
 
 	// Bind the vertex attribute locations.
-	for (int i = 0; i < sizeof(ProgramVertexAttributes) / sizeof(ProgramVertexAttributes[0]); i++)
+	for (size_t i = 0; i < sizeof(ProgramVertexAttributes) / sizeof(ProgramVertexAttributes[0]); i++)
 	{
 		GL(glBindAttribLocation(program->Program, ProgramVertexAttributes[i].location, ProgramVertexAttributes[i].name));
 	}
 
-	GL(glLinkProgram(program->Program));
-	GL(glGetProgramiv(program->Program, GL_LINK_STATUS, &r));
-	if (r == GL_FALSE)
+	if (cache != NULL)
 	{
-		GLchar msg[4096];
-		GL(glGetProgramInfoLog(program->Program, sizeof(msg), 0, msg));
-		LOGE("Linking program failed: %s\n", msg);
-		return false;
+		GL(glProgramParameteri(program->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
 	}
 
-	// Get the uniform locations.
-	memset(program->Uniforms, -1, sizeof(program->Uniforms));
-	for (int i = 0; i < sizeof(ProgramUniforms) / sizeof(ProgramUniforms[0]); i++)
+	GL(glLinkProgram(program->Program));
+}
+
+// Returns true if ovrProgram_End will not block. Without GL_KHR_parallel_shader_compile
+// there is no way to tell, so the program is reported complete right away.
+static bool ovrProgram_IsComplete(const ovrProgram * program)
+{
+	if (!program->Pending || !program->ParallelCompile)
 	{
-		program->Uniforms[ProgramUniforms[i].index] = glGetUniformLocation(program->Program, ProgramUniforms[i].name);
+		return true;
 	}
+	GLint complete = GL_FALSE;
+	GL(glGetProgramiv(program->Program, GL_COMPLETION_STATUS_KHR, &complete));
+	return complete != GL_FALSE;
+}
 
-	GL(glUseProgram(program->Program));
+static void ovrProgram_Destroy(ovrProgram * program);
 
-	// Get the texture locations.
-	for (int i = 0; i < MAX_PROGRAM_TEXTURES; i++)
+// Waits for the program started with ovrProgram_Begin, checks for errors, adds it to the
+// cache and looks up the uniforms. A program that fails is destroyed.
+static bool ovrProgram_End(ovrProgram * program, ovrProgramCache * cache)
+{
+	PROFILE_ZONE("ovrProgram_End");
+
+	if (!program->Pending)
 	{
-		char name[32];
-		sprintf(name, "Texture%i", i);
-		program->Textures[i] = glGetUniformLocation(program->Program, name);
-		if (program->Textures[i] != -1)
-		{
-			GL(glUniform1i(program->Textures[i], i));
-		}
+		return program->Program != 0;
 	}
+	program->Pending = false;
 
-	GL(glUseProgram(0));
-
-	return true;
-}
-
-static void ovrProgram_Destroy(ovrProgram * program)
+	if (!program->Loaded)
+	{
+		GLint r;
+		GL(glGetProgramiv(program->Program, GL_LINK_STATUS, &r));
+		if (r == GL_FALSE)
+		{
+			const GLuint shaders[2] = { program->VertexShader, program->FragmentShader };
+			const char * sources[2] = { program->VertexSource, program->FragmentSource };
+			bool compiled = true;
+			for (int i = 0; i < 2; i++)
+			{
+				GL(glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &r));
+				if (r == GL_FALSE)
+				{
+					GLchar msg[4096];
+					GL(glGetShaderInfoLog(shaders[i], sizeof(msg), 0, msg));
+					LOGE("%s\n%s\n", sources[i], msg);
+					compiled = false;
+				}
+			}
+			if (compiled)
+			{
+				GLchar msg[4096];
+				GL(glGetProgramInfoLog(program->Program, sizeof(msg), 0, msg));
+				LOGE("Linking program failed: %s\n", msg);
+			}
+			ovrProgram_Destroy(program);
+			return false;
+		}
+
+		if (cache != NULL)
+		{
+			ovrProgramCache_Store(cache, program->CacheKey, program->Program);
+		}
+	}
+
+	// Get the uniform locations.
+	memset(program->Uniforms, -1, sizeof(program->Uniforms));
+	for (size_t i = 0; i < sizeof(ProgramUniforms) / sizeof(ProgramUniforms[0]); i++)
+	{
+		program->Uniforms[ProgramUniforms[i].index] = glGetUniformLocation(program->Program, ProgramUniforms[i].name);
+	}
+
+	// Assign the uniform block binding points.
+	for (size_t i = 0; i < sizeof(ProgramUniformBlocks) / sizeof(ProgramUniformBlocks[0]); i++)
+	{
+		const GLuint blockIndex = glGetUniformBlockIndex(program->Program, ProgramUniformBlocks[i].name);
+		if (blockIndex != GL_INVALID_INDEX)
+		{
+			GL(glUniformBlockBinding(program->Program, blockIndex, ProgramUniformBlocks[i].binding));
+		}
+	}
+
+	GL(glUseProgram(program->Program));
+
+	// Get the texture locations.
+	for (int i = 0; i < MAX_PROGRAM_TEXTURES; i++)
+	{
+		char name[32];
+		sprintf(name, "Texture%i", i);
+		program->Textures[i] = glGetUniformLocation(program->Program, name);
+		if (program->Textures[i] != -1)
+		{
+			GL(glUniform1i(program->Textures[i], i));
+		}
+	}
+
+	GL(glUseProgram(0));
+
+	if (cache != NULL)
+	{
+		const double seconds = vrapi_GetTimeInSeconds() - program->StartTime;
+		ovrProgramCache_AddStats(cache, program->Loaded, seconds);
+		LOGI("Program %016llx %s in %1.2f ms", program->CacheKey, program->Loaded ? "loaded from cache" : "compiled", seconds * 1000.0);
+	}
+
+	return true;
+}
+
+// Finishes the program if it completed. Returns true if the program is ready to be used.
+static bool ovrProgram_Poll(ovrProgram * program, ovrProgramCache * cache)
+{
+	if (program->Pending && ovrProgram_IsComplete(program))
+	{
+		ovrProgram_End(program, cache);
+	}
+	return !program->Pending && program->Program != 0;
+}
+
+static bool ovrProgram_Create(ovrProgram * program, ovrProgramCache * cache, const char * vertexSource, const char * fragmentSource)
+{
+	PROFILE_ZONE("ovrProgram_Create");
+	ovrProgram_Begin(program, cache, vertexSource, fragmentSource);
+	return ovrProgram_End(program, cache);
+}
+
+static void ovrProgram_Destroy(ovrProgram * program)
 {
 	if (program->Program != 0)
 	{
@@ -643,517 +1296,4715 @@ static void ovrProgram_Destroy(ovrProgram * program)
 		GL(glDeleteShader(program->FragmentShader));
 		program->FragmentShader = 0;
 	}
+	program->Pending = false;
+}
+
+static bool ovrProgram_IsReady(const ovrProgram * program)
+{
+	return !program->Pending && program->Program != 0;
 }
 
 //================================================================================
 //
-// ovrFramebuffer
+// ovrProgramLoader
 //
 //================================================================================
 
+/*
+Without GL_KHR_parallel_shader_compile the driver compiles on the thread that queries
+the results. The program loader creates the programs on its own thread with a context
+that shares objects with the main context, so the main thread can keep submitting
+loading frames in the meantime. The programs may only be used after ovrProgramLoader_Join.
+*/
+
+#define MAX_LOADER_PROGRAMS		8
+
 typedef struct
 {
-	int						Width;
-	int						Height;
-	int						Multisamples;
-	int						TextureSwapChainLength;
-	int						TextureSwapChainIndex;
-	ovrTextureSwapChain *	ColorTextureSwapChain;
-	GLuint *				DepthBuffers;
-	GLuint *				FrameBuffers;
-} ovrFramebuffer;
+	ovrProgram *		Programs[MAX_LOADER_PROGRAMS];
+	const char *		VertexSources[MAX_LOADER_PROGRAMS];
+	const char *		FragmentSources[MAX_LOADER_PROGRAMS];
+	int					ProgramCount;
+	const ovrEgl *		ShareEgl;
+	ovrProgramCache *	Cache;
+	pthread_t			Thread;
+	pthread_mutex_t		Mutex;
+	bool				Started;
+	bool				Done;
+} ovrProgramLoader;
+
+static void ovrProgramLoader_Clear(ovrProgramLoader * loader)
+{
+	loader->ProgramCount = 0;
+	loader->ShareEgl = NULL;
+	loader->Cache = NULL;
+	loader->Thread = 0;
+	loader->Started = false;
+	loader->Done = false;
+}
 
-static void ovrFramebuffer_Clear(ovrFramebuffer * frameBuffer)
+static void ovrProgramLoader_Add(ovrProgramLoader * loader, ovrProgram * program, const char * vertexSource, const char * fragmentSource)
 {
-	frameBuffer->Width = 0;
-	frameBuffer->Height = 0;
-	frameBuffer->Multisamples = 0;
-	frameBuffer->TextureSwapChainLength = 0;
-	frameBuffer->TextureSwapChainIndex = 0;
-	frameBuffer->ColorTextureSwapChain = NULL;
-	frameBuffer->DepthBuffers = NULL;
-	frameBuffer->FrameBuffers = NULL;
+	if (loader->Started || loader->ProgramCount >= MAX_LOADER_PROGRAMS)
+	{
+		LOGE("ovrProgramLoader_Add: cannot add more programs");
+		return;
+	}
+	loader->Programs[loader->ProgramCount] = program;
+	loader->VertexSources[loader->ProgramCount] = vertexSource;
+	loader->FragmentSources[loader->ProgramCount] = fragmentSource;
+	loader->ProgramCount++;
 }
 
-static bool ovrFramebuffer_Create(ovrFramebuffer * frameBuffer, const ovrTextureFormat colorFormat, const int width, const int height, const int multisamples)
+static void * ovrProgramLoader_ThreadFunction(void * parm)
 {
-	frameBuffer->Width = width;
-	frameBuffer->Height = height;
-	frameBuffer->Multisamples = multisamples;
+	ovrProgramLoader * loader = (ovrProgramLoader *)parm;
 
-	frameBuffer->ColorTextureSwapChain = vrapi_CreateTextureSwapChain(VRAPI_TEXTURE_TYPE_2D, colorFormat, width, height, 1, true);
-	frameBuffer->TextureSwapChainLength = vrapi_GetTextureSwapChainLength(frameBuffer->ColorTextureSwapChain);
-	frameBuffer->DepthBuffers = (GLuint *)malloc(frameBuffer->TextureSwapChainLength * sizeof(GLuint));
-	frameBuffer->FrameBuffers = (GLuint *)malloc(frameBuffer->TextureSwapChainLength * sizeof(GLuint));
+	PROFILE_THREAD_NAME("ProgramLoader");
 
-	PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT =
-		(PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC)eglGetProcAddress("glRenderbufferStorageMultisampleEXT");
-	PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC glFramebufferTexture2DMultisampleEXT =
-		(PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC)eglGetProcAddress("glFramebufferTexture2DMultisampleEXT");
+	ovrEgl egl;
+	ovrEgl_Clear(&egl);
+	ovrEgl_CreateContext(&egl, loader->ShareEgl);
 
-	for (int i = 0; i < frameBuffer->TextureSwapChainLength; i++)
+	if (egl.Context != EGL_NO_CONTEXT)
 	{
-		// Create the color buffer texture.
-		const GLuint colorTexture = vrapi_GetTextureSwapChainHandle(frameBuffer->ColorTextureSwapChain, i);
-		GL(glBindTexture(GL_TEXTURE_2D, colorTexture));
-		GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-		GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-		GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-		GL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-		GL(glBindTexture(GL_TEXTURE_2D, 0));
-
-		if (multisamples > 1 && glRenderbufferStorageMultisampleEXT != NULL && glFramebufferTexture2DMultisampleEXT != NULL)
-		{
-			// Create multisampled depth buffer.
-			GL(glGenRenderbuffers(1, &frameBuffer->DepthBuffers[i]));
-			GL(glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer->DepthBuffers[i]));
-			GL(glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, multisamples, GL_DEPTH_COMPONENT24, width, height));
-			GL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
-
-			// Create the frame buffer.
-			GL(glGenFramebuffers(1, &frameBuffer->FrameBuffers[i]));
-			GL(glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer->FrameBuffers[i]));
-			GL(glFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0, multisamples));
-			GL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, frameBuffer->DepthBuffers[i]));
-			GL(GLenum renderFramebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER));
-			GL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-			if (renderFramebufferStatus != GL_FRAMEBUFFER_COMPLETE)
-			{
-				LOGE("Incomplete frame buffer object: %s", GlFrameBufferStatusString(renderFramebufferStatus));
-				return false;
-			}
-		}
-		else
+		for (int i = 0; i < loader->ProgramCount; i++)
 		{
-			// Create depth buffer.
-			GL(glGenRenderbuffers(1, &frameBuffer->DepthBuffers[i]));
-			GL(glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer->DepthBuffers[i]));
-			GL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height));
-			GL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
-
-			// Create the frame buffer.
-			GL(glGenFramebuffers(1, &frameBuffer->FrameBuffers[i]));
-			GL(glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer->FrameBuffers[i]));
-			GL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, frameBuffer->DepthBuffers[i]));
-			GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0));
-			GL(GLenum renderFramebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER));
-			GL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-			if (renderFramebufferStatus != GL_FRAMEBUFFER_COMPLETE)
-			{
-				LOGE("Incomplete frame buffer object: %s", GlFrameBufferStatusString(renderFramebufferStatus));
-				return false;
-			}
+			ovrProgram_Create(loader->Programs[i], loader->Cache, loader->VertexSources[i], loader->FragmentSources[i]);
 		}
+
+		// Make the programs visible to the main context before reporting they are done.
+		GL(glFinish());
+
+		// The display is shared with the main context, so it must not be terminated here.
+		eglMakeCurrent(egl.Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroySurface(egl.Display, egl.TinySurface);
+		eglDestroyContext(egl.Display, egl.Context);
+	}
+	else
+	{
+		LOGE("ovrProgramLoader: failed to create a shared context");
 	}
 
-	return true;
+	pthread_mutex_lock(&loader->Mutex);
+	loader->Done = true;
+	pthread_mutex_unlock(&loader->Mutex);
+
+	return NULL;
 }
 
-static void ovrFramebuffer_Destroy(ovrFramebuffer * frameBuffer)
+// Starts creating the added programs on a new thread with a context shared with shareEgl.
+static void ovrProgramLoader_Start(ovrProgramLoader * loader, const ovrEgl * shareEgl, ovrProgramCache * cache)
 {
-	GL(glDeleteFramebuffers(frameBuffer->TextureSwapChainLength, frameBuffer->FrameBuffers));
-	GL(glDeleteRenderbuffers(frameBuffer->TextureSwapChainLength, frameBuffer->DepthBuffers));
-	vrapi_DestroyTextureSwapChain(frameBuffer->ColorTextureSwapChain);
-
-	free(frameBuffer->DepthBuffers);
-	free(frameBuffer->FrameBuffers);
+	loader->ShareEgl = shareEgl;
+	loader->Cache = cache;
+	loader->Done = false;
+	pthread_mutex_init(&loader->Mutex, NULL);
 
-	ovrFramebuffer_Clear(frameBuffer);
+	const int createErr = pthread_create(&loader->Thread, NULL, ovrProgramLoader_ThreadFunction, loader);
+	if (createErr != 0)
+	{
+		LOGE("pthread_create returned %i", createErr);
+		pthread_mutex_destroy(&loader->Mutex);
+		return;
+	}
+	loader->Started = true;
 }
 
-static void ovrFramebuffer_SetCurrent(ovrFramebuffer * frameBuffer)
+static bool ovrProgramLoader_IsDone(ovrProgramLoader * loader)
 {
-	GL(glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer->FrameBuffers[frameBuffer->TextureSwapChainIndex]));
+	if (!loader->Started)
+	{
+		return true;
+	}
+	pthread_mutex_lock(&loader->Mutex);
+	const bool done = loader->Done;
+	pthread_mutex_unlock(&loader->Mutex);
+	return done;
 }
 
-static void ovrFramebuffer_SetNone()
+// Waits for the loader thread. Programs that failed have a zero Program.
+static void ovrProgramLoader_Join(ovrProgramLoader * loader)
 {
-	GL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	if (!loader->Started)
+	{
+		return;
+	}
+	pthread_join(loader->Thread, NULL);
+	pthread_mutex_destroy(&loader->Mutex);
+	ovrProgramLoader_Clear(loader);
 }
 
-static void ovrFramebuffer_Resolve(ovrFramebuffer * frameBuffer)
+//================================================================================
+//
+// ovrUniformRing
+//
+//================================================================================
+
+/*
+A uniform buffer with a block per view for each of the last few frames. A frame's blocks
+are written through an unsynchronized map while the GPU may still read the blocks of
+earlier frames, and a fence keeps a frame from overwriting blocks that are still in use.
+*/
+
+#define UNIFORM_RING_FRAMES		4
+
+typedef struct
+{
+	GLuint		Buffer;
+	int			BlockSize;			// rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	int			BlocksPerFrame;
+	int			Frame;
+	GLsync		Fences[UNIFORM_RING_FRAMES];
+} ovrUniformRing;
+
+static void ovrUniformRing_Clear(ovrUniformRing * ring)
 {
-	// Discard the depth buffer, so the tiler won't need to write it back out to memory.
-	const GLenum depthAttachment[1] = { GL_DEPTH_ATTACHMENT };
-	glInvalidateFramebuffer(GL_FRAMEBUFFER, 1, depthAttachment);
+	ring->Buffer = 0;
+	ring->BlockSize = 0;
+	ring->BlocksPerFrame = 0;
+	ring->Frame = 0;
+	for (int i = 0; i < UNIFORM_RING_FRAMES; i++)
+	{
+		ring->Fences[i] = 0;
+	}
+}
 
-	// Flush this frame worth of commands.
-	glFlush();
+static void ovrUniformRing_Create(ovrUniformRing * ring, const int blockSize, const int blocksPerFrame)
+{
+	GLint alignment = 0;
+	GL(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+	alignment = (alignment > 0) ? alignment : 256;
+
+	ring->BlockSize = ((blockSize + alignment - 1) / alignment) * alignment;
+	ring->BlocksPerFrame = blocksPerFrame;
+	ring->Frame = 0;
+
+	GL(glGenBuffers(1, &ring->Buffer));
+	GL(glBindBuffer(GL_UNIFORM_BUFFER, ring->Buffer));
+	GL(glBufferData(GL_UNIFORM_BUFFER, UNIFORM_RING_FRAMES * blocksPerFrame * ring->BlockSize, NULL, GL_DYNAMIC_DRAW));
+	GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
 }
 
-static void ovrFramebuffer_Advance(ovrFramebuffer * frameBuffer)
+static void ovrUniformRing_Destroy(ovrUniformRing * ring)
 {
-	// Advance to the next texture from the set.
-	frameBuffer->TextureSwapChainIndex = (frameBuffer->TextureSwapChainIndex + 1) % frameBuffer->TextureSwapChainLength;
+	for (int i = 0; i < UNIFORM_RING_FRAMES; i++)
+	{
+		if (ring->Fences[i] != 0)
+		{
+			GL(glDeleteSync(ring->Fences[i]));
+		}
+	}
+	if (ring->Buffer != 0)
+	{
+		GL(glDeleteBuffers(1, &ring->Buffer));
+	}
+	ovrUniformRing_Clear(ring);
 }
 
-/*
-================================================================================
+// Moves on to the next frame and maps its blocks, waiting for the GPU to finish with
+// them if necessary. Block i of the frame starts at i * BlockSize bytes.
+static unsigned char * ovrUniformRing_MapFrame(ovrUniformRing * ring)
+{
+	ring->Frame = (ring->Frame + 1) % UNIFORM_RING_FRAMES;
+	if (ring->Fences[ring->Frame] != 0)
+	{
+		GL(glClientWaitSync(ring->Fences[ring->Frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000 * 1000 * 1000));
+		GL(glDeleteSync(ring->Fences[ring->Frame]));
+		ring->Fences[ring->Frame] = 0;
+	}
+	const int frameSize = ring->BlocksPerFrame * ring->BlockSize;
+	GL(glBindBuffer(GL_UNIFORM_BUFFER, ring->Buffer));
+	GL(unsigned char * blocks = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, ring->Frame * frameSize, frameSize,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	return blocks;
+}
 
-ovrScene
+#if LATE_LATCH
+// Maps the start of one block of the current frame without waiting for the GPU, so the
+// block can be updated after the draws that read it were issued, as long as they were not
+// flushed yet.
+static unsigned char * ovrUniformRing_MapBlock(ovrUniformRing * ring, const int block, const int size)
+{
+	const int offset = (ring->Frame * ring->BlocksPerFrame + block) * ring->BlockSize;
+	GL(glBindBuffer(GL_UNIFORM_BUFFER, ring->Buffer));
+	GL(unsigned char * data = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, offset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	return data;
+}
+#endif
 
-================================================================================
-*/
+static void ovrUniformRing_Unmap(ovrUniformRing * ring)
+{
+	GL(glUnmapBuffer(GL_UNIFORM_BUFFER));
+	GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+}
 
-#define NUM_INSTANCES		1500
+static void ovrUniformRing_BindBlock(const ovrUniformRing * ring, const int binding, const int block)
+{
+	const int offset = (ring->Frame * ring->BlocksPerFrame + block) * ring->BlockSize;
+	GL(glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring->Buffer, offset, ring->BlockSize));
+}
 
-typedef struct
+// Call after the last draw that reads the blocks of the current frame.
+static void ovrUniformRing_EndFrame(ovrUniformRing * ring)
 {
-	bool				CreatedScene;
-	bool				CreatedVAOs;
-	unsigned int		Random;
-	ovrProgram			Program;
-	ovrGeometry			Cube;
-	GLuint				InstanceTransformBuffer;
-	ovrVector3f			CubePositions[NUM_INSTANCES];
-	ovrVector3f			CubeRotations[NUM_INSTANCES];
-} ovrScene;
+	GL(ring->Fences[ring->Frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+}
 
-static const char VERTEX_SHADER[] =
-"#version 300 es\n"
-"in vec3 vertexPosition;\n"
-"in vec4 vertexColor;\n"
-"in mat4 vertexTransform;\n"
-"uniform mat4 ViewMatrix;\n"
-"uniform mat4 ProjectionMatrix;\n"
-"out vec4 fragmentColor;\n"
-"void main()\n"
-"{\n"
-"	gl_Position = ProjectionMatrix * ( ViewMatrix * ( vertexTransform * vec4( vertexPosition, 1.0 ) ) );\n"
-"	fragmentColor = vertexColor;\n"
-"}\n";
+//================================================================================
+//
+// ovrHiddenAreaMask
+//
+//================================================================================
 
-static const char FRAGMENT_SHADER[] =
-"#version 300 es\n"
-"in lowp vec4 fragmentColor;\n"
-"out lowp vec4 outColor;\n"
-"void main()\n"
-"{\n"
-"	outColor = fragmentColor;\n"
-"}\n";
+/*
+The lenses only show a roughly circular part of each eye image. The hidden area mask
+is a ring of triangles between the visible circle and the edges of the eye image.
+It is drawn at the near plane right after the depth buffer is cleared, so all
+fragments that fall outside the visible circle fail the depth test and are rejected
+before they are shaded. The mesh is built in normalized device coordinates from the
+projection, and only rebuilt when the field of view, the resolution or the radius changes.
+
+The VrApi does not expose the lens distortion, only the suggested field of view, which
+covers the whole lens. So the radius of the visible circle cannot be derived from the
+projection and distortion bounds, and is a parameter per device type instead. A device
+with an unknown lens gets no mask, since a guessed radius could hide visible pixels.
+*/
 
-static void ovrScene_Clear(ovrScene * scene)
+#define LOCAL_PREF_HIDDEN_AREA_TAN_ANGLE	"dev_hiddenAreaTanAngle"	// visible radius in tangent-angle space, "0" turns the mask off, default per device type
+#define HIDDEN_AREA_SEGMENTS				64		// must be a multiple of 8 to hit the corners
+
+// Radius of the visible part of the lens in tangent-angle space, or 0 if the lens is not known.
+static float DeviceTypeVisibleTanAngle(const int deviceType)
 {
-	scene->CreatedScene = false;
-	scene->CreatedVAOs = false;
-	scene->Random = 2;
-	scene->InstanceTransformBuffer = 0;
+	switch (deviceType)
+	{
+		// Both use the Gear VR lens. 1.2 is about 50 degrees off axis, so only the corners of the
+		// 90 degree eye image, which reach 55 degrees, are hidden.
+		case VRAPI_DEVICE_TYPE_NOTE4:
+		case VRAPI_DEVICE_TYPE_S6:		return 1.2f;
+		default:						return 0.0f;
+	}
+}
 
-	ovrProgram_Clear(&scene->Program);
-	ovrGeometry_Clear(&scene->Cube);
+typedef struct
+{
+	ovrGeometry		Geometry;
+	float			FovDegreesX;
+	float			FovDegreesY;
+	int				Width;
+	int				Height;
+	float			VisibleTanAngle;
+	float			HiddenFraction;
+} ovrHiddenAreaMask;
+
+static void ovrHiddenAreaMask_Clear(ovrHiddenAreaMask * mask)
+{
+	ovrGeometry_Clear(&mask->Geometry);
+	mask->FovDegreesX = 0.0f;
+	mask->FovDegreesY = 0.0f;
+	mask->Width = 0;
+	mask->Height = 0;
+	mask->VisibleTanAngle = 0.0f;
+	mask->HiddenFraction = 0.0f;
 }
 
-static bool ovrScene_IsCreated(ovrScene * scene)
+static void ovrHiddenAreaMask_Destroy(ovrHiddenAreaMask * mask)
 {
-	return scene->CreatedScene;
+	if (mask->Geometry.VertexBuffer != 0)
+	{
+		ovrGeometry_DestroyVAO(&mask->Geometry);
+		ovrGeometry_Destroy(&mask->Geometry);
+	}
+	ovrHiddenAreaMask_Clear(mask);
 }
 
-static void ovrScene_CreateVAOs(ovrScene * scene)
+static void ovrHiddenAreaMask_Create(ovrHiddenAreaMask * mask, const float fovDegreesX, const float fovDegreesY, const int width, const int height,
+	const float visibleTanAngle)
 {
-	if (!scene->CreatedVAOs)
+	typedef struct
 	{
-		ovrGeometry_CreateVAO(&scene->Cube);
+		float	x, y;
+	} ovrMaskVertex;
 
-		// Modify the VAO to use the instance transform attributes.
-		GL(glBindVertexArray(scene->Cube.VertexArrayObject));
-		GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
-		for (int i = 0; i < 4; i++)
+	ovrMaskVertex vertices[HIDDEN_AREA_SEGMENTS * 2];
+	unsigned short indices[HIDDEN_AREA_SEGMENTS * 6];
+
+	const ovrMatrix4f projection = ovrMatrix4f_CreateProjectionFov(fovDegreesX, fovDegreesY, 0.0f, 0.0f, 1.0f, 0.0f);
+
+	for (int i = 0; i < HIDDEN_AREA_SEGMENTS; i++)
+	{
+		// Project the tangent-angle circle of the lens.
+		const float angle = i * (2.0f * VRAPI_PI / HIDDEN_AREA_SEGMENTS);
+		const float tanX = visibleTanAngle * cosf(angle);
+		const float tanY = visibleTanAngle * sinf(angle);
+		const float clipX = projection.M[0][0] * tanX + projection.M[0][1] * tanY - projection.M[0][2];
+		const float clipY = projection.M[1][0] * tanX + projection.M[1][1] * tanY - projection.M[1][2];
+		const float clipW = -projection.M[3][2];
+
+		// Push the point out to the edge of the image, and clamp the circle to the image.
+		float innerX = clipX / clipW;
+		float innerY = clipY / clipW;
+		const float edge = fmaxf(fabsf(innerX), fabsf(innerY));
+		const float outerX = innerX / edge;
+		const float outerY = innerY / edge;
+		if (edge > 1.0f)
 		{
-			GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i));
-			GL(glVertexAttribPointer(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i, 4, GL_FLOAT,
-				false, 4 * 4 * sizeof(float), (void *)(i * 4 * sizeof(float))));
-			GL(glVertexAttribDivisor(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i, 1));
+			innerX = outerX;
+			innerY = outerY;
 		}
-		GL(glBindVertexArray(0));
 
-		scene->CreatedVAOs = true;
+		vertices[i * 2 + 0].x = innerX;
+		vertices[i * 2 + 0].y = innerY;
+		vertices[i * 2 + 1].x = outerX;
+		vertices[i * 2 + 1].y = outerY;
 	}
-}
 
-static void ovrScene_DestroyVAOs(ovrScene * scene)
-{
-	if (scene->CreatedVAOs)
+	float hiddenArea = 0.0f;
+	for (int i = 0; i < HIDDEN_AREA_SEGMENTS; i++)
 	{
-		ovrGeometry_DestroyVAO(&scene->Cube);
-
-		scene->CreatedVAOs = false;
+		const int i0 = i * 2;
+		const int i1 = ((i + 1) % HIDDEN_AREA_SEGMENTS) * 2;
+		indices[i * 6 + 0] = (unsigned short)(i0 + 0);
+		indices[i * 6 + 1] = (unsigned short)(i0 + 1);
+		indices[i * 6 + 2] = (unsigned short)(i1 + 1);
+		indices[i * 6 + 3] = (unsigned short)(i1 + 1);
+		indices[i * 6 + 4] = (unsigned short)(i1 + 0);
+		indices[i * 6 + 5] = (unsigned short)(i0 + 0);
+
+		// Area of the quad between the circle and the edge.
+		const ovrMaskVertex * q[4] = { &vertices[i0 + 0], &vertices[i0 + 1], &vertices[i1 + 1], &vertices[i1 + 0] };
+		for (int j = 0; j < 4; j++)
+		{
+			hiddenArea += 0.5f * (q[j]->x * q[(j + 1) % 4]->y - q[(j + 1) % 4]->x * q[j]->y);
+		}
 	}
-}
 
-static float ovrScene_RandomFloat(ovrScene * scene)
-{
-	scene->Random = 1664525L * scene->Random + 1013904223L;
-	unsigned int rf = 0x3F800000 | (scene->Random & 0x007FFFFF);
-	return (*(float *)&rf) - 1.0f;
-}
+	ovrGeometry * geometry = &mask->Geometry;
+	geometry->VertexCount = HIDDEN_AREA_SEGMENTS * 2;
+	geometry->IndexCount = HIDDEN_AREA_SEGMENTS * 6;
 
-static void ovrScene_Create(ovrScene * scene)
-{
-	ovrProgram_Create(&scene->Program, VERTEX_SHADER, FRAGMENT_SHADER);
-	ovrGeometry_CreateCube(&scene->Cube);
+	geometry->VertexAttribs[0].Index = VERTEX_ATTRIBUTE_LOCATION_POSITION;
+	geometry->VertexAttribs[0].Size = 2;
+	geometry->VertexAttribs[0].Type = GL_FLOAT;
+	geometry->VertexAttribs[0].Normalized = false;
+	geometry->VertexAttribs[0].Stride = sizeof(vertices[0]);
+	geometry->VertexAttribs[0].Pointer = (const GLvoid *)0;
 
-	// Create the instance transform attribute buffer.
-	GL(glGenBuffers(1, &scene->InstanceTransformBuffer));
-	GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
-	GL(glBufferData(GL_ARRAY_BUFFER, NUM_INSTANCES * 4 * 4 * sizeof(float), NULL, GL_DYNAMIC_DRAW));
+	GL(glGenBuffers(1, &geometry->VertexBuffer));
+	GL(glBindBuffer(GL_ARRAY_BUFFER, geometry->VertexBuffer));
+	GL(glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW));
 	GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
 
-	// Setup random cube positions and rotations.
-	for (int i = 0; i < NUM_INSTANCES; i++)
-	{
-		// Using volatile keeps the compiler from optimizing away multiple calls to drand48().
-		volatile float rx, ry, rz;
+	GL(glGenBuffers(1, &geometry->IndexBuffer));
+	GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->IndexBuffer));
+	GL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW));
+	GL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+
+	ovrGeometry_CreateVAO(geometry);
+
+	mask->FovDegreesX = fovDegreesX;
+	mask->FovDegreesY = fovDegreesY;
+	mask->Width = width;
+	mask->Height = height;
+	mask->VisibleTanAngle = visibleTanAngle;
+	// The image covers 2x2 in normalized device coordinates.
+	mask->HiddenFraction = fabsf(hiddenArea) / 4.0f;
+
+	LOGI("Hidden area mask %dx%d fov %1.1fx%1.1f radius %1.2f: %1.1f%% of the pixels are hidden", width, height,
+		fovDegreesX, fovDegreesY, visibleTanAngle, mask->HiddenFraction * 100.0f);
+}
+
+// Rebuilds the mask if the field of view, the resolution or the radius changed.
+static void ovrHiddenAreaMask_Update(ovrHiddenAreaMask * mask, const float fovDegreesX, const float fovDegreesY, const int width, const int height,
+	const float visibleTanAngle)
+{
+	if (mask->Geometry.VertexBuffer != 0 &&
+		mask->FovDegreesX == fovDegreesX && mask->FovDegreesY == fovDegreesY &&
+		mask->Width == width && mask->Height == height && mask->VisibleTanAngle == visibleTanAngle)
+	{
+		return;
+	}
+	ovrHiddenAreaMask_Destroy(mask);
+	ovrHiddenAreaMask_Create(mask, fovDegreesX, fovDegreesY, width, height, visibleTanAngle);
+}
+
+// Writes opaque black and the nearest depth into the hidden area of the bound framebuffer.
+static void ovrHiddenAreaMask_Draw(const ovrHiddenAreaMask * mask, const ovrProgram * program)
+{
+	GL(glEnable(GL_DEPTH_TEST));
+	GL(glDepthFunc(GL_ALWAYS));
+	GL(glDepthMask(GL_TRUE));
+	GL(glUseProgram(program->Program));
+	GL(glBindVertexArray(mask->Geometry.VertexArrayObject));
+	GL(glDrawElements(GL_TRIANGLES, mask->Geometry.IndexCount, GL_UNSIGNED_SHORT, NULL));
+	GL(glBindVertexArray(0));
+	GL(glUseProgram(0));
+	GL(glDepthFunc(GL_LEQUAL));
+}
+
+//================================================================================
+//
+// ovrFramebuffer
+//
+//================================================================================
+
+typedef struct
+{
+	int						Width;
+	int						Height;
+	// The render area in the lower left corner of the textures, which may be smaller than the textures.
+	int						ViewportWidth;
+	int						ViewportHeight;
+	int						Multisamples;
+	int						TextureSwapChainLength;
+	int						TextureSwapChainIndex;
+	// A cube map has a frame buffer for each face of each swap chain image.
+	int						Faces;
+	int						Face;
+	ovrTextureSwapChain *	ColorTextureSwapChain;		// NULL for an offscreen framebuffer
+	GLuint *				ColorTextures;
+	// Depth is never stored, so a single transient depth buffer is shared by all swap chain
+	// images, and possibly with another framebuffer of the same size, like the other eye.
+	GLenum					DepthFormat;
+	GLuint					DepthBuffer;
+	bool					OwnsDepthBuffer;
+	GLuint *				FrameBuffers;
+	int *					Contents;		// ovrAttachmentContents bits per swap chain image and face
+	ovrHiddenAreaMask		HiddenAreaMask;
+} ovrFramebuffer;
+
+// Tracks which attachments of a framebuffer hold valid data in memory.
+typedef enum
+{
+	ATTACHMENT_CONTENTS_COLOR	= 1 << 0,
+	ATTACHMENT_CONTENTS_DEPTH	= 1 << 1
+} ovrAttachmentContents;
+
+static void ovrFramebuffer_Clear(ovrFramebuffer * frameBuffer)
+{
+	frameBuffer->Width = 0;
+	frameBuffer->Height = 0;
+	frameBuffer->ViewportWidth = 0;
+	frameBuffer->ViewportHeight = 0;
+	frameBuffer->Multisamples = 0;
+	frameBuffer->TextureSwapChainLength = 0;
+	frameBuffer->TextureSwapChainIndex = 0;
+	frameBuffer->Faces = 1;
+	frameBuffer->Face = 0;
+	frameBuffer->ColorTextureSwapChain = NULL;
+	frameBuffer->ColorTextures = NULL;
+	frameBuffer->DepthFormat = GL_NONE;
+	frameBuffer->DepthBuffer = 0;
+	frameBuffer->OwnsDepthBuffer = false;
+	frameBuffer->FrameBuffers = NULL;
+	frameBuffer->Contents = NULL;
+	ovrHiddenAreaMask_Clear(&frameBuffer->HiddenAreaMask);
+}
+
+static int DepthFormatBytes(const GLenum depthFormat)
+{
+	// 24-bit depth is stored in 32 bits, packed with 8 bits of stencil or padding.
+	return (depthFormat == GL_DEPTH_COMPONENT16) ? 2 : 4;
+}
+
+// Returns the smallest depth format that still separates surfaces that are minSeparation
+// apart at farthestZ, for a projection with an infinite far plane at nearZ. With such a
+// projection the window depth is 1 - nearZ / z, so one depth step at z spans z^2 / (nearZ * 2^bits).
+static GLenum ChooseDepthFormat(const float nearZ, const float farthestZ, const float minSeparation)
+{
+	const float depthStep16 = farthestZ * farthestZ / (nearZ * 65536.0f);
+	return (depthStep16 * 4.0f < minSeparation) ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT24;
+}
+
+// Returns the GPU memory in bytes taken by the depth buffer(s) this framebuffer allocated.
+static int ovrFramebuffer_GetDepthMemory(const ovrFramebuffer * frameBuffer)
+{
+	if (!frameBuffer->OwnsDepthBuffer)
+	{
+		return 0;
+	}
+	const int samples = (frameBuffer->Multisamples > 1) ? frameBuffer->Multisamples : 1;
+	return frameBuffer->Width * frameBuffer->Height * samples * DepthFormatBytes(frameBuffer->DepthFormat);
+}
+
+// Creates the depth buffer and the frame buffers for the color textures. The depth buffer
+// of shareDepth is used instead of allocating a new one, if it is compatible. There is no
+// depth buffer at all if depthFormat is GL_NONE.
+static bool ovrFramebuffer_CreateFrameBuffers(ovrFramebuffer * frameBuffer, const GLenum depthFormat, const ovrFramebuffer * shareDepth)
+{
+	const int width = frameBuffer->Width;
+	const int height = frameBuffer->Height;
+	const int multisamples = frameBuffer->Multisamples;
+
+	const int faces = frameBuffer->Faces;
+	const GLenum textureTarget = (faces == 6) ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+	// Zeroed, so destroying a framebuffer that failed halfway only deletes the frame buffers that were created.
+	frameBuffer->FrameBuffers = (GLuint *)calloc(frameBuffer->TextureSwapChainLength * faces, sizeof(GLuint));
+	frameBuffer->Contents = (int *)calloc(frameBuffer->TextureSwapChainLength * faces, sizeof(int));
+
+	PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT =
+		(PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC)eglGetProcAddress("glRenderbufferStorageMultisampleEXT");
+	PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC glFramebufferTexture2DMultisampleEXT =
+		(PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC)eglGetProcAddress("glFramebufferTexture2DMultisampleEXT");
+	// The entry points may be exported by drivers that do not support the extension.
+	const bool multisampled = (multisamples > 1 && glRenderbufferStorageMultisampleEXT != NULL && glFramebufferTexture2DMultisampleEXT != NULL &&
+								GlExtensionAvailable("GL_EXT_multisampled_render_to_texture"));
+	if (multisamples > 1 && !multisampled)
+	{
+		LOGW("%dx MSAA requested without GL_EXT_multisampled_render_to_texture, rendering without MSAA", multisamples);
+		frameBuffer->Multisamples = 1;
+	}
+
+	// Compared with the sample count that is actually rendered, which shareDepth fell back to as well.
+	const bool canShareDepth = (shareDepth != NULL && shareDepth->DepthBuffer != 0 &&
+		shareDepth->Width == width && shareDepth->Height == height &&
+		shareDepth->Multisamples == frameBuffer->Multisamples && shareDepth->DepthFormat == depthFormat);
+	if (depthFormat == GL_NONE)
+	{
+		// Only color, for instance for an overlay panel.
+		frameBuffer->DepthFormat = GL_NONE;
+		frameBuffer->DepthBuffer = 0;
+		frameBuffer->OwnsDepthBuffer = false;
+	}
+	else if (canShareDepth)
+	{
+		frameBuffer->DepthFormat = shareDepth->DepthFormat;
+		frameBuffer->DepthBuffer = shareDepth->DepthBuffer;
+		frameBuffer->OwnsDepthBuffer = false;
+	}
+	else
+	{
+		if (shareDepth != NULL)
+		{
+			LOGW("ovrFramebuffer_CreateFrameBuffers: %dx%d %dx MSAA cannot share the depth buffer of %dx%d %dx MSAA, allocating another",
+				width, height, frameBuffer->Multisamples, shareDepth->Width, shareDepth->Height, shareDepth->Multisamples);
+		}
+		// On a tiler a multisampled depth buffer that is always cleared and invalidated
+		// only ever lives in tile memory, so it is effectively memoryless.
+		frameBuffer->DepthFormat = depthFormat;
+		frameBuffer->OwnsDepthBuffer = true;
+		GL(glGenRenderbuffers(1, &frameBuffer->DepthBuffer));
+		GL(glBindRenderbuffer(GL_RENDERBUFFER, frameBuffer->DepthBuffer));
+		if (multisampled)
+		{
+			GL(glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, multisamples, depthFormat, width, height));
+		}
+		else
+		{
+			GL(glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, width, height));
+		}
+		GL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+	}
+
+	for (int i = 0; i < frameBuffer->TextureSwapChainLength; i++)
+	{
+		// Create the color buffer texture.
+		const GLuint colorTexture = frameBuffer->ColorTextures[i];
+		GL(glBindTexture(textureTarget, colorTexture));
+		GL(glTexParameteri(textureTarget, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+		GL(glTexParameteri(textureTarget, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+		GL(glTexParameteri(textureTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+		GL(glTexParameteri(textureTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+		GL(glBindTexture(textureTarget, 0));
+
+		// Create the frame buffers.
+		for (int face = 0; face < faces; face++)
+		{
+			const GLenum faceTarget = (faces == 6) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+			GLuint * frameBufferObject = &frameBuffer->FrameBuffers[i * faces + face];
+			GL(glGenFramebuffers(1, frameBufferObject));
+			GL(glBindFramebuffer(GL_FRAMEBUFFER, *frameBufferObject));
+			if (multisampled)
+			{
+				GL(glFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, faceTarget, colorTexture, 0, multisamples));
+			}
+			else
+			{
+				GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, faceTarget, colorTexture, 0));
+			}
+			if (frameBuffer->DepthBuffer != 0)
+			{
+				GL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, frameBuffer->DepthBuffer));
+			}
+			GL(GLenum renderFramebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER));
+			GL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+			if (renderFramebufferStatus != GL_FRAMEBUFFER_COMPLETE)
+			{
+				LOGE("Incomplete frame buffer object: %s", GlFrameBufferStatusString(renderFramebufferStatus));
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool ovrFramebuffer_Create(ovrFramebuffer * frameBuffer, const ovrTextureFormat colorFormat, const int width, const int height, const int multisamples,
+	const GLenum depthFormat, const ovrFramebuffer * shareDepth)
+{
+	frameBuffer->Width = width;
+	frameBuffer->Height = height;
+	frameBuffer->ViewportWidth = width;
+	frameBuffer->ViewportHeight = height;
+	frameBuffer->Multisamples = multisamples;
+
+	frameBuffer->ColorTextureSwapChain = vrapi_CreateTextureSwapChain(VRAPI_TEXTURE_TYPE_2D, colorFormat, width, height, 1, true);
+	frameBuffer->TextureSwapChainLength = vrapi_GetTextureSwapChainLength(frameBuffer->ColorTextureSwapChain);
+	frameBuffer->ColorTextures = (GLuint *)malloc(frameBuffer->TextureSwapChainLength * sizeof(GLuint));
+	for (int i = 0; i < frameBuffer->TextureSwapChainLength; i++)
+	{
+		frameBuffer->ColorTextures[i] = vrapi_GetTextureSwapChainHandle(frameBuffer->ColorTextureSwapChain, i);
+	}
+
+	return ovrFramebuffer_CreateFrameBuffers(frameBuffer, depthFormat, shareDepth);
+}
+
+// Creates a framebuffer with a single color texture that is rendered to and sampled by the
+// application itself, instead of being handed over to the time warp.
+static bool ovrFramebuffer_CreateOffscreen(ovrFramebuffer * frameBuffer, const int width, const int height, const int multisamples,
+	const GLenum depthFormat, const ovrFramebuffer * shareDepth)
+{
+	frameBuffer->Width = width;
+	frameBuffer->Height = height;
+	frameBuffer->ViewportWidth = width;
+	frameBuffer->ViewportHeight = height;
+	frameBuffer->Multisamples = multisamples;
+
+	frameBuffer->ColorTextureSwapChain = NULL;
+	frameBuffer->TextureSwapChainLength = 1;
+	frameBuffer->ColorTextures = (GLuint *)malloc(sizeof(GLuint));
+	GL(glGenTextures(1, &frameBuffer->ColorTextures[0]));
+	GL(glBindTexture(GL_TEXTURE_2D, frameBuffer->ColorTextures[0]));
+	GL(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height));
+	GL(glBindTexture(GL_TEXTURE_2D, 0));
+
+	return ovrFramebuffer_CreateFrameBuffers(frameBuffer, depthFormat, shareDepth);
+}
+
+// Creates a cube map swap chain for time warp, with a frame buffer per face. Select the
+// face to render to by setting Face before starting a render pass.
+static bool ovrFramebuffer_CreateCubeMap(ovrFramebuffer * frameBuffer, const ovrTextureFormat colorFormat, const int size,
+	const GLenum depthFormat)
+{
+	frameBuffer->Width = size;
+	frameBuffer->Height = size;
+	frameBuffer->ViewportWidth = size;
+	frameBuffer->ViewportHeight = size;
+	frameBuffer->Multisamples = 1;
+	frameBuffer->Faces = 6;
+	frameBuffer->Face = 0;
+
+	frameBuffer->ColorTextureSwapChain = vrapi_CreateTextureSwapChain(VRAPI_TEXTURE_TYPE_CUBE, colorFormat, size, size, 1, true);
+	frameBuffer->TextureSwapChainLength = vrapi_GetTextureSwapChainLength(frameBuffer->ColorTextureSwapChain);
+	frameBuffer->ColorTextures = (GLuint *)malloc(frameBuffer->TextureSwapChainLength * sizeof(GLuint));
+	for (int i = 0; i < frameBuffer->TextureSwapChainLength; i++)
+	{
+		frameBuffer->ColorTextures[i] = vrapi_GetTextureSwapChainHandle(frameBuffer->ColorTextureSwapChain, i);
+	}
+
+	return ovrFramebuffer_CreateFrameBuffers(frameBuffer, depthFormat, NULL);
+}
+
+static void ovrFramebuffer_Destroy(ovrFramebuffer * frameBuffer)
+{
+	GL(glDeleteFramebuffers(frameBuffer->TextureSwapChainLength * frameBuffer->Faces, frameBuffer->FrameBuffers));
+	if (frameBuffer->OwnsDepthBuffer)
+	{
+		GL(glDeleteRenderbuffers(1, &frameBuffer->DepthBuffer));
+	}
+	if (frameBuffer->ColorTextureSwapChain != NULL)
+	{
+		vrapi_DestroyTextureSwapChain(frameBuffer->ColorTextureSwapChain);
+	}
+	else
+	{
+		GL(glDeleteTextures(frameBuffer->TextureSwapChainLength, frameBuffer->ColorTextures));
+	}
+
+	ovrHiddenAreaMask_Destroy(&frameBuffer->HiddenAreaMask);
+
+	free(frameBuffer->ColorTextures);
+	free(frameBuffer->FrameBuffers);
+	free(frameBuffer->Contents);
+
+	ovrFramebuffer_Clear(frameBuffer);
+}
+
+// Returns the index of the frame buffer of the current swap chain image and face.
+static int ovrFramebuffer_GetCurrentIndex(const ovrFramebuffer * frameBuffer)
+{
+	return frameBuffer->TextureSwapChainIndex * frameBuffer->Faces + frameBuffer->Face;
+}
+
+static void ovrFramebuffer_SetCurrent(ovrFramebuffer * frameBuffer)
+{
+	GL(glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer->FrameBuffers[ovrFramebuffer_GetCurrentIndex(frameBuffer)]));
+}
+
+static GLuint ovrFramebuffer_GetColorTexture(const ovrFramebuffer * frameBuffer)
+{
+	return frameBuffer->ColorTextures[frameBuffer->TextureSwapChainIndex];
+}
+
+static void ovrFramebuffer_SetNone()
+{
+	GL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+// Restricts rendering to the lower left width x height texels, without reallocating anything.
+static void ovrFramebuffer_SetViewport(ovrFramebuffer * frameBuffer, const int width, const int height)
+{
+	frameBuffer->ViewportWidth = (width < 1) ? 1 : ((width > frameBuffer->Width) ? frameBuffer->Width : width);
+	frameBuffer->ViewportHeight = (height < 1) ? 1 : ((height > frameBuffer->Height) ? frameBuffer->Height : height);
+}
+
+static void ovrFramebuffer_Advance(ovrFramebuffer * frameBuffer)
+{
+	// Advance to the next texture from the set.
+	frameBuffer->TextureSwapChainIndex = (frameBuffer->TextureSwapChainIndex + 1) % frameBuffer->TextureSwapChainLength;
+}
+
+//================================================================================
+//
+// ovrRenderPass
+//
+//================================================================================
+
+/*
+A render pass declares up front what happens to each attachment of an ovrFramebuffer
+when rendering starts and ends. On a tiler the load operation decides whether the
+tile memory is initialized from main memory, and the store operation decides
+whether the tile memory is written back. ovrRenderPass_Begin and ovrRenderPass_End
+turn the declaration into the minimum number of glClear and glInvalidateFramebuffer
+calls, and verify that a pass never loads an attachment that does not hold valid data.
+*/
+
+typedef enum
+{
+	RENDER_PASS_LOAD_DONT_CARE,		// contents are undefined, nothing is loaded
+	RENDER_PASS_LOAD_CLEAR,			// contents are cleared, nothing is loaded
+	RENDER_PASS_LOAD_LOAD			// contents are loaded from memory (expensive on a tiler)
+} ovrRenderPassLoadOp;
+
+typedef enum
+{
+	RENDER_PASS_STORE_DONT_CARE,	// contents are discarded
+	RENDER_PASS_STORE_STORE,		// contents are written back to memory
+	RENDER_PASS_STORE_RESOLVE		// multisampled contents are resolved and written back, and the pass is flushed
+} ovrRenderPassStoreOp;
+
+typedef struct
+{
+	ovrRenderPassLoadOp		ColorLoadOp;
+	ovrRenderPassStoreOp	ColorStoreOp;
+	ovrRenderPassLoadOp		DepthLoadOp;
+	ovrRenderPassStoreOp	DepthStoreOp;
+	float					ClearColor[4];
+	float					ClearDepth;
+	// Clear the outermost texels to opaque black before storing, because
+	// OpenGL-ES does not support GL_CLAMP_TO_BORDER.
+	bool					ClearBorder;
+} ovrRenderPass;
+
+static void ovrRenderPass_Clear(ovrRenderPass * renderPass)
+{
+	renderPass->ColorLoadOp = RENDER_PASS_LOAD_CLEAR;
+	renderPass->ColorStoreOp = RENDER_PASS_STORE_STORE;
+	renderPass->DepthLoadOp = RENDER_PASS_LOAD_CLEAR;
+	renderPass->DepthStoreOp = RENDER_PASS_STORE_DONT_CARE;
+	renderPass->ClearColor[0] = 0.0f;
+	renderPass->ClearColor[1] = 0.0f;
+	renderPass->ClearColor[2] = 0.0f;
+	renderPass->ClearColor[3] = 1.0f;
+	renderPass->ClearDepth = 1.0f;
+	renderPass->ClearBorder = false;
+}
+
+// Binds the current texture of the framebuffer and initializes the tile memory.
+static void ovrRenderPass_Begin(const ovrRenderPass * renderPass, ovrFramebuffer * frameBuffer)
+{
+	int * contents = &frameBuffer->Contents[ovrFramebuffer_GetCurrentIndex(frameBuffer)];
+
+	if (renderPass->ColorLoadOp == RENDER_PASS_LOAD_LOAD && (*contents & ATTACHMENT_CONTENTS_COLOR) == 0)
+	{
+		LOGE("ovrRenderPass_Begin: color attachment %d loads stale tile memory", frameBuffer->TextureSwapChainIndex);
+	}
+	if (renderPass->DepthLoadOp == RENDER_PASS_LOAD_LOAD && (*contents & ATTACHMENT_CONTENTS_DEPTH) == 0)
+	{
+		LOGE("ovrRenderPass_Begin: depth attachment %d loads stale tile memory", frameBuffer->TextureSwapChainIndex);
+	}
+
+	ovrFramebuffer_SetCurrent(frameBuffer);
+
+	// The whole framebuffer is cleared even when the viewport is smaller, because a
+	// full clear is free on a tiler while a partial clear may cause the rest to be loaded.
+	GL(glEnable(GL_SCISSOR_TEST));
+	GL(glScissor(0, 0, frameBuffer->Width, frameBuffer->Height));
+
+	// All attachments that are cleared are cleared with a single call.
+	GLbitfield clearMask = 0;
+	if (renderPass->ColorLoadOp == RENDER_PASS_LOAD_CLEAR)
+	{
+		GL(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+		GL(glClearColor(renderPass->ClearColor[0], renderPass->ClearColor[1], renderPass->ClearColor[2], renderPass->ClearColor[3]));
+		clearMask |= GL_COLOR_BUFFER_BIT;
+	}
+	if (renderPass->DepthLoadOp == RENDER_PASS_LOAD_CLEAR)
+	{
+		GL(glDepthMask(GL_TRUE));
+		GL(glClearDepthf(renderPass->ClearDepth));
+		clearMask |= GL_DEPTH_BUFFER_BIT;
+	}
+	if (clearMask != 0)
+	{
+		GL(glClear(clearMask));
+	}
+
+	// Attachments that are neither cleared nor loaded are invalidated so the tiler does not load them.
+	GLenum invalidate[2];
+	int invalidateCount = 0;
+	if (renderPass->ColorLoadOp == RENDER_PASS_LOAD_DONT_CARE)
+	{
+		invalidate[invalidateCount++] = GL_COLOR_ATTACHMENT0;
+	}
+	if (renderPass->DepthLoadOp == RENDER_PASS_LOAD_DONT_CARE)
+	{
+		invalidate[invalidateCount++] = GL_DEPTH_ATTACHMENT;
+	}
+	if (invalidateCount > 0)
+	{
+		GL(glInvalidateFramebuffer(GL_FRAMEBUFFER, invalidateCount, invalidate));
+	}
+
+	GL(glViewport(0, 0, frameBuffer->ViewportWidth, frameBuffer->ViewportHeight));
+	GL(glScissor(0, 0, frameBuffer->ViewportWidth, frameBuffer->ViewportHeight));
+}
+
+// Finishes the pass on the currently bound framebuffer and stores or discards the tile memory.
+static void ovrRenderPass_End(const ovrRenderPass * renderPass, ovrFramebuffer * frameBuffer)
+{
+	if (renderPass->ClearBorder)
+	{
+		// Clear to fully opaque black.
+		GL(glEnable(GL_SCISSOR_TEST));
+		GL(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+		GL(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
+		// The border is cleared around the viewport, which is the part time warp samples.
+		const int width = frameBuffer->ViewportWidth;
+		const int height = frameBuffer->ViewportHeight;
+		// bottom
+		GL(glScissor(0, 0, width, 1));
+		GL(glClear(GL_COLOR_BUFFER_BIT));
+		// top
+		GL(glScissor(0, height - 1, width, 1));
+		GL(glClear(GL_COLOR_BUFFER_BIT));
+		// left
+		GL(glScissor(0, 0, 1, height));
+		GL(glClear(GL_COLOR_BUFFER_BIT));
+		// right
+		GL(glScissor(width - 1, 0, 1, height));
+		GL(glClear(GL_COLOR_BUFFER_BIT));
+	}
+
+	// Discard the attachments that are not stored, so the tiler won't need to write them back out to memory.
+	GLenum invalidate[2];
+	int invalidateCount = 0;
+	int contents = 0;
+	if (renderPass->ColorStoreOp == RENDER_PASS_STORE_DONT_CARE)
+	{
+		invalidate[invalidateCount++] = GL_COLOR_ATTACHMENT0;
+	}
+	else
+	{
+		contents |= ATTACHMENT_CONTENTS_COLOR;
+	}
+	if (renderPass->DepthStoreOp == RENDER_PASS_STORE_DONT_CARE)
+	{
+		invalidate[invalidateCount++] = GL_DEPTH_ATTACHMENT;
+	}
+	else if (!frameBuffer->OwnsDepthBuffer || frameBuffer->TextureSwapChainLength > 1)
+	{
+		// The next user of the shared depth buffer overwrites it, so storing it is pointless.
+		LOGE("ovrRenderPass_End: depth attachment %d is shared and can not be stored", frameBuffer->TextureSwapChainIndex);
+	}
+	else
+	{
+		contents |= ATTACHMENT_CONTENTS_DEPTH;
+	}
+	if (invalidateCount > 0)
+	{
+		GL(glInvalidateFramebuffer(GL_FRAMEBUFFER, invalidateCount, invalidate));
+	}
+	frameBuffer->Contents[ovrFramebuffer_GetCurrentIndex(frameBuffer)] = contents;
+
+	if (renderPass->ColorStoreOp == RENDER_PASS_STORE_RESOLVE || renderPass->DepthStoreOp == RENDER_PASS_STORE_RESOLVE)
+	{
+		// Flush this frame worth of commands.
+		GL(glFlush());
+	}
+}
+
+//================================================================================
+//
+// ovrCommandBuffer
+//
+//================================================================================
+
+/*
+The eye pass is recorded once into a compact stream of 32-bit words and then
+replayed for each eye. Every command starts with a header word that holds the
+opcode in the low 8 bits and the number of payload words in the upper bits.
+Values that differ between the eyes are not baked into the stream. Instead a
+command references a patch slot that is filled in when the stream is replayed.
+Binding, clearing and resolving the framebuffer is left to ovrRenderPass.
+
+The stream only holds plain values (no pointers), so it can be handed over to
+another thread for submission, or saved to a file to be inspected offline.
+*/
+
+typedef enum
+{
+	COMMAND_NOP,
+	COMMAND_ENABLE,							// cap
+	COMMAND_DEPTH_MASK,						// flag
+	COMMAND_DEPTH_FUNC,						// func
+	COMMAND_USE_PROGRAM,					// program
+	COMMAND_UNIFORM_MATRIX4,				// location, 16 floats (row-major)
+	COMMAND_UNIFORM_MATRIX4_PATCHED,		// location, patch slot
+	COMMAND_BIND_VERTEX_ARRAY,				// vertex array object
+	COMMAND_DRAW_ELEMENTS_INSTANCED,		// mode, count, type, instance count
+	COMMAND_MAX
+} ovrCommandOpcode;
+
+static const char * CommandOpcodeNames[COMMAND_MAX] =
+{
+	"NOP",
+	"ENABLE",
+	"DEPTH_MASK",
+	"DEPTH_FUNC",
+	"USE_PROGRAM",
+	"UNIFORM_MATRIX4",
+	"UNIFORM_MATRIX4_PATCHED",
+	"BIND_VERTEX_ARRAY",
+	"DRAW_ELEMENTS_INSTANCED"
+};
+
+enum
+{
+	COMMAND_PATCH_VIEW_MATRIX,
+	COMMAND_PATCH_VIEW_PROJECTION_MATRIX,
+	COMMAND_PATCH_MAX_MATRICES
+};
+
+#define COMMAND_BUFFER_FILE_MAGIC		0x4243564F	// "OVCB"
+#define COMMAND_BUFFER_FILE_VERSION		3
+
+typedef struct
+{
+	ovrMatrix4f		Matrices[COMMAND_PATCH_MAX_MATRICES];
+} ovrCommandPatches;
+
+typedef struct
+{
+	unsigned int *	Words;
+	int				WordCount;
+	int				WordCapacity;
+	int				CommandCount;
+} ovrCommandBuffer;
+
+static void ovrCommandBuffer_Clear(ovrCommandBuffer * commandBuffer)
+{
+	commandBuffer->Words = NULL;
+	commandBuffer->WordCount = 0;
+	commandBuffer->WordCapacity = 0;
+	commandBuffer->CommandCount = 0;
+}
+
+static void ovrCommandBuffer_Create(ovrCommandBuffer * commandBuffer, const int wordCapacity)
+{
+	commandBuffer->Words = (unsigned int *)malloc(wordCapacity * sizeof(unsigned int));
+	commandBuffer->WordCount = 0;
+	commandBuffer->WordCapacity = wordCapacity;
+	commandBuffer->CommandCount = 0;
+}
+
+static void ovrCommandBuffer_Destroy(ovrCommandBuffer * commandBuffer)
+{
+	free(commandBuffer->Words);
+	ovrCommandBuffer_Clear(commandBuffer);
+}
+
+static void ovrCommandBuffer_Reset(ovrCommandBuffer * commandBuffer)
+{
+	commandBuffer->WordCount = 0;
+	commandBuffer->CommandCount = 0;
+}
+
+static bool ovrCommandBuffer_IsEmpty(const ovrCommandBuffer * commandBuffer)
+{
+	return commandBuffer->CommandCount == 0;
+}
+
+// Appends a command header and returns a pointer to the payload words.
+static unsigned int * ovrCommandBuffer_Emit(ovrCommandBuffer * commandBuffer, const ovrCommandOpcode opcode, const int payloadWords)
+{
+	if (commandBuffer->WordCount + 1 + payloadWords > commandBuffer->WordCapacity)
+	{
+		commandBuffer->WordCapacity = (commandBuffer->WordCapacity + 1 + payloadWords) * 2;
+		commandBuffer->Words = (unsigned int *)realloc(commandBuffer->Words, commandBuffer->WordCapacity * sizeof(unsigned int));
+	}
+	unsigned int * header = &commandBuffer->Words[commandBuffer->WordCount];
+	header[0] = (unsigned int)opcode | ((unsigned int)payloadWords << 8);
+	commandBuffer->WordCount += 1 + payloadWords;
+	commandBuffer->CommandCount++;
+	return header + 1;
+}
+
+static void ovrCommandBuffer_Enable(ovrCommandBuffer * commandBuffer, const GLenum cap)
+{
+	unsigned int * p = ovrCommandBuffer_Emit(commandBuffer, COMMAND_ENABLE, 1);
+	p[0] = cap;
+}
+
+static void ovrCommandBuffer_DepthMask(ovrCommandBuffer * commandBuffer, const GLboolean flag)
+{
+	unsigned int * p = ovrCommandBuffer_Emit(commandBuffer, COMMAND_DEPTH_MASK, 1);
+	p[0] = flag;
+}
+
+static void ovrCommandBuffer_DepthFunc(ovrCommandBuffer * commandBuffer, const GLenum func)
+{
+	unsigned int * p = ovrCommandBuffer_Emit(commandBuffer, COMMAND_DEPTH_FUNC, 1);
+	p[0] = func;
+}
+
+static void ovrCommandBuffer_UseProgram(ovrCommandBuffer * commandBuffer, const GLuint program)
+{
+	unsigned int * p = ovrCommandBuffer_Emit(commandBuffer, COMMAND_USE_PROGRAM, 1);
+	p[0] = program;
+}
+
+static void ovrCommandBuffer_UniformMatrix4(ovrCommandBuffer * commandBuffer, const GLint location, const ovrMatrix4f * matrix)
+{
+	unsigned int * p = ovrCommandBuffer_Emit(commandBuffer, COMMAND_UNIFORM_MATRIX4, 1 + 16);
+	p[0] = location;
+	memcpy(&p[1], matrix->M, 16 * sizeof(float));
+}
+
+static void ovrCommandBuffer_UniformMatrix4Patched(ovrCommandBuffer * commandBuffer, const GLint location, const int patchSlot)
+{
+	unsigned int * p = ovrCommandBuffer_Emit(commandBuffer, COMMAND_UNIFORM_MATRIX4_PATCHED, 2);
+	p[0] = location;
+	p[1] = patchSlot;
+}
+
+static void ovrCommandBuffer_BindVertexArray(ovrCommandBuffer * commandBuffer, const GLuint vertexArrayObject)
+{
+	unsigned int * p = ovrCommandBuffer_Emit(commandBuffer, COMMAND_BIND_VERTEX_ARRAY, 1);
+	p[0] = vertexArrayObject;
+}
+
+static void ovrCommandBuffer_DrawElementsInstanced(ovrCommandBuffer * commandBuffer, const GLenum mode, const int count, const GLenum type, const int instanceCount)
+{
+	unsigned int * p = ovrCommandBuffer_Emit(commandBuffer, COMMAND_DRAW_ELEMENTS_INSTANCED, 4);
+	p[0] = mode;
+	p[1] = count;
+	p[2] = type;
+	p[3] = instanceCount;
+}
+
+static void ovrCommandBuffer_Execute(const ovrCommandBuffer * commandBuffer, const ovrCommandPatches * patches)
+{
+	const unsigned int * words = commandBuffer->Words;
+	for (int offset = 0; offset < commandBuffer->WordCount; )
+	{
+		const ovrCommandOpcode opcode = (ovrCommandOpcode)(words[offset] & 0xFF);
+		const int payloadWords = (int)(words[offset] >> 8);
+		const unsigned int * p = &words[offset + 1];
+		switch (opcode)
+		{
+			case COMMAND_NOP:						break;
+			case COMMAND_ENABLE:					GL(glEnable(p[0])); break;
+			case COMMAND_DEPTH_MASK:				GL(glDepthMask((GLboolean)p[0])); break;
+			case COMMAND_DEPTH_FUNC:				GL(glDepthFunc(p[0])); break;
+			case COMMAND_USE_PROGRAM:				GL(glUseProgram(p[0])); break;
+			case COMMAND_UNIFORM_MATRIX4:			GL(glUniformMatrix4fv((GLint)p[0], 1, GL_TRUE, (const GLfloat *)&p[1])); break;
+			case COMMAND_UNIFORM_MATRIX4_PATCHED:	GL(glUniformMatrix4fv((GLint)p[0], 1, GL_TRUE, (const GLfloat *)patches->Matrices[p[1]].M[0])); break;
+			case COMMAND_BIND_VERTEX_ARRAY:			GL(glBindVertexArray(p[0])); break;
+			case COMMAND_DRAW_ELEMENTS_INSTANCED:	GL(glDrawElementsInstanced(p[0], (GLsizei)p[1], p[2], NULL, (GLsizei)p[3])); break;
+			default:
+			{
+				LOGE("ovrCommandBuffer_Execute: invalid opcode %d at word %d", opcode, offset);
+				return;
+			}
+		}
+		offset += 1 + payloadWords;
+	}
+}
+
+// Logs a human readable listing of the command stream.
+static void ovrCommandBuffer_Log(const ovrCommandBuffer * commandBuffer, const char * name)
+{
+	LOGI("ovrCommandBuffer '%s': %d commands, %d words (%d bytes)", name,
+		commandBuffer->CommandCount, commandBuffer->WordCount, commandBuffer->WordCount * (int)sizeof(unsigned int));
+	const unsigned int * words = commandBuffer->Words;
+	for (int offset = 0; offset < commandBuffer->WordCount; )
+	{
+		const int opcode = words[offset] & 0xFF;
+		const int payloadWords = (int)(words[offset] >> 8);
+		char args[128] = "";
+		int length = 0;
+		for (int i = 0; i < payloadWords && i < 6 && length < (int)sizeof(args) - 16; i++)
+		{
+			length += sprintf(args + length, " 0x%X", words[offset + 1 + i]);
+		}
+		LOGI("    %4d: %-24s%s%s", offset, (opcode < COMMAND_MAX) ? CommandOpcodeNames[opcode] : "INVALID", args, (payloadWords > 6) ? " ..." : "");
+		offset += 1 + payloadWords;
+	}
+}
+
+// Writes the raw command stream to a file so it can be inspected and benchmarked offline.
+// The file is a header of three words (magic, version, word count) followed by the stream.
+static bool ovrCommandBuffer_Save(const ovrCommandBuffer * commandBuffer, const char * fileName)
+{
+	FILE * file = fopen(fileName, "wb");
+	if (file == NULL)
+	{
+		LOGE("ovrCommandBuffer_Save: failed to open %s", fileName);
+		return false;
+	}
+	const unsigned int header[3] = { COMMAND_BUFFER_FILE_MAGIC, COMMAND_BUFFER_FILE_VERSION, (unsigned int)commandBuffer->WordCount };
+	const bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+					fwrite(commandBuffer->Words, sizeof(unsigned int), commandBuffer->WordCount, file) == (size_t)commandBuffer->WordCount;
+	fclose(file);
+	LOGI("ovrCommandBuffer_Save: %s %s", ok ? "wrote" : "failed to write", fileName);
+	return ok;
+}
+
+/*
+================================================================================
+
+ovrScene
+
+================================================================================
+*/
+
+#define NUM_INSTANCES		1500
+// The unit cubes are scattered through a cube shaped field of this size,
+// with at least CUBE_MIN_GAP between any two of them.
+#define CUBE_FIELD_SIZE		(50.0f + sqrt(NUM_INSTANCES))
+#define CUBE_MIN_GAP		2.0f
+// Cubes farther than this from the origin may be rendered into the far field cube map,
+// because the difference between the two eye images drops to a couple of texels there.
+#define FAR_FIELD_DISTANCE	20.0f
+
+/*
+The scene vertex shader comes in permutations selected by a key of feature bits.
+The instance format decides what the per-instance attributes hold:
+
+	MATRIX		a 4x4 transform per instance, rebuilt on the CPU every frame
+	AFFINE		the top 3 rows of the transform, 25% less to build and fetch
+	ANIMATED	the position and rotation rates, written once; the vertex shader
+				rotates the cube by AnimationRotation, so nothing is uploaded per frame
+
+SCENE_SHADER_VIEW_PROJECTION replaces the separate view and projection matrices with
+a single matrix multiplied on the CPU, which saves a matrix multiply per vertex.
+SCENE_SHADER_UNIFORM_BLOCKS reads the uniforms from std140 row-major uniform blocks
+instead of setting them on the program, so the driver never has to transpose them.
+The sources of all known permutations are assembled from string literals at compile
+time, and the programs are linked on demand and kept per key.
+*/
+
+typedef enum
+{
+	SCENE_INSTANCE_FORMAT_MATRIX,
+	SCENE_INSTANCE_FORMAT_AFFINE,
+	SCENE_INSTANCE_FORMAT_ANIMATED
+} ovrSceneInstanceFormat;
+
+#define SCENE_SHADER_INSTANCE_FORMAT_MASK	3
+#define SCENE_SHADER_VIEW_PROJECTION		4
+#define SCENE_SHADER_UNIFORM_BLOCKS			8
+#define SCENE_SHADER_MAX					16
+
+// The cheapest permutation for this scene; the cubes only spin, so they are animated on the GPU.
+#define SCENE_INSTANCE_FORMAT				SCENE_INSTANCE_FORMAT_ANIMATED
+#define SCENE_SHADER_KEY					(SCENE_INSTANCE_FORMAT | SCENE_SHADER_VIEW_PROJECTION | SCENE_SHADER_UNIFORM_BLOCKS)
+
+static const int SceneInstanceVectors[] = { 4, 3, 2 };	// vec4 attributes per instance for each format
+
+typedef struct
+{
+	bool				CreatedScene;
+	bool				CreatedVAOs;
+	bool				ReadyScene;			// the programs are ready to be used
+	double				CreateTime;
+	unsigned int		Random;
+	int					ShaderKey;			// SCENE_SHADER_*
+	ovrProgram			Programs[SCENE_SHADER_MAX];
+	ovrProgramLoader	ProgramLoader;
+	ovrGeometry			Cube;
+	GLuint				InstanceTransformBuffer;
+	// The cubes are sorted on distance, so the near cubes come first, and the far
+	// field vertex array starts at the first cube beyond FAR_FIELD_DISTANCE.
+	int					NearInstanceCount;
+	GLuint				FarFieldVertexArrayObject;
+	ovrVector3f			CubePositions[NUM_INSTANCES];
+	ovrVector3f			CubeRotations[NUM_INSTANCES];
+} ovrScene;
+
+// The SceneView uniform block, one per eye per frame.
+typedef struct
+{
+	ovrMatrix4f			ViewMatrix;
+	ovrMatrix4f			ViewProjectionMatrix;
+	float				AnimationRotation[4];
+} ovrSceneViewUniforms;
+
+// The SceneStatic uniform block, written once.
+typedef struct
+{
+	ovrMatrix4f			ProjectionMatrix;
+} ovrSceneStaticUniforms;
+
+#define SCENE_VERTEX_SHADER_HEADER \
+"#version 300 es\n" \
+"in vec3 vertexPosition;\n" \
+"in vec4 vertexColor;\n" \
+"out vec4 fragmentColor;\n"
+
+#define SCENE_VERTEX_SHADER_UNIFORMS_DEFAULT \
+"uniform mat4 ViewMatrix;\n" \
+"uniform mat4 ProjectionMatrix;\n" \
+"uniform mat4 ViewProjectionMatrix;\n" \
+"uniform vec4 AnimationRotation;\n"
+
+// Matches ovrSceneViewUniforms and ovrSceneStaticUniforms.
+#define SCENE_VERTEX_SHADER_UNIFORMS_BLOCKS \
+"layout( std140, row_major ) uniform SceneView\n" \
+"{\n" \
+"	mat4 ViewMatrix;\n" \
+"	mat4 ViewProjectionMatrix;\n" \
+"	vec4 AnimationRotation;\n" \
+"};\n" \
+"layout( std140, row_major ) uniform SceneStatic\n" \
+"{\n" \
+"	mat4 ProjectionMatrix;\n" \
+"};\n"
+
+#define SCENE_VERTEX_SHADER_INSTANCE_MATRIX \
+"in mat4 vertexTransform;\n" \
+"vec3 instanceTransform( vec3 p )\n" \
+"{\n" \
+"	return ( vertexTransform * vec4( p, 1.0 ) ).xyz;\n" \
+"}\n"
+
+// The columns hold the rows of the transform.
+#define SCENE_VERTEX_SHADER_INSTANCE_AFFINE \
+"in mat3x4 vertexTransform;\n" \
+"vec3 instanceTransform( vec3 p )\n" \
+"{\n" \
+"	return vec4( p, 1.0 ) * vertexTransform;\n" \
+"}\n"
+
+// The first column holds the position and the second the rotation rates.
+// Rotates around X, then Y, then Z, like ovrMatrix4f_CreateRotation.
+#define SCENE_VERTEX_SHADER_INSTANCE_ANIMATED \
+"in mat2x4 vertexTransform;\n" \
+"vec3 instanceTransform( vec3 p )\n" \
+"{\n" \
+"	vec3 angles = vertexTransform[1].xyz * AnimationRotation.xyz;\n" \
+"	vec3 s = sin( angles );\n" \
+"	vec3 c = cos( angles );\n" \
+"	p = vec3( p.x, c.x * p.y - s.x * p.z, s.x * p.y + c.x * p.z );\n" \
+"	p = vec3( c.y * p.x + s.y * p.z, p.y, c.y * p.z - s.y * p.x );\n" \
+"	p = vec3( c.z * p.x - s.z * p.y, s.z * p.x + c.z * p.y, p.z );\n" \
+"	return vertexTransform[0].xyz + p;\n" \
+"}\n"
+
+#define SCENE_VERTEX_SHADER_VIEW_SEPARATE \
+"vec4 viewTransform( vec3 p )\n" \
+"{\n" \
+"	return ProjectionMatrix * ( ViewMatrix * vec4( p, 1.0 ) );\n" \
+"}\n"
+
+#define SCENE_VERTEX_SHADER_VIEW_COMBINED \
+"vec4 viewTransform( vec3 p )\n" \
+"{\n" \
+"	return ViewProjectionMatrix * vec4( p, 1.0 );\n" \
+"}\n"
+
+#define SCENE_VERTEX_SHADER_MAIN \
+"void main()\n" \
+"{\n" \
+"	gl_Position = viewTransform( instanceTransform( vertexPosition ) );\n" \
+"	fragmentColor = vertexColor;\n" \
+"}\n"
+
+#define SCENE_VERTEX_SHADER( uniforms, instance, view ) \
+	SCENE_VERTEX_SHADER_HEADER \
+	SCENE_VERTEX_SHADER_UNIFORMS_##uniforms \
+	SCENE_VERTEX_SHADER_INSTANCE_##instance \
+	SCENE_VERTEX_SHADER_VIEW_##view \
+	SCENE_VERTEX_SHADER_MAIN
+
+// Indexed by the SCENE_SHADER_* key.
+static const char * const SceneVertexShaders[SCENE_SHADER_MAX] =
+{
+	SCENE_VERTEX_SHADER( DEFAULT, MATRIX, SEPARATE ),
+	SCENE_VERTEX_SHADER( DEFAULT, AFFINE, SEPARATE ),
+	SCENE_VERTEX_SHADER( DEFAULT, ANIMATED, SEPARATE ),
+	NULL,
+	SCENE_VERTEX_SHADER( DEFAULT, MATRIX, COMBINED ),
+	SCENE_VERTEX_SHADER( DEFAULT, AFFINE, COMBINED ),
+	SCENE_VERTEX_SHADER( DEFAULT, ANIMATED, COMBINED ),
+	NULL,
+	SCENE_VERTEX_SHADER( BLOCKS, MATRIX, SEPARATE ),
+	SCENE_VERTEX_SHADER( BLOCKS, AFFINE, SEPARATE ),
+	SCENE_VERTEX_SHADER( BLOCKS, ANIMATED, SEPARATE ),
+	NULL,
+	SCENE_VERTEX_SHADER( BLOCKS, MATRIX, COMBINED ),
+	SCENE_VERTEX_SHADER( BLOCKS, AFFINE, COMBINED ),
+	SCENE_VERTEX_SHADER( BLOCKS, ANIMATED, COMBINED ),
+	NULL
+};
+
+static const char FRAGMENT_SHADER[] =
+"#version 300 es\n"
+"in lowp vec4 fragmentColor;\n"
+"out lowp vec4 outColor;\n"
+"void main()\n"
+"{\n"
+"	outColor = fragmentColor;\n"
+"}\n";
+
+static void ovrScene_Clear(ovrScene * scene)
+{
+	scene->CreatedScene = false;
+	scene->CreatedVAOs = false;
+	scene->ReadyScene = false;
+	scene->CreateTime = 0.0;
+	scene->Random = 2;
+	scene->ShaderKey = SCENE_SHADER_KEY;
+	scene->InstanceTransformBuffer = 0;
+	scene->NearInstanceCount = NUM_INSTANCES;
+	scene->FarFieldVertexArrayObject = 0;
+
+	for (int i = 0; i < SCENE_SHADER_MAX; i++)
+	{
+		ovrProgram_Clear(&scene->Programs[i]);
+	}
+	ovrProgramLoader_Clear(&scene->ProgramLoader);
+	ovrGeometry_Clear(&scene->Cube);
+}
+
+static bool ovrScene_IsCreated(ovrScene * scene)
+{
+	return scene->CreatedScene;
+}
+
+static const ovrProgram * ovrScene_GetProgram(const ovrScene * scene)
+{
+	return &scene->Programs[scene->ShaderKey];
+}
+
+static ovrSceneInstanceFormat ovrScene_GetInstanceFormat(const ovrScene * scene)
+{
+	return (ovrSceneInstanceFormat)(scene->ShaderKey & SCENE_SHADER_INSTANCE_FORMAT_MASK);
+}
+
+// Returns true once the scene programs finished compiling. Never blocks.
+static bool ovrScene_IsReady(ovrScene * scene, ovrProgramCache * programCache)
+{
+	if (scene->ReadyScene)
+	{
+		return true;
+	}
+	if (scene->ProgramLoader.Started)
+	{
+		if (!ovrProgramLoader_IsDone(&scene->ProgramLoader))
+		{
+			return false;
+		}
+		ovrProgramLoader_Join(&scene->ProgramLoader);
+	}
+	else if (!ovrProgram_Poll(&scene->Programs[scene->ShaderKey], programCache))
+	{
+		return false;
+	}
+	scene->ReadyScene = true;
+	LOGI("Scene ready after %1.2f ms", (vrapi_GetTimeInSeconds() - scene->CreateTime) * 1000.0);
+	ovrProgramCache_LogStats(programCache);
+	return true;
+}
+
+// Returns how many of the instances, which are sorted by distance, are within the distance of the origin.
+static int ovrScene_CountInstancesWithin(const ovrScene * scene, const float distance)
+{
+	int count = 0;
+	while (count < NUM_INSTANCES)
+	{
+		const ovrVector3f * position = &scene->CubePositions[count];
+		if (position->x * position->x + position->y * position->y + position->z * position->z > distance * distance)
+		{
+			break;
+		}
+		count++;
+	}
+	return count;
+}
+
+// Modifies the VAO to use the instance transform attributes, starting at the given instance.
+static void ovrScene_SetInstanceAttribs(const ovrScene * scene, const GLuint vertexArrayObject, const int firstInstance)
+{
+	const int vectors = SceneInstanceVectors[ovrScene_GetInstanceFormat(scene)];
+	const size_t instanceSize = vectors * 4 * sizeof(float);
+	GL(glBindVertexArray(vertexArrayObject));
+	GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
+	for (int i = 0; i < vectors; i++)
+	{
+		GL(glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i));
+		GL(glVertexAttribPointer(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i, 4, GL_FLOAT,
+			false, instanceSize, (void *)(firstInstance * instanceSize + i * 4 * sizeof(float))));
+		GL(glVertexAttribDivisor(VERTEX_ATTRIBUTE_LOCATION_TRANSFORM + i, 1));
+	}
+	GL(glBindVertexArray(0));
+}
+
+static void ovrScene_CreateVAOs(ovrScene * scene)
+{
+	if (!scene->CreatedVAOs)
+	{
+		ovrGeometry_CreateVAO(&scene->Cube);
+		ovrScene_SetInstanceAttribs(scene, scene->Cube.VertexArrayObject, 0);
+
+		// GLES 3.0 has no base instance, so the far cubes get a vertex array of their own.
+		ovrGeometry farFieldCube = scene->Cube;
+		ovrGeometry_CreateVAO(&farFieldCube);
+		scene->FarFieldVertexArrayObject = farFieldCube.VertexArrayObject;
+		ovrScene_SetInstanceAttribs(scene, scene->FarFieldVertexArrayObject, scene->NearInstanceCount);
+
+		scene->CreatedVAOs = true;
+	}
+}
+
+static void ovrScene_DestroyVAOs(ovrScene * scene)
+{
+	if (scene->CreatedVAOs)
+	{
+		ovrGeometry_DestroyVAO(&scene->Cube);
+		GL(glDeleteVertexArrays(1, &scene->FarFieldVertexArrayObject));
+		scene->FarFieldVertexArrayObject = 0;
+
+		scene->CreatedVAOs = false;
+	}
+}
+
+static float ovrScene_RandomFloat(ovrScene * scene)
+{
+	scene->Random = 1664525L * scene->Random + 1013904223L;
+	const unsigned int rf = 0x3F800000 | (scene->Random & 0x007FFFFF);
+	float f;
+	memcpy(&f, &rf, sizeof(f));
+	return f - 1.0f;
+}
+
+// Only starts compiling the programs, see ovrScene_IsReady.
+static void ovrScene_Create(ovrScene * scene, ovrProgramCache * programCache, const ovrEgl * egl)
+{
+	PROFILE_ZONE("ovrScene_Create");
+
+	scene->CreateTime = vrapi_GetTimeInSeconds();
+
+	// Without parallel compilation the driver would block the main thread, so compile on a loader thread instead.
+	ovrProgram * program = &scene->Programs[scene->ShaderKey];
+	const char * vertexShader = SceneVertexShaders[scene->ShaderKey];
+	if (GlExtensionAvailable("GL_KHR_parallel_shader_compile"))
+	{
+		ovrProgram_Begin(program, programCache, vertexShader, FRAGMENT_SHADER);
+	}
+	else
+	{
+		ovrProgramLoader_Add(&scene->ProgramLoader, program, vertexShader, FRAGMENT_SHADER);
+		ovrProgramLoader_Start(&scene->ProgramLoader, egl, programCache);
+		if (!scene->ProgramLoader.Started)
+		{
+			ovrProgram_Create(program, programCache, vertexShader, FRAGMENT_SHADER);
+		}
+	}
+
+	ovrGeometry_CreateCube(&scene->Cube);
+
+	// Setup random cube positions and rotations.
+	for (int i = 0; i < NUM_INSTANCES; i++)
+	{
+		// Using volatile keeps the compiler from optimizing away multiple calls to drand48().
+		volatile float rx, ry, rz;
 		for (;;)
 		{
-			rx = (ovrScene_RandomFloat(scene) - 0.5f) * (50.0f + sqrt(NUM_INSTANCES));
-			ry = (ovrScene_RandomFloat(scene) - 0.5f) * (50.0f + sqrt(NUM_INSTANCES));
-			rz = (ovrScene_RandomFloat(scene) - 0.5f) * (50.0f + sqrt(NUM_INSTANCES));
-			// If too close to 0,0,0
-			if (fabsf(rx) < 4.0f && fabsf(ry) < 4.0f && fabsf(rz) < 4.0f)
+			rx = (ovrScene_RandomFloat(scene) - 0.5f) * CUBE_FIELD_SIZE;
+			ry = (ovrScene_RandomFloat(scene) - 0.5f) * CUBE_FIELD_SIZE;
+			rz = (ovrScene_RandomFloat(scene) - 0.5f) * CUBE_FIELD_SIZE;
+			// If too close to 0,0,0
+			if (fabsf(rx) < 4.0f && fabsf(ry) < 4.0f && fabsf(rz) < 4.0f)
+			{
+				continue;
+			}
+			// Test for overlap with any of the existing cubes.
+			bool overlap = false;
+			for (int j = 0; j < i; j++)
+			{
+				if (fabsf(rx - scene->CubePositions[j].x) < 4.0f &&
+					fabsf(ry - scene->CubePositions[j].y) < 4.0f &&
+					fabsf(rz - scene->CubePositions[j].z) < 4.0f)
+				{
+					overlap = true;
+					break;
+				}
+			}
+			if (!overlap)
+			{
+				break;
+			}
+		}
+
+		// Insert into list sorted based on distance.
+		int insert = 0;
+		const float distSqr = rx * rx + ry * ry + rz * rz;
+		for (int j = i; j > 0; j--)
+		{
+			const ovrVector3f * otherPos = &scene->CubePositions[j - 1];
+			const float otherDistSqr = otherPos->x * otherPos->x + otherPos->y * otherPos->y + otherPos->z * otherPos->z;
+			if (distSqr > otherDistSqr)
+			{
+				insert = j;
+				break;
+			}
+			scene->CubePositions[j] = scene->CubePositions[j - 1];
+			scene->CubeRotations[j] = scene->CubeRotations[j - 1];
+		}
+
+		scene->CubePositions[insert].x = rx;
+		scene->CubePositions[insert].y = ry;
+		scene->CubePositions[insert].z = rz;
+
+		scene->CubeRotations[insert].x = ovrScene_RandomFloat(scene);
+		scene->CubeRotations[insert].y = ovrScene_RandomFloat(scene);
+		scene->CubeRotations[insert].z = ovrScene_RandomFloat(scene);
+	}
+
+	scene->NearInstanceCount = ovrScene_CountInstancesWithin(scene, FAR_FIELD_DISTANCE);
+
+	// Create the instance transform attribute buffer. Animated instances never change,
+	// the others are rewritten every frame by ovrRenderer_RenderFrame.
+	const ovrSceneInstanceFormat format = ovrScene_GetInstanceFormat(scene);
+	const int instanceSize = SceneInstanceVectors[format] * 4 * sizeof(float);
+	GL(glGenBuffers(1, &scene->InstanceTransformBuffer));
+	GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
+	if (format == SCENE_INSTANCE_FORMAT_ANIMATED)
+	{
+		float * instances = (float *)malloc(NUM_INSTANCES * instanceSize);
+		for (int i = 0; i < NUM_INSTANCES; i++)
+		{
+			float * instance = &instances[i * 8];
+			instance[0] = scene->CubePositions[i].x;
+			instance[1] = scene->CubePositions[i].y;
+			instance[2] = scene->CubePositions[i].z;
+			instance[3] = 1.0f;
+			instance[4] = scene->CubeRotations[i].x;
+			instance[5] = scene->CubeRotations[i].y;
+			instance[6] = scene->CubeRotations[i].z;
+			instance[7] = 0.0f;
+		}
+		GL(glBufferData(GL_ARRAY_BUFFER, NUM_INSTANCES * instanceSize, instances, GL_STATIC_DRAW));
+		free(instances);
+	}
+	else
+	{
+		GL(glBufferData(GL_ARRAY_BUFFER, NUM_INSTANCES * instanceSize, NULL, GL_DYNAMIC_DRAW));
+	}
+	GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+	scene->CreatedScene = true;
+
+#if !MULTI_THREADED
+	ovrScene_CreateVAOs(scene);
+#endif
+}
+
+static void ovrScene_Destroy(ovrScene * scene)
+{
+#if !MULTI_THREADED
+	ovrScene_DestroyVAOs(scene);
+#endif
+
+	ovrProgramLoader_Join(&scene->ProgramLoader);
+	for (int i = 0; i < SCENE_SHADER_MAX; i++)
+	{
+		ovrProgram_Destroy(&scene->Programs[i]);
+	}
+	ovrGeometry_Destroy(&scene->Cube);
+	GL(glDeleteBuffers(1, &scene->InstanceTransformBuffer));
+	scene->CreatedScene = false;
+	scene->ReadyScene = false;
+}
+
+//================================================================================
+//
+// ovrSimulation
+//
+//================================================================================
+
+typedef struct
+{
+	ovrVector3f			CurrentRotation;
+	bool				Paused;
+	double				PauseTime;
+	double				PausedSeconds;		// time spent paused, so the cubes continue where they stopped
+} ovrSimulation;
+
+static void ovrSimulation_Clear(ovrSimulation * simulation)
+{
+	simulation->CurrentRotation.x = 0.0f;
+	simulation->CurrentRotation.y = 0.0f;
+	simulation->CurrentRotation.z = 0.0f;
+	simulation->Paused = false;
+	simulation->PauseTime = 0.0;
+	simulation->PausedSeconds = 0.0;
+}
+
+static void ovrSimulation_TogglePause(ovrSimulation * simulation)
+{
+	const double time = vrapi_GetTimeInSeconds();
+	if (simulation->Paused)
+	{
+		simulation->PausedSeconds += time - simulation->PauseTime;
+	}
+	else
+	{
+		simulation->PauseTime = time;
+	}
+	simulation->Paused = !simulation->Paused;
+}
+
+static void ovrSimulation_Advance(ovrSimulation * simulation, double predictedDisplayTime)
+{
+	if (simulation->Paused)
+	{
+		return;
+	}
+
+	// Update rotation.
+	simulation->CurrentRotation.x = (float)(predictedDisplayTime - simulation->PausedSeconds);
+	simulation->CurrentRotation.y = (float)(predictedDisplayTime - simulation->PausedSeconds);
+	simulation->CurrentRotation.z = (float)(predictedDisplayTime - simulation->PausedSeconds);
+}
+
+//================================================================================
+//
+// ovrGpuTimer
+//
+//================================================================================
+
+/*
+Measures how long the GPU takes to render a frame. With GL_EXT_disjoint_timer_query
+the frame is wrapped in a GL_TIME_ELAPSED_EXT query. The results arrive a few frames
+late, so a ring of queries is used to never stall on the GPU.
+
+Without the extension there is no GPU time. A fence is inserted at the end of the
+frame instead, and checked without waiting right after every vrapi_SubmitFrame().
+The time from the end of the frame to the first check that sees the fence signaled
+is an upper bound of the completion latency: it includes the queueing behind earlier
+work and the wait for the vsync in vrapi_SubmitFrame(), so it is only reported, and
+never fed to the controllers that act on the GPU time.
+*/
+
+#define LOCAL_PREF_GPU_TIMER		"dev_gpuTimer"		// "auto" (default), or "fence" to ignore the timer query extension
+
+#define GPU_TIMER_FRAMES	4
+// Longer measurements are discarded. Some drivers report garbage for the first query,
+// and frames that span a pause say nothing about the rendering cost.
+#define GPU_TIMER_MAX_FRAME_TIME	0.5f
+
+typedef struct
+{
+	bool		UseTimerQueries;
+	GLuint		Queries[GPU_TIMER_FRAMES];
+	GLsync		Fences[GPU_TIMER_FRAMES];
+	double		EndTimes[GPU_TIMER_FRAMES];
+	bool		Pending[GPU_TIMER_FRAMES];
+	bool		Active;
+	int			FrameIndex;
+	float		GpuTime;			// Most recently measured GPU frame time in seconds, zero until known, and always without timer queries.
+	int			MeasuredFrames;		// Frames GpuTime was measured for, to tell when it is updated.
+	float		CompletionLatency;	// Upper bound of the completion latency of the most recent frame seen by a fence, in seconds.
+} ovrGpuTimer;
+
+static void ovrGpuTimer_Clear(ovrGpuTimer * timer)
+{
+	timer->UseTimerQueries = false;
+	for (int i = 0; i < GPU_TIMER_FRAMES; i++)
+	{
+		timer->Queries[i] = 0;
+		timer->Fences[i] = 0;
+		timer->EndTimes[i] = 0.0;
+		timer->Pending[i] = false;
+	}
+	timer->Active = false;
+	timer->FrameIndex = 0;
+	timer->GpuTime = 0.0f;
+	timer->MeasuredFrames = 0;
+	timer->CompletionLatency = 0.0f;
+}
+
+static void ovrGpuTimer_Create(ovrGpuTimer * timer)
+{
+	timer->UseTimerQueries = GlExtensionAvailable("GL_EXT_disjoint_timer_query") &&
+		strcasecmp(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_GPU_TIMER, "auto"), "fence") != 0;
+	if (timer->UseTimerQueries)
+	{
+		GL(glGenQueries(GPU_TIMER_FRAMES, timer->Queries));
+	}
+	LOGI("GPU timer: %s", timer->UseTimerQueries ? "GL_EXT_disjoint_timer_query" : "fence completion");
+}
+
+static void ovrGpuTimer_Destroy(ovrGpuTimer * timer)
+{
+	if (timer->UseTimerQueries)
+	{
+		GL(glDeleteQueries(GPU_TIMER_FRAMES, timer->Queries));
+	}
+	for (int i = 0; i < GPU_TIMER_FRAMES; i++)
+	{
+		if (timer->Fences[i] != 0)
+		{
+			GL(glDeleteSync(timer->Fences[i]));
+		}
+	}
+	ovrGpuTimer_Clear(timer);
+}
+
+// Picks up the timer query results of earlier frames that completed, oldest first, without waiting.
+static void ovrGpuTimer_Poll(ovrGpuTimer * timer)
+{
+	if (!timer->UseTimerQueries)
+	{
+		return;
+	}
+
+	// Timings are meaningless if the GPU changed clocks or was interrupted.
+	GLint disjoint = 0;
+	GL(glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint));
+
+	for (int i = 1; i <= GPU_TIMER_FRAMES; i++)
+	{
+		const int slot = (timer->FrameIndex + i) % GPU_TIMER_FRAMES;
+		if (!timer->Pending[slot])
+		{
+			continue;
+		}
+		GLuint available = GL_FALSE;
+		GL(glGetQueryObjectuiv(timer->Queries[slot], GL_QUERY_RESULT_AVAILABLE, &available));
+		if (!available)
+		{
+			break;
+		}
+		GLuint elapsedNanoseconds = 0;
+		GL(glGetQueryObjectuiv(timer->Queries[slot], GL_QUERY_RESULT, &elapsedNanoseconds));
+		timer->Pending[slot] = false;
+		if (!disjoint && elapsedNanoseconds * 1e-9f < GPU_TIMER_MAX_FRAME_TIME)
+		{
+			timer->GpuTime = elapsedNanoseconds * 1e-9f;
+			timer->MeasuredFrames++;
+		}
+	}
+}
+
+// Call right after vrapi_SubmitFrame(). Checks the fences of earlier frames, oldest first, without waiting.
+static void ovrGpuTimer_PollFences(ovrGpuTimer * timer)
+{
+	if (timer->UseTimerQueries)
+	{
+		return;
+	}
+	const double now = vrapi_GetTimeInSeconds();
+	for (int i = 1; i <= GPU_TIMER_FRAMES; i++)
+	{
+		const int slot = (timer->FrameIndex + i) % GPU_TIMER_FRAMES;
+		if (!timer->Pending[slot])
+		{
+			continue;
+		}
+		GL(const GLenum status = glClientWaitSync(timer->Fences[slot], 0, 0));
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			break;
+		}
+		GL(glDeleteSync(timer->Fences[slot]));
+		timer->Fences[slot] = 0;
+		timer->Pending[slot] = false;
+		timer->CompletionLatency = (float)(now - timer->EndTimes[slot]);
+	}
+}
+
+// Call before the first GPU command of the frame, after ovrGpuTimer_Poll().
+static void ovrGpuTimer_BeginFrame(ovrGpuTimer * timer)
+{
+	// Skip the measurement if the GPU is so far behind that the slot is still in flight.
+	const int slot = timer->FrameIndex % GPU_TIMER_FRAMES;
+	timer->Active = !timer->Pending[slot];
+	if (!timer->Active)
+	{
+		return;
+	}
+	if (timer->UseTimerQueries)
+	{
+		GL(glBeginQuery(GL_TIME_ELAPSED_EXT, timer->Queries[slot]));
+	}
+}
+
+// Call after the last GPU command of the frame.
+static void ovrGpuTimer_EndFrame(ovrGpuTimer * timer)
+{
+	const int slot = timer->FrameIndex % GPU_TIMER_FRAMES;
+	if (timer->Active)
+	{
+		if (timer->UseTimerQueries)
+		{
+			GL(glEndQuery(GL_TIME_ELAPSED_EXT));
+		}
+		else
+		{
+			GL(timer->Fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+			timer->EndTimes[slot] = vrapi_GetTimeInSeconds();
+		}
+		timer->Pending[slot] = true;
+		timer->Active = false;
+	}
+	timer->FrameIndex++;
+}
+
+//================================================================================
+//
+// ovrDynamicResolution
+//
+//================================================================================
+
+/*
+Scales the eye buffer viewport based on the measured GPU frame time. The eye textures
+are allocated once at the largest resolution, and only the viewport, the tan angle
+matrix and the texture rectangle handed to time warp change, so nothing is ever
+reallocated. The scale drops as soon as the GPU time gets close to the frame budget,
+before frames are actually missed, and only recovers after a sustained period of
+headroom. After every change the controller waits until the GPU timer reports frames
+that were rendered at the new scale.
+*/
+
+#define DYNAMIC_RESOLUTION_MIN_SCALE		0.5f
+#define DYNAMIC_RESOLUTION_MAX_SCALE		1.0f
+#define DYNAMIC_RESOLUTION_STEP_UP			0.05f
+#define DYNAMIC_RESOLUTION_HIGH_WATER		0.85f	// fraction of the frame budget above which the scale drops
+#define DYNAMIC_RESOLUTION_LOW_WATER		0.65f	// fraction of the frame budget below which there is headroom
+#define DYNAMIC_RESOLUTION_TARGET			0.75f	// fraction of the frame budget aimed for when dropping
+#define DYNAMIC_RESOLUTION_HEADROOM_FRAMES	30
+
+typedef struct
+{
+	bool	Enabled;
+	float	Scale;
+	int		HeadroomFrames;		// consecutive frames with headroom
+	int		SettleFrames;		// frames to ignore after a change
+} ovrDynamicResolution;
+
+static void ovrDynamicResolution_Clear(ovrDynamicResolution * resolution)
+{
+	resolution->Enabled = true;
+	resolution->Scale = DYNAMIC_RESOLUTION_MAX_SCALE;
+	resolution->HeadroomFrames = 0;
+	resolution->SettleFrames = 0;
+}
+
+// Returns true if the scale changed.
+static bool ovrDynamicResolution_Update(ovrDynamicResolution * resolution, const float gpuTime, const float frameBudget)
+{
+	if (!resolution->Enabled || gpuTime <= 0.0f || frameBudget <= 0.0f)
+	{
+		return false;
+	}
+	if (resolution->SettleFrames > 0)
+	{
+		resolution->SettleFrames--;
+		return false;
+	}
+
+	const float previousScale = resolution->Scale;
+	float scale = previousScale;
+	if (gpuTime > frameBudget * DYNAMIC_RESOLUTION_HIGH_WATER)
+	{
+		// The GPU time is roughly proportional to the number of pixels, which is the square of the scale.
+		scale *= sqrtf(frameBudget * DYNAMIC_RESOLUTION_TARGET / gpuTime);
+		resolution->HeadroomFrames = 0;
+	}
+	else if (gpuTime < frameBudget * DYNAMIC_RESOLUTION_LOW_WATER)
+	{
+		if (++resolution->HeadroomFrames >= DYNAMIC_RESOLUTION_HEADROOM_FRAMES)
+		{
+			scale += DYNAMIC_RESOLUTION_STEP_UP;
+			resolution->HeadroomFrames = 0;
+		}
+	}
+	else
+	{
+		resolution->HeadroomFrames = 0;
+	}
+
+	scale = (scale < DYNAMIC_RESOLUTION_MIN_SCALE) ? DYNAMIC_RESOLUTION_MIN_SCALE : ((scale > DYNAMIC_RESOLUTION_MAX_SCALE) ? DYNAMIC_RESOLUTION_MAX_SCALE : scale);
+	if (scale == previousScale)
+	{
+		return false;
+	}
+	resolution->Scale = scale;
+	resolution->SettleFrames = GPU_TIMER_FRAMES;
+	return true;
+}
+
+//================================================================================
+//
+// ovrFrameRateController
+//
+//================================================================================
+
+/*
+Picks the MinimumVsyncs, in other words synthesizes eye images at 60, 30 or 20 Hz on a
+60 Hz display, while time warp fills in the display refreshes in between. Dropping the
+rate is the last resort: the GPU only counts as overloaded when its measured time is
+over budget while dynamic resolution is already at its lowest scale, while a CPU frame
+time over budget or missed vsyncs count right away, because lowering the resolution
+does not help those. The rate only goes back up after a sustained period in which the
+CPU and the full resolution GPU work both fit well within the shorter frame budget, so
+it does not oscillate between two rates. Without a measured GPU time, as with the fence
+fallback of ovrGpuTimer, only the CPU time and the display interval are used.
+*/
+
+#define FRAME_RATE_MAX_VSYNCS			3		// 20 Hz on a 60 Hz display
+#define FRAME_RATE_HIGH_WATER			0.9f	// fraction of the frame budget above which a frame is overloaded
+#define FRAME_RATE_DROP_FRAMES			30		// overloaded frames within FRAME_RATE_DROP_WINDOW before the rate drops
+#define FRAME_RATE_DROP_WINDOW			60
+#define FRAME_RATE_RAISE_HEADROOM		0.6f	// fraction of the shorter frame budget the work must fit in to raise the rate
+#define FRAME_RATE_RAISE_FRAMES			300		// consecutive frames with headroom before the rate goes up
+#define FRAME_RATE_SETTLE_FRAMES		(GPU_TIMER_FRAMES + 2)
+
+typedef struct
+{
+	bool	Enabled;
+	int		MinimumVsyncs;
+	int		OverloadedFrames;	// overloaded frames in the current window
+	int		WindowFrames;
+	int		HeadroomFrames;		// consecutive frames with headroom for a higher rate
+	int		SettleFrames;		// frames to ignore after a change
+} ovrFrameRateController;
+
+static void ovrFrameRateController_Clear(ovrFrameRateController * controller)
+{
+	controller->Enabled = true;
+	controller->MinimumVsyncs = 1;
+	controller->OverloadedFrames = 0;
+	controller->WindowFrames = 0;
+	controller->HeadroomFrames = 0;
+	controller->SettleFrames = 0;
+}
+
+static void ovrFrameRateController_SetMinimumVsyncs(ovrFrameRateController * controller, const int minimumVsyncs,
+	const float refreshRate, const char * reason, const float value, const float budget)
+{
+	LOGI("Frame rate: %1.0f Hz -> %1.0f Hz, %s %1.2f ms of %1.2f ms", refreshRate / controller->MinimumVsyncs,
+		refreshRate / minimumVsyncs, reason, value * 1000.0f, budget * 1000.0f);
+	controller->MinimumVsyncs = minimumVsyncs;
+	controller->OverloadedFrames = 0;
+	controller->WindowFrames = 0;
+	controller->HeadroomFrames = 0;
+	controller->SettleFrames = FRAME_RATE_SETTLE_FRAMES;
+}
+
+// The display interval is the difference between the predicted display times of this frame
+// and the previous frame. The GPU time is ignored unless gpuMeasured. Returns true if
+// MinimumVsyncs changed.
+static bool ovrFrameRateController_Update(ovrFrameRateController * controller, const float cpuTime, const bool gpuMeasured,
+	const float gpuTime, const float resolutionScale, const float displayInterval, const float refreshRate)
+{
+	if (!controller->Enabled || refreshRate <= 0.0f)
+	{
+		return false;
+	}
+	if (controller->SettleFrames > 0)
+	{
+		controller->SettleFrames--;
+		return false;
+	}
+
+	const float vsync = 1.0f / refreshRate;
+	const float budget = controller->MinimumVsyncs * vsync;
+	const bool gpuKnown = gpuMeasured && gpuTime > 0.0f;
+	const bool gpuOverloaded = gpuKnown && gpuTime > budget * FRAME_RATE_HIGH_WATER;
+	const bool gpuAtMinimum = resolutionScale <= DYNAMIC_RESOLUTION_MIN_SCALE;
+
+	// Find the worst metric of this frame.
+	const char * reason = NULL;
+	float value = 0.0f;
+	float limit = 0.0f;
+	if (displayInterval > budget + 0.5f * vsync)
+	{
+		reason = "missed vsync, display interval";
+		value = displayInterval;
+		limit = budget;
+	}
+	else if (cpuTime > budget * FRAME_RATE_HIGH_WATER)
+	{
+		reason = "CPU";
+		value = cpuTime;
+		limit = budget;
+	}
+	else if (gpuOverloaded && gpuAtMinimum)
+	{
+		reason = "GPU at the lowest resolution";
+		value = gpuTime;
+		limit = budget;
+	}
+
+	if (reason != NULL)
+	{
+		controller->OverloadedFrames++;
+		controller->HeadroomFrames = 0;
+		if (controller->OverloadedFrames >= FRAME_RATE_DROP_FRAMES && controller->MinimumVsyncs < FRAME_RATE_MAX_VSYNCS)
+		{
+			ovrFrameRateController_SetMinimumVsyncs(controller, controller->MinimumVsyncs + 1, refreshRate, reason, value, limit);
+			return true;
+		}
+	}
+	else if (controller->MinimumVsyncs > 1)
+	{
+		// The GPU time at full resolution is roughly the measured time over the square of the scale.
+		const float fasterBudget = (controller->MinimumVsyncs - 1) * vsync;
+		const float fullGpuTime = gpuKnown ? gpuTime / (resolutionScale * resolutionScale) : 0.0f;
+		if (cpuTime < fasterBudget * FRAME_RATE_RAISE_HEADROOM && fullGpuTime < fasterBudget * FRAME_RATE_RAISE_HEADROOM)
+		{
+			if (++controller->HeadroomFrames >= FRAME_RATE_RAISE_FRAMES)
+			{
+				const bool gpuBound = fullGpuTime > cpuTime;
+				ovrFrameRateController_SetMinimumVsyncs(controller, controller->MinimumVsyncs - 1, refreshRate,
+					gpuBound ? "headroom, full resolution GPU" : "headroom, CPU", gpuBound ? fullGpuTime : cpuTime, fasterBudget);
+				return true;
+			}
+		}
+		else
+		{
+			controller->HeadroomFrames = 0;
+		}
+	}
+
+	// Only a sustained overload within a window counts, not the occasional hitch.
+	if (++controller->WindowFrames >= FRAME_RATE_DROP_WINDOW)
+	{
+		controller->OverloadedFrames = 0;
+		controller->WindowFrames = 0;
+	}
+	return false;
+}
+
+//================================================================================
+//
+// ovrOverlayPanel
+//
+//================================================================================
+
+/*
+A panel of UI, like a HUD or a menu, that is rendered into its own swap chain and
+composited by time warp as the overlay layer on top of the eye buffers. Time warp
+reprojects the panel every vsync, so a new image is only rendered when the content
+changes, instead of drawing the UI into both eye buffers every frame. The application
+summarizes the content in a key, and the panel is only redrawn when the key changes.
+A panel is either fixed to the view, or placed in the world and seen in stereo.
+Time warp composites a single overlay plane, so one panel is shown at a time.
+*/
+
+typedef struct
+{
+	ovrFramebuffer	FrameBuffer;
+	ovrRenderPass	RenderPass;
+	bool			FixedToView;
+	// Transforms the -1 to 1 unit square to view space when fixed to the view, otherwise to world space.
+	ovrMatrix4f		Transform;
+	unsigned int	ContentKey;
+	bool			HasContent;
+	int				DisplayIndex;	// swap chain image with the latest content
+	int				RenderCount;
+} ovrOverlayPanel;
+
+static void ovrOverlayPanel_Clear(ovrOverlayPanel * panel)
+{
+	ovrFramebuffer_Clear(&panel->FrameBuffer);
+	ovrRenderPass_Clear(&panel->RenderPass);
+	panel->FixedToView = false;
+	panel->Transform = ovrMatrix4f_CreateIdentity();
+	panel->ContentKey = 0;
+	panel->HasContent = false;
+	panel->DisplayIndex = 0;
+	panel->RenderCount = 0;
+}
+
+static bool ovrOverlayPanel_Create(ovrOverlayPanel * panel, const int width, const int height,
+	const bool fixedToView, const ovrMatrix4f * transform)
+{
+	// The panel is only updated now and then, so it is not worth multisampling or depth.
+	if (!ovrFramebuffer_Create(&panel->FrameBuffer, VRAPI_TEXTURE_FORMAT_8888, width, height, 1, GL_NONE, NULL))
+	{
+		ovrFramebuffer_Destroy(&panel->FrameBuffer);
+		return false;
+	}
+
+	// Everything outside the drawn rectangles stays transparent, including the border.
+	ovrRenderPass * renderPass = &panel->RenderPass;
+	renderPass->ColorLoadOp = RENDER_PASS_LOAD_CLEAR;
+	renderPass->ColorStoreOp = RENDER_PASS_STORE_STORE;
+	renderPass->DepthLoadOp = RENDER_PASS_LOAD_DONT_CARE;
+	renderPass->DepthStoreOp = RENDER_PASS_STORE_DONT_CARE;
+	renderPass->ClearColor[0] = 0.0f;
+	renderPass->ClearColor[1] = 0.0f;
+	renderPass->ClearColor[2] = 0.0f;
+	renderPass->ClearColor[3] = 0.0f;
+	renderPass->ClearBorder = false;
+
+	panel->FixedToView = fixedToView;
+	panel->Transform = *transform;
+	panel->HasContent = false;
+	return true;
+}
+
+static void ovrOverlayPanel_Destroy(ovrOverlayPanel * panel)
+{
+	if (panel->FrameBuffer.Width != 0)
+	{
+		LOGI("Overlay panel: rendered %d times", panel->RenderCount);
+		ovrFramebuffer_Destroy(&panel->FrameBuffer);
+	}
+	ovrOverlayPanel_Clear(panel);
+}
+
+// Returns true and starts rendering into the next swap chain image if the content changed.
+// The image time warp is showing, or may still be showing, is never rendered into.
+static bool ovrOverlayPanel_BeginUpdate(ovrOverlayPanel * panel, const unsigned int contentKey)
+{
+	if (panel->FrameBuffer.Width == 0 || (panel->HasContent && contentKey == panel->ContentKey))
+	{
+		return false;
+	}
+	panel->ContentKey = contentKey;
+	panel->FrameBuffer.TextureSwapChainIndex = (panel->DisplayIndex + 1) % panel->FrameBuffer.TextureSwapChainLength;
+	ovrRenderPass_Begin(&panel->RenderPass, &panel->FrameBuffer);
+	return true;
+}
+
+// Fills a rectangle in panel texels, with the origin in the upper left corner
+// because time warp maps the top of the texture to the top of the unit square.
+static void ovrOverlayPanel_FillRect(ovrOverlayPanel * panel, const int x, const int y, const int width, const int height,
+	const float r, const float g, const float b, const float a)
+{
+	GL(glScissor(x, panel->FrameBuffer.Height - y - height, width, height));
+	GL(glClearColor(r, g, b, a));
+	GL(glClear(GL_COLOR_BUFFER_BIT));
+}
+
+static void ovrOverlayPanel_EndUpdate(ovrOverlayPanel * panel)
+{
+	ovrRenderPass_End(&panel->RenderPass, &panel->FrameBuffer);
+	panel->DisplayIndex = panel->FrameBuffer.TextureSwapChainIndex;
+	panel->HasContent = true;
+	panel->RenderCount++;
+}
+
+// Sets up the overlay layer of the frame to show the panel, if it has any content yet.
+static void ovrOverlayPanel_Submit(const ovrOverlayPanel * panel, ovrFrameParms * parms,
+	const ovrMatrix4f * eyeViewMatrix, const ovrTracking * eyeTracking)
+{
+	if (!panel->HasContent)
+	{
+		return;
+	}
+
+	ovrFrameLayer * layer = &parms->Layers[VRAPI_FRAME_LAYER_TYPE_OVERLAY];
+	layer->FixedToView = panel->FixedToView;
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		const ovrMatrix4f modelView = panel->FixedToView ? panel->Transform : ovrMatrix4f_Multiply(&eyeViewMatrix[eye], &panel->Transform);
+		layer->Textures[eye].ColorTextureSwapChain = panel->FrameBuffer.ColorTextureSwapChain;
+		layer->Textures[eye].TextureSwapChainIndex = panel->DisplayIndex;
+		layer->Textures[eye].TexCoordsFromTanAngles = ovrMatrix4f_TanAngleMatrixFromUnitSquare(&modelView);
+		layer->Textures[eye].HeadPose = eyeTracking[eye].HeadPose;
+	}
+	parms->LayerCount = VRAPI_FRAME_LAYER_TYPE_OVERLAY + 1;
+	parms->WarpProgram = VRAPI_FRAME_PROGRAM_OVERLAY_PLANE;
+}
+
+//================================================================================
+//
+// ovrFarField
+//
+//================================================================================
+
+/*
+The cubes beyond FAR_FIELD_DISTANCE barely differ between the eyes, and barely move as
+the head turns, so instead of rendering them into both eye buffers every frame they are
+rendered into a cube map around the viewer every FAR_FIELD_REFRESH_FRAMES frames. To keep
+the cost of a refresh from landing on a single frame, one face is rendered per frame into the
+next swap chain image, which is only shown once all six faces are written. Only the first
+fill, when there is nothing to show yet, renders all faces at once. Time warp shows the cube map through the transparent parts of the eye buffers with the masked cube
+program, and reprojects it for the latest head orientation every vsync, while only the near
+cubes are rendered into the eye buffers. The cube map takes the overlay layer, so there is
+no room for an overlay panel at the same time. In the comparison mode the far field is
+switched on and off every FAR_FIELD_COMPARE_FRAMES frames, and the GPU time and battery
+current of both ways of rendering are logged.
+*/
+
+#define FAR_FIELD_CUBE_MAP_SIZE			512		// about half the texel density of the eye buffers
+#define FAR_FIELD_REFRESH_FRAMES		10		// the far cubes animate at 6 Hz on a 60 Hz display, at least 6 for one face per frame
+#define FAR_FIELD_NEAR_Z				(FAR_FIELD_DISTANCE - 2.0f)
+#define FAR_FIELD_COMPARE_FRAMES		600
+#define FAR_FIELD_SETTLE_FRAMES			(GPU_TIMER_FRAMES + 2)
+#define FAR_FIELD_BATTERY_FRAMES		60		// reading the battery current is a system call, so it is sampled
+#define BATTERY_CURRENT_FILE			"/sys/class/power_supply/battery/current_now"
+
+typedef struct
+{
+	bool			Enabled;		// the far cubes go to the cube map instead of the eye buffers
+	bool			Compare;		// alternate with full rendering
+	ovrFramebuffer	FrameBuffer;
+	ovrRenderPass	RenderPass;
+	bool			HasContent;
+	int				DisplayIndex;	// swap chain image with the latest content
+	int				UpdateIndex;	// swap chain image the faces are rendered into
+	int				NextFace;		// next face to render, 0 when no refresh is in progress
+	int				Frames;			// frames since the last refresh started
+	// The comparison, indexed by Enabled.
+	int				CompareFrames;	// frames in the current mode
+	double			GpuTime[2];
+	double			ResolutionScale[2];
+	int				GpuSamples[2];
+	double			BatteryCurrent[2];
+	int				BatterySamples[2];
+} ovrFarField;
+
+// The rows of the view matrix of each cube map face, in the GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order.
+// Every face looks down its axis with -Y (or +Z and -Z for the Y faces) up, which makes the window
+// coordinates match the cube map texture coordinates without any flipping.
+static const float CubeFaceViewRows[6][3][3] =
+{
+	{ {  0.0f,  0.0f, -1.0f }, { 0.0f, -1.0f,  0.0f }, { -1.0f,  0.0f,  0.0f } },
+	{ {  0.0f,  0.0f,  1.0f }, { 0.0f, -1.0f,  0.0f }, {  1.0f,  0.0f,  0.0f } },
+	{ {  1.0f,  0.0f,  0.0f }, { 0.0f,  0.0f,  1.0f }, {  0.0f, -1.0f,  0.0f } },
+	{ {  1.0f,  0.0f,  0.0f }, { 0.0f,  0.0f, -1.0f }, {  0.0f,  1.0f,  0.0f } },
+	{ {  1.0f,  0.0f,  0.0f }, { 0.0f, -1.0f,  0.0f }, {  0.0f,  0.0f, -1.0f } },
+	{ { -1.0f,  0.0f,  0.0f }, { 0.0f, -1.0f,  0.0f }, {  0.0f,  0.0f,  1.0f } }
+};
+
+static ovrMatrix4f CubeFaceViewMatrix(const int face)
+{
+	ovrMatrix4f viewMatrix = ovrMatrix4f_CreateIdentity();
+	for (int row = 0; row < 3; row++)
+	{
+		for (int column = 0; column < 3; column++)
+		{
+			viewMatrix.M[row][column] = CubeFaceViewRows[face][row][column];
+		}
+	}
+	return viewMatrix;
+}
+
+// Returns the battery current in mA, or a negative value if the kernel does not report it.
+static float ReadBatteryCurrent()
+{
+	FILE * file = fopen(BATTERY_CURRENT_FILE, "rb");
+	if (file == NULL)
+	{
+		return -1.0f;
+	}
+	long microAmps = 0;
+	const int count = fscanf(file, "%ld", &microAmps);
+	fclose(file);
+	return (count == 1) ? fabsf(microAmps / 1000.0f) : -1.0f;
+}
+
+static void ovrFarField_Clear(ovrFarField * farField)
+{
+	farField->Enabled = false;
+	farField->Compare = false;
+	ovrFramebuffer_Clear(&farField->FrameBuffer);
+	ovrRenderPass_Clear(&farField->RenderPass);
+	farField->HasContent = false;
+	farField->DisplayIndex = 0;
+	farField->UpdateIndex = 0;
+	farField->NextFace = 0;
+	farField->Frames = 0;
+	farField->CompareFrames = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		farField->GpuTime[i] = 0.0;
+		farField->ResolutionScale[i] = 0.0;
+		farField->GpuSamples[i] = 0;
+		farField->BatteryCurrent[i] = 0.0;
+		farField->BatterySamples[i] = 0;
+	}
+}
+
+// The cube map is cleared to the clear color of the eye buffers, which is what shows between the far cubes.
+static bool ovrFarField_Create(ovrFarField * farField, const bool compare, const float clearColor[4])
+{
+	if (!ovrFramebuffer_CreateCubeMap(&farField->FrameBuffer, VRAPI_TEXTURE_FORMAT_8888, FAR_FIELD_CUBE_MAP_SIZE, GL_DEPTH_COMPONENT24))
+	{
+		ovrFramebuffer_Destroy(&farField->FrameBuffer);
+		return false;
+	}
+
+	ovrRenderPass * renderPass = &farField->RenderPass;
+	renderPass->ColorLoadOp = RENDER_PASS_LOAD_CLEAR;
+	renderPass->ColorStoreOp = RENDER_PASS_STORE_STORE;
+	renderPass->DepthLoadOp = RENDER_PASS_LOAD_CLEAR;
+	renderPass->DepthStoreOp = RENDER_PASS_STORE_DONT_CARE;
+	for (int i = 0; i < 4; i++)
+	{
+		renderPass->ClearColor[i] = clearColor[i];
+	}
+	renderPass->ClearBorder = false;
+
+	farField->Enabled = true;
+	farField->Compare = compare;
+	farField->HasContent = false;
+	farField->NextFace = 0;
+	farField->Frames = 0;
+	return true;
+}
+
+static void ovrFarField_Destroy(ovrFarField * farField)
+{
+	if (farField->FrameBuffer.Width != 0)
+	{
+		ovrFramebuffer_Destroy(&farField->FrameBuffer);
+	}
+	ovrFarField_Clear(farField);
+}
+
+// Returns the number of faces to render this frame, starting at NextFace.
+static int ovrFarField_GetUpdateFaces(ovrFarField * farField)
+{
+	if (!farField->Enabled)
+	{
+		return 0;
+	}
+	if (!farField->HasContent)
+	{
+		return 6 - farField->NextFace;
+	}
+	if (farField->NextFace > 0 || ++farField->Frames >= FAR_FIELD_REFRESH_FRAMES)
+	{
+		return 1;
+	}
+	return 0;
+}
+
+// A refresh renders into the next swap chain image, which time warp is not showing.
+static void ovrFarField_BeginUpdate(ovrFarField * farField)
+{
+	if (farField->NextFace == 0)
+	{
+		farField->UpdateIndex = (farField->DisplayIndex + 1) % farField->FrameBuffer.TextureSwapChainLength;
+		farField->Frames = 0;
+	}
+	farField->FrameBuffer.TextureSwapChainIndex = farField->UpdateIndex;
+}
+
+static void ovrFarField_BeginFace(ovrFarField * farField, const int face)
+{
+	farField->FrameBuffer.Face = face;
+	ovrRenderPass_Begin(&farField->RenderPass, &farField->FrameBuffer);
+}
+
+static void ovrFarField_EndFace(ovrFarField * farField)
+{
+	ovrRenderPass_End(&farField->RenderPass, &farField->FrameBuffer);
+}
+
+// Shows the refreshed image once all six faces are written.
+static void ovrFarField_EndUpdate(ovrFarField * farField, const int faces)
+{
+	farField->NextFace += faces;
+	if (farField->NextFace >= 6)
+	{
+		farField->DisplayIndex = farField->UpdateIndex;
+		farField->HasContent = true;
+		farField->NextFace = 0;
+	}
+}
+
+// Sets up the overlay layer of the frame to show the cube map through the transparent parts of the eye buffers.
+static void ovrFarField_Submit(const ovrFarField * farField, ovrFrameParms * parms,
+	const ovrMatrix4f * eyeViewMatrix, const ovrTracking * eyeTracking)
+{
+	if (!farField->Enabled || !farField->HasContent)
+	{
+		return;
+	}
+
+	ovrFrameLayer * layer = &parms->Layers[VRAPI_FRAME_LAYER_TYPE_OVERLAY];
+	layer->FixedToView = false;
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		// The cube map is centered on the viewer, so only the rotation turns view vectors into cube map vectors.
+		ovrMatrix4f rotation = eyeViewMatrix[eye];
+		rotation.M[0][3] = 0.0f;
+		rotation.M[1][3] = 0.0f;
+		rotation.M[2][3] = 0.0f;
+		layer->Textures[eye].ColorTextureSwapChain = farField->FrameBuffer.ColorTextureSwapChain;
+		layer->Textures[eye].TextureSwapChainIndex = farField->DisplayIndex;
+		layer->Textures[eye].TexCoordsFromTanAngles = ovrMatrix4f_Transpose(&rotation);
+		layer->Textures[eye].HeadPose = eyeTracking[eye].HeadPose;
+	}
+	parms->LayerCount = VRAPI_FRAME_LAYER_TYPE_OVERLAY + 1;
+	parms->WarpProgram = VRAPI_FRAME_PROGRAM_MASKED_CUBE;
+}
+
+// Accumulates the frame for the comparison with full rendering. Returns true if the far
+// field was switched on or off.
+static bool ovrFarField_UpdateComparison(ovrFarField * farField, const float gpuTime, const float resolutionScale)
+{
+	if (!farField->Compare)
+	{
+		return false;
+	}
+
+	// Skip the frames the GPU timer still reports from before the switch.
+	const int mode = farField->Enabled ? 1 : 0;
+	if (++farField->CompareFrames > FAR_FIELD_SETTLE_FRAMES && gpuTime > 0.0f)
+	{
+		farField->GpuTime[mode] += gpuTime;
+		farField->ResolutionScale[mode] += resolutionScale;
+		farField->GpuSamples[mode]++;
+	}
+	if (farField->CompareFrames % FAR_FIELD_BATTERY_FRAMES == 0)
+	{
+		const float current = ReadBatteryCurrent();
+		if (current >= 0.0f)
+		{
+			farField->BatteryCurrent[mode] += current;
+			farField->BatterySamples[mode]++;
+		}
+	}
+	if (farField->CompareFrames < FAR_FIELD_COMPARE_FRAMES)
+	{
+		return false;
+	}
+
+	// Report after every pair of windows.
+	if (farField->Enabled && farField->GpuSamples[0] > 0 && farField->GpuSamples[1] > 0)
+	{
+		double averageCurrent[2];
+		for (int i = 0; i < 2; i++)
+		{
+			averageCurrent[i] = (farField->BatterySamples[i] > 0) ? farField->BatteryCurrent[i] / farField->BatterySamples[i] : 0.0;
+		}
+		LOGI("Far field: cube map %1.2f ms GPU at scale %1.2f, %1.0f mA; full rendering %1.2f ms GPU at scale %1.2f, %1.0f mA",
+			farField->GpuTime[1] * 1000.0 / farField->GpuSamples[1], farField->ResolutionScale[1] / farField->GpuSamples[1], averageCurrent[1],
+			farField->GpuTime[0] * 1000.0 / farField->GpuSamples[0], farField->ResolutionScale[0] / farField->GpuSamples[0], averageCurrent[0]);
+		for (int i = 0; i < 2; i++)
+		{
+			farField->GpuTime[i] = 0.0;
+			farField->ResolutionScale[i] = 0.0;
+			farField->GpuSamples[i] = 0;
+			farField->BatteryCurrent[i] = 0.0;
+			farField->BatterySamples[i] = 0;
+		}
+	}
+
+	farField->Enabled = !farField->Enabled;
+	farField->HasContent = false;
+	farField->NextFace = 0;
+	farField->CompareFrames = 0;
+	return true;
+}
+
+//================================================================================
+//
+// ovrRenderer
+//
+//================================================================================
+
+#define NUM_MULTI_SAMPLES	4
+
+// The eyes are rendered one after the other and never keep depth, so they can share one depth buffer.
+#define SHARE_STEREO_DEPTH	true
+#define EYE_NEAR_Z			1.0f
+
+// Eye buffer settings that can be changed at runtime through the local preferences, for instance:
+// adb shell "echo dev_eyeColorFormat 565 dev_eyeMultisamples 2 > /sdcard/.oculusprefs"
+// The same key / value tokens in EYE_BUFFER_CONFIG_FILE are applied while the app is running,
+// so different configurations can be compared in a single session.
+#define LOCAL_PREF_EYE_COLOR_FORMAT			"dev_eyeColorFormat"		// "565", "5551", "4444", "8888" (default), "8888_sRGB" or "RGBA16F"
+#define LOCAL_PREF_EYE_MULTISAMPLES			"dev_eyeMultisamples"		// "auto" (default), "1", "2" or "4"
+#define LOCAL_PREF_EYE_DEPTH_FORMAT			"dev_eyeDepthFormat"		// "auto" (default), "16" or "24"
+#define LOCAL_PREF_EYE_RESOLUTION_SCALE		"dev_eyeResolutionScale"	// relative to the suggested resolution, default "1.0"
+
+#define EYE_BUFFER_CONFIG_FILE				"/sdcard/vrsample_eyebuffers.txt"
+#define EYE_BUFFER_CONFIG_POLL_SECONDS		1.0
+
+// Time warp may still sample the replaced eye buffers, so they are destroyed this many frames later.
+#define RETIRED_FRAME_BUFFER_FRAMES			4
+
+// A performance HUD on the overlay layer, with bars for the GPU time, the resolution scale,
+// the frame rate and the MSAA samples. It is only redrawn when one of the bars changes.
+#define LOCAL_PREF_PERFORMANCE_HUD			"dev_performanceHud"		// "off" (default), "view" or "world"
+#define HUD_WIDTH							256
+#define HUD_HEIGHT							64
+#define HUD_GPU_TIME_STEPS					20		// the GPU time bar moves in 5% steps of the frame budget
+#define HUD_GPU_TIME_FRAMES					10		// and only every this many frames, because the GPU time is noisy
+
+// Renders the cubes beyond FAR_FIELD_DISTANCE into a cube map layer at a low rate, see ovrFarField,
+// or the cubes without visible disparity once for both eyes, see ovrRenderer_UpdateMonoFarField.
+#define LOCAL_PREF_FAR_FIELD				"dev_farField"				// "off" (default), "cube", "mono", or "compare" to alternate "cube" with full rendering
+#define MONO_FAR_FIELD_MAX_DISPARITY		1.0f	// texels between the center eye and either eye image beyond the split
+
+// Resubmit the last eye buffers while neither the scene nor the simulation changed, and the
+// head moved so little that time warp can correct it.
+#define LOCAL_PREF_EYE_BUFFER_REUSE			"dev_eyeBufferReuse"		// "on" (default) or "off"
+#define EYE_BUFFER_REUSE_MAX_DEGREES		0.25f	// rotation time warp corrects, pulling in a little black at the edges
+#define EYE_BUFFER_REUSE_MAX_METERS			0.0005f	// translation time warp does not correct
+
+// Widen the field of view of the eye buffers while the head turns fast, see ovrRenderer_UpdateOverscan.
+#define LOCAL_PREF_OVERSCAN					"dev_overscan"				// "off" (default) or "on"
+#define OVERSCAN_STEP_DEGREES				1.0f	// the projection changes in steps, because that invalidates the eye buffers
+#define OVERSCAN_MAX_STEPS					8		// at most this many steps on each side of the suggested field of view
+#define OVERSCAN_RELEASE_FRAMES				30		// frames between the steps back once the head slows down
+
+// Beam racing. The VrApi owns the front buffer, so all the application does is ask for the
+// sliced time warp, which warps each slice with a pose predicted for its own scanout. The
+// eye buffers are rendered as before. The slices start dev_slicePreScheduleSeconds ahead of
+// their scanout. host/scanout_sim models that schedule: with the VrApi default of 14 ms the
+// slices have more latency than a full frame warp, so the pre-schedule should be lowered.
+#define LOCAL_PREF_BEAM_RACING				"dev_beamRacing"			// "off" (default) or "on"
+#define BEAM_RACING_MAX_PRE_SCHEDULE_SECONDS	0.008	// keeps the slices well below the latency of a full frame warp in scanout_sim
+
+// The view uniform blocks of the far field cube map faces, or of the center eye, follow those of the eyes.
+#define SCENE_VIEW_BLOCK_FAR_FIELD			VRAPI_FRAME_LAYER_EYE_MAX
+
+typedef struct
+{
+	ovrTextureFormat	ColorFormat;
+	int					Multisamples;		// 0 lets the MSAA policy pick and adapt the sample count
+	GLenum				DepthFormat;		// GL_NONE picks the smallest format with enough precision
+	float				ResolutionScale;
+} ovrEyeBufferConfig;
+
+typedef struct
+{
+	ovrTextureFormat	Format;
+	const char *		Name;
+} ovrColorFormatName;
+
+static const ovrColorFormatName EyeColorFormatNames[] =
+{
+	{ VRAPI_TEXTURE_FORMAT_565,			"565" },
+	{ VRAPI_TEXTURE_FORMAT_5551,		"5551" },
+	{ VRAPI_TEXTURE_FORMAT_4444,		"4444" },
+	{ VRAPI_TEXTURE_FORMAT_8888,		"8888" },
+	{ VRAPI_TEXTURE_FORMAT_8888_sRGB,	"8888_sRGB" },
+	{ VRAPI_TEXTURE_FORMAT_RGBA16F,		"RGBA16F" }
+};
+
+static const char * EyeColorFormatName(const ovrTextureFormat format)
+{
+	for (int i = 0; i < (int)(sizeof(EyeColorFormatNames) / sizeof(EyeColorFormatNames[0])); i++)
+	{
+		if (EyeColorFormatNames[i].Format == format)
+		{
+			return EyeColorFormatNames[i].Name;
+		}
+	}
+	return "unknown";
+}
+
+static void ovrEyeBufferConfig_Default(ovrEyeBufferConfig * config)
+{
+	config->ColorFormat = VRAPI_TEXTURE_FORMAT_8888;
+	config->Multisamples = 0;
+	config->DepthFormat = GL_NONE;
+	config->ResolutionScale = 1.0f;
+}
+
+// Applies a single key / value pair. Returns false if the key is unknown or the value is invalid.
+static bool ovrEyeBufferConfig_Set(ovrEyeBufferConfig * config, const char * key, const char * value)
+{
+	if (strcasecmp(key, LOCAL_PREF_EYE_COLOR_FORMAT) == 0)
+	{
+		for (int i = 0; i < (int)(sizeof(EyeColorFormatNames) / sizeof(EyeColorFormatNames[0])); i++)
+		{
+			if (strcasecmp(value, EyeColorFormatNames[i].Name) == 0)
+			{
+				config->ColorFormat = EyeColorFormatNames[i].Format;
+				return true;
+			}
+		}
+	}
+	else if (strcasecmp(key, LOCAL_PREF_EYE_MULTISAMPLES) == 0)
+	{
+		const int multisamples = (strcasecmp(value, "auto") == 0) ? 0 : atoi(value);
+		if (multisamples == 0 || multisamples == 1 || multisamples == 2 || multisamples == 4)
+		{
+			config->Multisamples = multisamples;
+			return true;
+		}
+	}
+	else if (strcasecmp(key, LOCAL_PREF_EYE_DEPTH_FORMAT) == 0)
+	{
+		if (strcasecmp(value, "auto") == 0 || strcmp(value, "16") == 0 || strcmp(value, "24") == 0)
+		{
+			config->DepthFormat = (strcmp(value, "16") == 0) ? GL_DEPTH_COMPONENT16 :
+									((strcmp(value, "24") == 0) ? GL_DEPTH_COMPONENT24 : GL_NONE);
+			return true;
+		}
+	}
+	else if (strcasecmp(key, LOCAL_PREF_EYE_RESOLUTION_SCALE) == 0)
+	{
+		const float scale = (float)atof(value);
+		if (scale >= 0.25f && scale <= 2.0f)
+		{
+			config->ResolutionScale = scale;
+			return true;
+		}
+	}
+	else
+	{
+		LOGW("Unknown eye buffer setting %s", key);
+		return false;
+	}
+	LOGW("Invalid value %s for eye buffer setting %s", value, key);
+	return false;
+}
+
+static void ovrEyeBufferConfig_LoadLocalPrefs(ovrEyeBufferConfig * config)
+{
+	static const char * keys[] =
+	{
+		LOCAL_PREF_EYE_COLOR_FORMAT,
+		LOCAL_PREF_EYE_MULTISAMPLES,
+		LOCAL_PREF_EYE_DEPTH_FORMAT,
+		LOCAL_PREF_EYE_RESOLUTION_SCALE
+	};
+	for (int i = 0; i < (int)(sizeof(keys) / sizeof(keys[0])); i++)
+	{
+		const char * value = ovr_GetLocalPreferenceValueForKey(keys[i], "");
+		if (value[0] != '\0')
+		{
+			ovrEyeBufferConfig_Set(config, keys[i], value);
+		}
+	}
+}
+
+// Reads whitespace separated key / value tokens, just like the local preferences file.
+static bool ovrEyeBufferConfig_LoadFile(ovrEyeBufferConfig * config, const char * fileName)
+{
+	FILE * file = fopen(fileName, "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	char key[128];
+	char value[128];
+	while (fscanf(file, "%127s %127s", key, value) == 2)
+	{
+		ovrEyeBufferConfig_Set(config, key, value);
+	}
+	fclose(file);
+	return true;
+}
+
+static bool ovrEyeBufferConfig_Equals(const ovrEyeBufferConfig * a, const ovrEyeBufferConfig * b)
+{
+	return a->ColorFormat == b->ColorFormat &&
+			a->Multisamples == b->Multisamples &&
+			a->DepthFormat == b->DepthFormat &&
+			a->ResolutionScale == b->ResolutionScale;
+}
+
+// MSAA with GL_EXT_multisampled_render_to_texture resolves in tile memory, so it mostly costs
+// fill rate. The sample count is the lowest of NUM_MULTI_SAMPLES, a default for the GPU type,
+// and the highest count the device supports at full speed. Unless the sample count is configured
+// explicitly, it is stepped down when even the lowest dynamic resolution scale misses the
+// frame budget, and stepped back up after a long stretch of headroom at full resolution.
+#define MSAA_STEP_DOWN_FRAMES		10		// consecutive frames over budget at the lowest resolution scale
+#define MSAA_STEP_UP_FRAMES			300		// consecutive frames with headroom at the highest resolution scale
+#define MSAA_STEP_UP_HEADROOM		0.5f	// fraction of the frame budget below which there is room for more samples
+
+typedef struct
+{
+	bool	Supported;			// GL_EXT_multisampled_render_to_texture is available
+	int		MinSamples;			// lowest sample count used
+	int		MaxSamples;			// highest sample count used
+	int		Samples;			// current sample count
+	int		OverBudgetFrames;
+	int		HeadroomFrames;
+} ovrMsaaPolicy;
+
+static void ovrMsaaPolicy_Clear(ovrMsaaPolicy * policy)
+{
+	policy->Supported = false;
+	policy->MinSamples = 1;
+	policy->MaxSamples = 1;
+	policy->Samples = 1;
+	policy->OverBudgetFrames = 0;
+	policy->HeadroomFrames = 0;
+}
+
+static int GpuTypeDefaultSamples(const int gpuType)
+{
+	switch (gpuType & 0xF000)
+	{
+		case VRAPI_GPU_TYPE_ADRENO:		return (gpuType == VRAPI_GPU_TYPE_ADRENO_330) ? 2 : 4;
+		case VRAPI_GPU_TYPE_MALI:		return 4;
+		default:						return 2;
+	}
+}
+
+static void ovrMsaaPolicy_Create(ovrMsaaPolicy * policy, const ovrJava * java)
+{
+	policy->Supported = GlExtensionAvailable("GL_EXT_multisampled_render_to_texture");
+
+	const int gpuType = ovr_GetSystemProperty(java, VRAPI_SYS_PROP_GPU_TYPE);
+	const int fullSpeedSamples = ovr_GetSystemProperty(java, VRAPI_SYS_PROP_MAX_FULLSPEED_FRAMEBUFFER_SAMPLES);
+	const int gpuSamples = GpuTypeDefaultSamples(gpuType);
+
+	int samples = NUM_MULTI_SAMPLES;
+	samples = (gpuSamples < samples) ? gpuSamples : samples;
+	samples = (fullSpeedSamples > 0 && fullSpeedSamples < samples) ? fullSpeedSamples : samples;
+	samples = policy->Supported ? samples : 1;
+
+	policy->MinSamples = 1;
+	policy->MaxSamples = samples;
+	policy->Samples = samples;
+	policy->OverBudgetFrames = 0;
+	policy->HeadroomFrames = 0;
+
+	if (!policy->Supported)
+	{
+		LOGW("GL_EXT_multisampled_render_to_texture is not available, rendering without MSAA");
+	}
+	LOGI("MSAA: %dx (GPU type 0x%04X default %dx, full speed %dx)", samples, gpuType, gpuSamples, fullSpeedSamples);
+}
+
+// Returns true if the sample count changed.
+static bool ovrMsaaPolicy_Update(ovrMsaaPolicy * policy, const float resolutionScale, const float gpuTime, const float frameBudget)
+{
+	if (gpuTime <= 0.0f || frameBudget <= 0.0f)
+	{
+		return false;
+	}
+
+	policy->OverBudgetFrames = (resolutionScale <= DYNAMIC_RESOLUTION_MIN_SCALE &&
+								gpuTime > frameBudget * DYNAMIC_RESOLUTION_HIGH_WATER) ? policy->OverBudgetFrames + 1 : 0;
+	policy->HeadroomFrames = (resolutionScale >= DYNAMIC_RESOLUTION_MAX_SCALE &&
+								gpuTime < frameBudget * MSAA_STEP_UP_HEADROOM) ? policy->HeadroomFrames + 1 : 0;
+
+	int samples = policy->Samples;
+	if (policy->OverBudgetFrames >= MSAA_STEP_DOWN_FRAMES && samples > policy->MinSamples)
+	{
+		samples /= 2;
+	}
+	else if (policy->HeadroomFrames >= MSAA_STEP_UP_FRAMES && samples < policy->MaxSamples)
+	{
+		samples *= 2;
+	}
+	if (samples == policy->Samples)
+	{
+		return false;
+	}
+	policy->Samples = samples;
+	policy->OverBudgetFrames = 0;
+	policy->HeadroomFrames = 0;
+	return true;
+}
+
+// Log and save the recorded eye pass whenever it is (re-)recorded.
+#define DUMP_COMMAND_BUFFERS		false
+#define COMMAND_BUFFER_DUMP_FILE	"/sdcard/vrsample_eye_pass.ovrcb"
+
+// Frames over which the CPU time of the eye passes is averaged before it is logged.
+#define EYE_PASS_STATS_FRAMES		300
+
+// The stages of a frame on the CPU, as reported by the benchmark.
+typedef enum
+{
+	FRAME_STAGE_UPDATE,				// resolution, overscan and HUD
+	FRAME_STAGE_RECORD,				// splitting off the far cubes and recording the draws, nothing is culled
+	FRAME_STAGE_INSTANCE_UPLOAD,	// writing the instance transforms
+	FRAME_STAGE_EYE_RENDER,			// the view uniforms, the far field and the eye passes
+	FRAME_STAGE_SUBMIT,				// vrapi_SubmitFrame(), which blocks until time warp takes the frame
+	FRAME_STAGE_FRAME,				// everything from the return of the previous vrapi_SubmitFrame()
+	FRAME_STAGE_MAX
+} ovrFrameStage;
+
+static const char * FrameStageNames[FRAME_STAGE_MAX] =
+{
+	"update",
+	"record",
+	"instance_upload",
+	"eye_render",
+	"submit",
+	"frame"
+};
+
+typedef struct
+{
+	float	CpuTime[FRAME_STAGE_MAX];	// seconds
+	int		EyeInstanceCount;			// instances drawn in each eye pass
+	bool	ReusedEyeBuffers;
+} ovrFrameStats;
+
+// Fixed foveated rendering. The lenses blur the periphery of the eye images, so the
+// whole field of view is first rendered at a reduced resolution, then upsampled into
+// the eye buffer, after which only the center region is rendered at full resolution.
+// The eye buffer keeps its layout, so TexCoordsTanAnglesMatrix does not change.
+typedef enum
+{
+	FOVEATION_LEVEL_OFF,
+	FOVEATION_LEVEL_LOW,
+	FOVEATION_LEVEL_MEDIUM,
+	FOVEATION_LEVEL_HIGH,
+	FOVEATION_LEVEL_MAX
+} ovrFoveationLevel;
+
+typedef struct
+{
+	const char *	Name;
+	float			CenterFraction;		// Fraction of the eye width and height rendered at full resolution.
+	float			PeripheryScale;		// Resolution scale of the periphery.
+} ovrFoveationParms;
+
+static const ovrFoveationParms FoveationParms[FOVEATION_LEVEL_MAX] =
+{
+	{ "off",	1.0f,	1.0f },
+	{ "low",	0.6f,	0.6f },
+	{ "medium",	0.5f,	0.5f },
+	{ "high",	0.4f,	0.35f }
+};
+
+// Draws a single triangle that covers the viewport and samples the TexCoordScale part of Texture0.
+static const char BLIT_VERTEX_SHADER[] =
+"#version 300 es\n"
+"out vec2 fragmentUv;\n"
+"void main()\n"
+"{\n"
+"	fragmentUv = vec2( float( ( gl_VertexID & 1 ) << 1 ), float( gl_VertexID & 2 ) );\n"
+"	gl_Position = vec4( fragmentUv * 2.0 - 1.0, 0.0, 1.0 );\n"
+"}\n";
+
+static const char BLIT_FRAGMENT_SHADER[] =
+"#version 300 es\n"
+"uniform sampler2D Texture0;\n"
+"uniform highp vec4 TexCoordScale;\n"
+"in highp vec2 fragmentUv;\n"
+"out lowp vec4 outColor;\n"
+"void main()\n"
+"{\n"
+"	outColor = texture( Texture0, fragmentUv * TexCoordScale.xy );\n"
+"}\n";
+
+// Outputs opaque black at the near plane.
+static const char HIDDEN_AREA_VERTEX_SHADER[] =
+"#version 300 es\n"
+"in vec2 vertexPosition;\n"
+"void main()\n"
+"{\n"
+"	gl_Position = vec4( vertexPosition, -1.0, 1.0 );\n"
+"}\n";
+
+static const char HIDDEN_AREA_FRAGMENT_SHADER[] =
+"#version 300 es\n"
+"out lowp vec4 outColor;\n"
+"void main()\n"
+"{\n"
+"	outColor = vec4( 0.0, 0.0, 0.0, 1.0 );\n"
+"}\n";
+
+typedef struct
+{
+	ovrFramebuffer		FrameBuffer[VRAPI_FRAME_LAYER_EYE_MAX];
+	ovrEyeBufferConfig	Config;
+	ovrMsaaPolicy		MsaaPolicy;
+	int					SuggestedEyeWidth;
+	int					SuggestedEyeHeight;
+	ovrFramebuffer		RetiredFrameBuffer[VRAPI_FRAME_LAYER_EYE_MAX];
+	int					RetiredFrames;		// frames until the retired frame buffers are destroyed
+	GLenum				DepthFormat;
+	float				DisplayRefreshRate;
+	ovrGpuTimer			GpuTimer;
+	ovrDynamicResolution	DynamicResolution;
+	float				FovDegreesX;		// suggested field of view, without the overscan
+	float				FovDegreesY;
+	bool				Overscan;
+	int					OverscanStepsX;		// margin on each side of the suggested field of view
+	int					OverscanStepsY;
+	int					OverscanFrames;		// frames since the margin last changed
+	double				OverscanDegrees;	// sum of the horizontal margins since the last report
+	ovrMatrix4f			ProjectionMatrix;
+	ovrMatrix4f			TexCoordsTanAnglesMatrix;
+	ovrRenderPass		EyeRenderPass;
+	ovrFoveationLevel	FoveationLevel;
+	ovrFramebuffer		PeripheryFrameBuffer[VRAPI_FRAME_LAYER_EYE_MAX];
+	ovrRenderPass		PeripheryRenderPass;
+	ovrProgram			BlitProgram;
+	float				HiddenAreaTanAngle;		// visible radius of the lens, 0 without a hidden area mask
+	ovrProgram			HiddenAreaProgram;
+	ovrProgramCache *	ProgramCache;
+	ovrUniformRing		SceneViewUniforms;
+	GLuint				SceneStaticUniforms;
+	double				EyePassSeconds;		// CPU time spent on the eye passes since the last report
+	int					EyePassFrames;
+	double				PredictionSeconds;	// how far ahead the poses were predicted since the last report
+	double				LatchedPredictionSeconds;
+	ovrCommandBuffer	EyeCommands;
+	// The scene objects the eye commands were recorded with.
+	GLuint				EyeCommandsProgram;
+	GLuint				EyeCommandsVertexArray;
+	int					EyeCommandsInstanceCount;
+	ovrFarField			FarField;
+	ovrMatrix4f			FarFieldProjectionMatrix;
+	GLuint				FarFieldStaticUniforms;
+	ovrCommandBuffer	FarFieldCommands;
+	GLuint				FarFieldCommandsProgram;
+	GLuint				FarFieldCommandsVertexArray;
+	bool				MonoFarField;
+	ovrFramebuffer		MonoFarFieldFrameBuffer;
+	GLuint				MonoFarFieldVertexArray;	// the cube with the instances from MonoFarFieldFirstInstance on
+	int					MonoFarFieldFirstInstance;
+	int					MonoFarFieldViewportWidth;	// eye viewport width the split was chosen for
+	double				MonoFarFieldSavedFraction;	// fraction of the cube draws saved since the last report
+	ovrOverlayPanel		HudPanel;
+	int					HudGpuSteps;
+	int					HudFrames;
+	bool				ReuseEyeBuffers;
+	bool				EyeBuffersDirty;	// set by anything that changes how the eye buffers are rendered
+	ovrFrameLayer		EyeBuffersLayer;	// the world layer of the eye buffers rendered last
+	ovrVector3f			EyeBuffersRotation;	// and the simulation state they show
+	int					ReusedFrames;		// frames the eye buffers were reused since the last report
+	bool				BeamRacing;
+	ovrFrameStats		FrameStats;			// of the last frame rendered
+} ovrRenderer;
+
+static void ovrRenderer_Clear(ovrRenderer * renderer)
+{
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		ovrFramebuffer_Clear(&renderer->FrameBuffer[eye]);
+	}
+	ovrEyeBufferConfig_Default(&renderer->Config);
+	ovrMsaaPolicy_Clear(&renderer->MsaaPolicy);
+	renderer->SuggestedEyeWidth = 0;
+	renderer->SuggestedEyeHeight = 0;
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		ovrFramebuffer_Clear(&renderer->RetiredFrameBuffer[eye]);
+	}
+	renderer->RetiredFrames = 0;
+	renderer->DepthFormat = GL_DEPTH_COMPONENT24;
+	renderer->DisplayRefreshRate = 60.0f;
+	ovrGpuTimer_Clear(&renderer->GpuTimer);
+	ovrDynamicResolution_Clear(&renderer->DynamicResolution);
+	renderer->ProjectionMatrix = ovrMatrix4f_CreateIdentity();
+	renderer->TexCoordsTanAnglesMatrix = ovrMatrix4f_CreateIdentity();
+	ovrRenderPass_Clear(&renderer->EyeRenderPass);
+	renderer->FoveationLevel = FOVEATION_LEVEL_OFF;
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		ovrFramebuffer_Clear(&renderer->PeripheryFrameBuffer[eye]);
+	}
+	ovrRenderPass_Clear(&renderer->PeripheryRenderPass);
+	ovrProgram_Clear(&renderer->BlitProgram);
+	renderer->FovDegreesX = 0.0f;
+	renderer->FovDegreesY = 0.0f;
+	renderer->Overscan = false;
+	renderer->OverscanStepsX = 0;
+	renderer->OverscanStepsY = 0;
+	renderer->OverscanFrames = 0;
+	renderer->OverscanDegrees = 0.0;
+	renderer->HiddenAreaTanAngle = 0.0f;
+	ovrProgram_Clear(&renderer->HiddenAreaProgram);
+	renderer->ProgramCache = NULL;
+	ovrUniformRing_Clear(&renderer->SceneViewUniforms);
+	renderer->SceneStaticUniforms = 0;
+	renderer->EyePassSeconds = 0.0;
+	renderer->EyePassFrames = 0;
+	renderer->PredictionSeconds = 0.0;
+	renderer->LatchedPredictionSeconds = 0.0;
+	ovrCommandBuffer_Clear(&renderer->EyeCommands);
+	renderer->EyeCommandsProgram = 0;
+	renderer->EyeCommandsVertexArray = 0;
+	renderer->EyeCommandsInstanceCount = 0;
+	ovrFarField_Clear(&renderer->FarField);
+	renderer->FarFieldProjectionMatrix = ovrMatrix4f_CreateIdentity();
+	renderer->FarFieldStaticUniforms = 0;
+	ovrCommandBuffer_Clear(&renderer->FarFieldCommands);
+	renderer->FarFieldCommandsProgram = 0;
+	renderer->FarFieldCommandsVertexArray = 0;
+	renderer->MonoFarField = false;
+	ovrFramebuffer_Clear(&renderer->MonoFarFieldFrameBuffer);
+	renderer->MonoFarFieldVertexArray = 0;
+	renderer->MonoFarFieldFirstInstance = NUM_INSTANCES;
+	renderer->MonoFarFieldViewportWidth = 0;
+	renderer->MonoFarFieldSavedFraction = 0.0;
+	ovrOverlayPanel_Clear(&renderer->HudPanel);
+	renderer->HudGpuSteps = 0;
+	renderer->HudFrames = 0;
+	renderer->ReuseEyeBuffers = false;
+	renderer->EyeBuffersDirty = true;
+	memset(&renderer->EyeBuffersLayer, 0, sizeof(renderer->EyeBuffersLayer));
+	renderer->EyeBuffersRotation.x = 0.0f;
+	renderer->EyeBuffersRotation.y = 0.0f;
+	renderer->EyeBuffersRotation.z = 0.0f;
+	renderer->ReusedFrames = 0;
+	renderer->BeamRacing = false;
+	memset(&renderer->FrameStats, 0, sizeof(renderer->FrameStats));
+}
+
+static void ovrRenderer_SetFoveationLevel(ovrRenderer * renderer, const ovrFoveationLevel level);
+static void ovrRenderer_CreateMonoFarFieldFrameBuffer(ovrRenderer * renderer);
+
+// Creates the eye frame buffers from the current configuration.
+static bool ovrRenderer_CreateFrameBuffers(ovrRenderer * renderer)
+{
+	const ovrEyeBufferConfig * config = &renderer->Config;
+
+	// Unless configured otherwise, use 16-bit depth if it can still separate the farthest cubes,
+	// including their rotated corners.
+	const float farthestZ = sqrtf(3.0f) * (0.5f * CUBE_FIELD_SIZE + 1.0f);
+	renderer->DepthFormat = (config->DepthFormat != GL_NONE) ? config->DepthFormat : ChooseDepthFormat(EYE_NEAR_Z, farthestZ, CUBE_MIN_GAP);
+
+	// Create the frame buffers at the largest resolution dynamic resolution may use.
+	const int width = (int)(renderer->SuggestedEyeWidth * config->ResolutionScale * DYNAMIC_RESOLUTION_MAX_SCALE);
+	const int height = (int)(renderer->SuggestedEyeHeight * config->ResolutionScale * DYNAMIC_RESOLUTION_MAX_SCALE);
+	const int multisamples = (config->Multisamples != 0) ? config->Multisamples : renderer->MsaaPolicy.Samples;
+	bool created = true;
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		created &= ovrFramebuffer_Create(&renderer->FrameBuffer[eye],
+			config->ColorFormat,
+			width,
+			height,
+			multisamples,
+			renderer->DepthFormat,
+			(SHARE_STEREO_DEPTH && eye > 0) ? &renderer->FrameBuffer[0] : NULL);
+	}
+	if (!created)
+	{
+		return false;
+	}
+	LOGI("Eye buffers: %dx%d %s, %dx MSAA%s", width, height, EyeColorFormatName(config->ColorFormat),
+		renderer->FrameBuffer[0].Multisamples, (config->Multisamples == 0) ? " (auto)" : "");
+
+	// Compare against a 24-bit depth buffer per swap chain image per eye.
+	int depthMemory = 0;
+	int unsharedDepthMemory = 0;
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		const ovrFramebuffer * frameBuffer = &renderer->FrameBuffer[eye];
+		const int samples = (frameBuffer->Multisamples > 1) ? frameBuffer->Multisamples : 1;
+		depthMemory += ovrFramebuffer_GetDepthMemory(frameBuffer);
+		unsharedDepthMemory += frameBuffer->TextureSwapChainLength * frameBuffer->Width * frameBuffer->Height * samples * DepthFormatBytes(GL_DEPTH_COMPONENT24);
+	}
+	LOGI("Eye depth buffers: %d-bit, %1.1f MB instead of %1.1f MB (%1.1f MB saved)",
+		(renderer->DepthFormat == GL_DEPTH_COMPONENT16) ? 16 : 24,
+		depthMemory / (1024.0f * 1024.0f), unsharedDepthMemory / (1024.0f * 1024.0f),
+		(unsharedDepthMemory - depthMemory) / (1024.0f * 1024.0f));
+
+	// The periphery follows the size of the eye buffers.
+	if (renderer->FoveationLevel != FOVEATION_LEVEL_OFF)
+	{
+		ovrRenderer_SetFoveationLevel(renderer, renderer->FoveationLevel);
+	}
+	ovrRenderer_CreateMonoFarFieldFrameBuffer(renderer);
+	renderer->EyeBuffersDirty = true;
+
+	return true;
+}
+
+static void ovrRenderer_DestroyRetiredFrameBuffers(ovrRenderer * renderer)
+{
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		if (renderer->RetiredFrameBuffer[eye].Width != 0)
+		{
+			ovrFramebuffer_Destroy(&renderer->RetiredFrameBuffer[eye]);
+		}
+	}
+	renderer->RetiredFrames = 0;
+}
+
+// There is room for one set of retired eye buffers. Until it is destroyed, time warp may
+// still sample the buffers in it, so the next rebuild has to wait.
+static bool ovrRenderer_CanRebuildFrameBuffers(const ovrRenderer * renderer)
+{
+	return renderer->RetiredFrames == 0;
+}
+
+// Replaces the eye frame buffers between frames without waiting for the GPU. The old eye
+// buffers are kept around until time warp is done with them, and are put back if the new
+// ones can not be created. Only call this when ovrRenderer_CanRebuildFrameBuffers().
+static bool ovrRenderer_RebuildFrameBuffers(ovrRenderer * renderer)
+{
+	if (!ovrRenderer_CanRebuildFrameBuffers(renderer))
+	{
+		LOGW("ovrRenderer_RebuildFrameBuffers: the previous eye buffers are still in use");
+		return false;
+	}
+
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		renderer->RetiredFrameBuffer[eye] = renderer->FrameBuffer[eye];
+		ovrFramebuffer_Clear(&renderer->FrameBuffer[eye]);
+	}
+	renderer->RetiredFrames = RETIRED_FRAME_BUFFER_FRAMES;
+
+	// Ignore the GPU timings of frames rendered with the old eye buffers.
+	renderer->DynamicResolution.SettleFrames = GPU_TIMER_FRAMES;
+
+	if (ovrRenderer_CreateFrameBuffers(renderer))
+	{
+		return true;
+	}
+
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		ovrFramebuffer_Destroy(&renderer->FrameBuffer[eye]);
+		renderer->FrameBuffer[eye] = renderer->RetiredFrameBuffer[eye];
+		ovrFramebuffer_Clear(&renderer->RetiredFrameBuffer[eye]);
+	}
+	renderer->RetiredFrames = 0;
+	renderer->DepthFormat = renderer->FrameBuffer[0].DepthFormat;
+	if (renderer->FoveationLevel != FOVEATION_LEVEL_OFF)
+	{
+		ovrRenderer_SetFoveationLevel(renderer, renderer->FoveationLevel);
+	}
+	ovrRenderer_CreateMonoFarFieldFrameBuffer(renderer);
+	return false;
+}
+
+// Switches to a new eye buffer configuration between frames.
+static void ovrRenderer_Reconfigure(ovrRenderer * renderer, const ovrEyeBufferConfig * config)
+{
+	if (ovrEyeBufferConfig_Equals(&renderer->Config, config))
+	{
+		return;
+	}
+
+	const ovrEyeBufferConfig previousConfig = renderer->Config;
+	renderer->Config = *config;
+	if (!ovrRenderer_RebuildFrameBuffers(renderer))
+	{
+		LOGE("Eye buffer configuration not supported, keeping the previous one");
+		renderer->Config = previousConfig;
+	}
+}
+
+// Sets the projection of the eye buffers from the suggested field of view and the overscan.
+static void ovrRenderer_SetProjection(ovrRenderer * renderer)
+{
+	renderer->ProjectionMatrix = ovrMatrix4f_CreateProjectionFov(
+		renderer->FovDegreesX + 2.0f * OVERSCAN_STEP_DEGREES * renderer->OverscanStepsX,
+		renderer->FovDegreesY + 2.0f * OVERSCAN_STEP_DEGREES * renderer->OverscanStepsY,
+		0.0f, 0.0f, EYE_NEAR_Z, 0.0f);
+	renderer->TexCoordsTanAnglesMatrix = ovrMatrix4f_TanAngleMatrixFromProjection(&renderer->ProjectionMatrix);
+
+	if (renderer->SceneStaticUniforms != 0)
+	{
+		ovrSceneStaticUniforms staticUniforms;
+		staticUniforms.ProjectionMatrix = renderer->ProjectionMatrix;
+		GL(glBindBuffer(GL_UNIFORM_BUFFER, renderer->SceneStaticUniforms));
+		GL(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(staticUniforms), &staticUniforms));
+		GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+	}
+}
+
+static void ovrRenderer_Create(ovrRenderer * renderer, const ovrJava * java, const ovrHmdInfo * hmdInfo,
+	const ovrEyeBufferConfig * config, ovrProgramCache * programCache)
+{
+	ovrMsaaPolicy_Create(&renderer->MsaaPolicy, java);
+
+	renderer->SuggestedEyeWidth = hmdInfo->SuggestedEyeResolutionWidth;
+	renderer->SuggestedEyeHeight = hmdInfo->SuggestedEyeResolutionHeight;
+	renderer->Config = *config;
+	const char * farField = ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_FAR_FIELD, "off");
+	renderer->MonoFarField = (strcasecmp(farField, "mono") == 0);
+	ovrRenderer_CreateFrameBuffers(renderer);
+
+	renderer->DisplayRefreshRate = hmdInfo->DisplayRefreshRate;
+	ovrGpuTimer_Create(&renderer->GpuTimer);
+
+	// Setup the projection matrix.
+	renderer->FovDegreesX = hmdInfo->SuggestedEyeFovDegreesX;
+	renderer->FovDegreesY = hmdInfo->SuggestedEyeFovDegreesY;
+	renderer->Overscan = (strcasecmp(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_OVERSCAN, "off"), "on") == 0);
+	ovrRenderer_SetProjection(renderer);
+
+	const int deviceType = ovr_GetSystemProperty(java, VRAPI_SYS_PROP_DEVICE_TYPE);
+	const char * hiddenAreaTanAngle = ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_HIDDEN_AREA_TAN_ANGLE, "");
+	renderer->HiddenAreaTanAngle = (hiddenAreaTanAngle[0] != '\0') ? (float)atof(hiddenAreaTanAngle) : DeviceTypeVisibleTanAngle(deviceType);
+	if (renderer->HiddenAreaTanAngle <= 0.0f)
+	{
+		LOGI("Hidden area mask: off on device type %d", deviceType);
+	}
+
+	// The eye pass clears color and depth, discards depth, and resolves color with a black border.
+	ovrRenderPass * eyeRenderPass = &renderer->EyeRenderPass;
+	eyeRenderPass->ColorLoadOp = RENDER_PASS_LOAD_CLEAR;
+	eyeRenderPass->ColorStoreOp = RENDER_PASS_STORE_RESOLVE;
+	eyeRenderPass->DepthLoadOp = RENDER_PASS_LOAD_CLEAR;
+	eyeRenderPass->DepthStoreOp = RENDER_PASS_STORE_DONT_CARE;
+	eyeRenderPass->ClearColor[0] = 0.125f;
+	eyeRenderPass->ClearColor[1] = 0.0f;
+	eyeRenderPass->ClearColor[2] = 0.125f;
+	eyeRenderPass->ClearColor[3] = 1.0f;
+	eyeRenderPass->ClearDepth = 1.0f;
+	eyeRenderPass->ClearBorder = true;
+
+	// The periphery is sampled right after it is rendered, so only color is stored.
+	ovrRenderPass * peripheryRenderPass = &renderer->PeripheryRenderPass;
+	*peripheryRenderPass = *eyeRenderPass;
+	peripheryRenderPass->ColorStoreOp = RENDER_PASS_STORE_STORE;
+	peripheryRenderPass->ClearBorder = false;
+
+	// These are finished in ovrRenderer_RenderFrame, and not used until they are.
+	renderer->ProgramCache = programCache;
+	ovrProgram_Begin(&renderer->BlitProgram, programCache, BLIT_VERTEX_SHADER, BLIT_FRAGMENT_SHADER);
+	ovrProgram_Begin(&renderer->HiddenAreaProgram, programCache, HIDDEN_AREA_VERTEX_SHADER, HIDDEN_AREA_FRAGMENT_SHADER);
+
+	if (strcasecmp(farField, "cube") == 0 || strcasecmp(farField, "compare") == 0)
+	{
+		if (ovrFarField_Create(&renderer->FarField, strcasecmp(farField, "compare") == 0, eyeRenderPass->ClearColor))
+		{
+			renderer->FarFieldProjectionMatrix = ovrMatrix4f_CreateProjectionFov(90.0f, 90.0f, 0.0f, 0.0f, FAR_FIELD_NEAR_Z, 0.0f);
+			ovrSceneStaticUniforms farFieldStaticUniforms;
+			farFieldStaticUniforms.ProjectionMatrix = renderer->FarFieldProjectionMatrix;
+			GL(glGenBuffers(1, &renderer->FarFieldStaticUniforms));
+			GL(glBindBuffer(GL_UNIFORM_BUFFER, renderer->FarFieldStaticUniforms));
+			GL(glBufferData(GL_UNIFORM_BUFFER, sizeof(farFieldStaticUniforms), &farFieldStaticUniforms, GL_STATIC_DRAW));
+			GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+			ovrCommandBuffer_Create(&renderer->FarFieldCommands, 256);
+			LOGI("Far field: %dx%d cube map, %1.1f MB, refreshed every %d frames one face at a time", FAR_FIELD_CUBE_MAP_SIZE, FAR_FIELD_CUBE_MAP_SIZE,
+				renderer->FarField.FrameBuffer.TextureSwapChainLength * 6 * FAR_FIELD_CUBE_MAP_SIZE * FAR_FIELD_CUBE_MAP_SIZE * 4 / (1024.0f * 1024.0f),
+				FAR_FIELD_REFRESH_FRAMES);
+		}
+		else
+		{
+			LOGE("Failed to create the far field cube map");
+		}
+	}
+
+	if (renderer->MonoFarField)
+	{
+		ovrCommandBuffer_Create(&renderer->FarFieldCommands, 256);
+	}
+
+	// The view uniforms change every frame, the projection never does.
+	const int viewBlocks = VRAPI_FRAME_LAYER_EYE_MAX + ((renderer->FarField.FrameBuffer.Width != 0) ? 6 : (renderer->MonoFarField ? 1 : 0));
+	ovrUniformRing_Create(&renderer->SceneViewUniforms, sizeof(ovrSceneViewUniforms), viewBlocks);
+	ovrSceneStaticUniforms staticUniforms;
+	staticUniforms.ProjectionMatrix = renderer->ProjectionMatrix;
+	GL(glGenBuffers(1, &renderer->SceneStaticUniforms));
+	GL(glBindBuffer(GL_UNIFORM_BUFFER, renderer->SceneStaticUniforms));
+	GL(glBufferData(GL_UNIFORM_BUFFER, sizeof(staticUniforms), &staticUniforms, GL_STATIC_DRAW));
+	GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+
+	ovrCommandBuffer_Create(&renderer->EyeCommands, 256);
+
+	renderer->ReuseEyeBuffers = (strcasecmp(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_EYE_BUFFER_REUSE, "on"), "off") != 0);
+
+	// The sliced time warp races the beam in the front buffer, with the pre-schedule time of the VrApi.
+	renderer->BeamRacing = (strcasecmp(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_BEAM_RACING, "off"), "on") == 0);
+	if (renderer->BeamRacing)
+	{
+		const float preScheduleSeconds = atof(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_VRAPI_SLICE_PRE_SCHEDULE_SECONDS, "0.014"));
+		LOGI("Beam racing: sliced time warp, slices started %1.1f ms ahead of their scanout", preScheduleSeconds * 1000.0f);
+		if (preScheduleSeconds > BEAM_RACING_MAX_PRE_SCHEDULE_SECONDS)
+		{
+			LOGW("Beam racing adds latency unless %s is at most %1.3f", LOCAL_PREF_VRAPI_SLICE_PRE_SCHEDULE_SECONDS, BEAM_RACING_MAX_PRE_SCHEDULE_SECONDS);
+		}
+		if (strcmp(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_VRAPI_FRONTBUFFER, "1"), "0") == 0)
+		{
+			LOGW("Beam racing needs front buffer rendering, which %s turns off", LOCAL_PREF_VRAPI_FRONTBUFFER);
+		}
+	}
+
+	// The HUD is a 0.5 by 0.125 meter panel, one meter ahead and a bit below the eyes.
+	const char * hud = ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_PERFORMANCE_HUD, "off");
+	if (strcasecmp(hud, "view") == 0 || strcasecmp(hud, "world") == 0)
+	{
+		if (renderer->FarField.FrameBuffer.Width != 0)
+		{
+			LOGW("The performance HUD is hidden while the far field takes the overlay layer");
+		}
+		ovrMatrix4f transform = ovrMatrix4f_CreateTranslation(0.0f, -0.35f, -1.0f);
+		transform.M[0][0] = 0.25f;
+		transform.M[1][1] = 0.0625f;
+		if (!ovrOverlayPanel_Create(&renderer->HudPanel, HUD_WIDTH, HUD_HEIGHT, strcasecmp(hud, "view") == 0, &transform))
+		{
+			LOGE("Failed to create the performance HUD");
+		}
+	}
+}
+
+static void ovrRenderer_SetFoveationLevel(ovrRenderer * renderer, const ovrFoveationLevel level)
+{
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		if (renderer->PeripheryFrameBuffer[eye].Width != 0)
+		{
+			ovrFramebuffer_Destroy(&renderer->PeripheryFrameBuffer[eye]);
+		}
+	}
+
+	renderer->FoveationLevel = level;
+	renderer->EyeBuffersDirty = true;
+
+	const int width = renderer->FrameBuffer[0].Width;
+	const int height = renderer->FrameBuffer[0].Height;
+	const ovrFoveationParms * parms = &FoveationParms[level];
+	const int peripheryWidth = (int)(width * parms->PeripheryScale);
+	const int peripheryHeight = (int)(height * parms->PeripheryScale);
+	const int centerWidth = (int)(width * parms->CenterFraction);
+	const int centerHeight = (int)(height * parms->CenterFraction);
+
+	if (level != FOVEATION_LEVEL_OFF)
+	{
+		for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+		{
+			ovrFramebuffer_CreateOffscreen(&renderer->PeripheryFrameBuffer[eye],
+				peripheryWidth, peripheryHeight, renderer->FrameBuffer[eye].Multisamples,
+				renderer->DepthFormat, (SHARE_STEREO_DEPTH && eye > 0) ? &renderer->PeripheryFrameBuffer[0] : NULL);
+		}
+	}
+
+	const int fullPixels = width * height;
+	const int shadedPixels = (level != FOVEATION_LEVEL_OFF) ? peripheryWidth * peripheryHeight + centerWidth * centerHeight : fullPixels;
+	LOGI("Foveation %s: %d of %d pixels shaded per eye (%1.0f%% saved)", parms->Name,
+		shadedPixels, fullPixels, 100.0f * (fullPixels - shadedPixels) / fullPixels);
+}
+
+// The mono far field is rendered at the size of the eye buffers, and shares their depth buffer
+// because it is done with it before the eye passes start.
+static void ovrRenderer_CreateMonoFarFieldFrameBuffer(ovrRenderer * renderer)
+{
+	if (renderer->MonoFarFieldFrameBuffer.Width != 0)
+	{
+		ovrFramebuffer_Destroy(&renderer->MonoFarFieldFrameBuffer);
+	}
+	if (!renderer->MonoFarField)
+	{
+		return;
+	}
+	if (!ovrFramebuffer_CreateOffscreen(&renderer->MonoFarFieldFrameBuffer,
+		renderer->FrameBuffer[0].Width, renderer->FrameBuffer[0].Height, renderer->FrameBuffer[0].Multisamples,
+		renderer->DepthFormat, SHARE_STEREO_DEPTH ? &renderer->FrameBuffer[0] : NULL))
+	{
+		LOGE("Failed to create the mono far field, rendering both eyes in full");
+		ovrFramebuffer_Destroy(&renderer->MonoFarFieldFrameBuffer);
+	}
+	// Choose the split again for the new eye buffers.
+	renderer->MonoFarFieldViewportWidth = 0;
+}
+
+// Rejects the fragments the lenses never show for the currently bound framebuffer. The mask
+// is built for the suggested field of view, so it scales with the overscan margin.
+static void ovrRenderer_DrawHiddenAreaMask(ovrRenderer * renderer, ovrFramebuffer * frameBuffer)
+{
+	if (renderer->HiddenAreaTanAngle <= 0.0f || !ovrProgram_IsReady(&renderer->HiddenAreaProgram))
+	{
+		return;
+	}
+	ovrHiddenAreaMask_Update(&frameBuffer->HiddenAreaMask, renderer->FovDegreesX, renderer->FovDegreesY, frameBuffer->Width, frameBuffer->Height,
+		renderer->HiddenAreaTanAngle);
+	ovrHiddenAreaMask_Draw(&frameBuffer->HiddenAreaMask, &renderer->HiddenAreaProgram);
+}
+
+// Upsamples the periphery, or copies the mono far field, into the currently bound eye framebuffer.
+static void ovrRenderer_Composite(ovrRenderer * renderer, const ovrFramebuffer * source)
+{
+	GL(glDisable(GL_DEPTH_TEST));
+	GL(glDepthMask(GL_FALSE));
+	GL(glUseProgram(renderer->BlitProgram.Program));
+	GL(glUniform4f(renderer->BlitProgram.Uniforms[UNIFORM_TEXCOORD_SCALE],
+		(float)source->ViewportWidth / source->Width,
+		(float)source->ViewportHeight / source->Height, 1.0f, 1.0f));
+	GL(glActiveTexture(GL_TEXTURE0));
+	GL(glBindTexture(GL_TEXTURE_2D, ovrFramebuffer_GetColorTexture(source)));
+	GL(glDrawArrays(GL_TRIANGLES, 0, 3));
+	GL(glBindTexture(GL_TEXTURE_2D, 0));
+	GL(glUseProgram(0));
+}
+
+static void ovrRenderer_Destroy(ovrRenderer * renderer)
+{
+	ovrRenderer_DestroyRetiredFrameBuffers(renderer);
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		ovrFramebuffer_Destroy(&renderer->FrameBuffer[eye]);
+		if (renderer->PeripheryFrameBuffer[eye].Width != 0)
+		{
+			ovrFramebuffer_Destroy(&renderer->PeripheryFrameBuffer[eye]);
+		}
+	}
+	ovrGpuTimer_Destroy(&renderer->GpuTimer);
+	ovrDynamicResolution_Clear(&renderer->DynamicResolution);
+	renderer->ProjectionMatrix = ovrMatrix4f_CreateIdentity();
+	renderer->TexCoordsTanAnglesMatrix = ovrMatrix4f_CreateIdentity();
+	renderer->FoveationLevel = FOVEATION_LEVEL_OFF;
+	ovrProgram_Destroy(&renderer->BlitProgram);
+	ovrProgram_Destroy(&renderer->HiddenAreaProgram);
+	ovrUniformRing_Destroy(&renderer->SceneViewUniforms);
+	GL(glDeleteBuffers(1, &renderer->SceneStaticUniforms));
+	renderer->SceneStaticUniforms = 0;
+	ovrCommandBuffer_Destroy(&renderer->EyeCommands);
+	renderer->EyeCommandsProgram = 0;
+	renderer->EyeCommandsVertexArray = 0;
+	renderer->EyeCommandsInstanceCount = 0;
+	ovrFarField_Destroy(&renderer->FarField);
+	renderer->FarFieldProjectionMatrix = ovrMatrix4f_CreateIdentity();
+	GL(glDeleteBuffers(1, &renderer->FarFieldStaticUniforms));
+	renderer->FarFieldStaticUniforms = 0;
+	ovrCommandBuffer_Destroy(&renderer->FarFieldCommands);
+	renderer->FarFieldCommandsProgram = 0;
+	renderer->FarFieldCommandsVertexArray = 0;
+	if (renderer->MonoFarFieldFrameBuffer.Width != 0)
+	{
+		ovrFramebuffer_Destroy(&renderer->MonoFarFieldFrameBuffer);
+	}
+	GL(glDeleteVertexArrays(1, &renderer->MonoFarFieldVertexArray));
+	renderer->MonoFarFieldVertexArray = 0;
+	renderer->MonoFarFieldFirstInstance = NUM_INSTANCES;
+	renderer->MonoFarFieldViewportWidth = 0;
+	ovrOverlayPanel_Destroy(&renderer->HudPanel);
+}
+
+// Trades samples for frame rate when resolution alone is not enough. Call outside the GPU
+// timer frame, so the frame that rebuilds the eye buffers is not measured with the cost.
+// Only measured GPU times count, and not while the previous eye buffers are retiring.
+static void ovrRenderer_UpdateMsaaPolicy(ovrRenderer * renderer, const int minimumVsyncs)
+{
+	if (renderer->Config.Multisamples != 0 || !renderer->GpuTimer.UseTimerQueries || !ovrRenderer_CanRebuildFrameBuffers(renderer))
+	{
+		return;
+	}
+	const float frameBudget = (float)minimumVsyncs / renderer->DisplayRefreshRate;
+	if (!ovrMsaaPolicy_Update(&renderer->MsaaPolicy, renderer->DynamicResolution.Scale, renderer->GpuTimer.GpuTime, frameBudget))
+	{
+		return;
+	}
+	LOGI("MSAA policy: %dx at GPU %1.2f ms of %1.2f ms", renderer->MsaaPolicy.Samples,
+		renderer->GpuTimer.GpuTime * 1000.0f, frameBudget * 1000.0f);
+	const int previousSamples = renderer->FrameBuffer[0].Multisamples;
+	if (!ovrRenderer_RebuildFrameBuffers(renderer))
+	{
+		// Never try this sample count again.
+		LOGE("%dx MSAA not supported, staying at %dx", renderer->MsaaPolicy.Samples, previousSamples);
+		if (renderer->MsaaPolicy.Samples < previousSamples)
+		{
+			renderer->MsaaPolicy.MinSamples = previousSamples;
+		}
+		else
+		{
+			renderer->MsaaPolicy.MaxSamples = previousSamples;
+		}
+		renderer->MsaaPolicy.Samples = previousSamples;
+	}
+}
+
+// Feeds the latest GPU frame time to the dynamic resolution controller and sizes the
+// eye, periphery and mono far field viewports accordingly.
+static void ovrRenderer_UpdateResolution(ovrRenderer * renderer, const int minimumVsyncs)
+{
+	const float frameBudget = (float)minimumVsyncs / renderer->DisplayRefreshRate;
+	if (ovrDynamicResolution_Update(&renderer->DynamicResolution, renderer->GpuTimer.GpuTime, frameBudget))
+	{
+		LOGI("Dynamic resolution: scale %1.2f at GPU %1.2f ms of %1.2f ms", renderer->DynamicResolution.Scale,
+			renderer->GpuTimer.GpuTime * 1000.0f, frameBudget * 1000.0f);
+	}
+
+	const float scale = renderer->DynamicResolution.Scale / DYNAMIC_RESOLUTION_MAX_SCALE;
+	const int previousViewportWidth = renderer->FrameBuffer[0].ViewportWidth;
+	const int previousViewportHeight = renderer->FrameBuffer[0].ViewportHeight;
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		ovrFramebuffer * frameBuffer = &renderer->FrameBuffer[eye];
+		ovrFramebuffer_SetViewport(frameBuffer, (int)(frameBuffer->Width * scale), (int)(frameBuffer->Height * scale));
+		ovrFramebuffer * periphery = &renderer->PeripheryFrameBuffer[eye];
+		if (periphery->Width != 0)
+		{
+			ovrFramebuffer_SetViewport(periphery, (int)(periphery->Width * scale), (int)(periphery->Height * scale));
+		}
+	}
+	ovrFramebuffer * monoFarField = &renderer->MonoFarFieldFrameBuffer;
+	if (monoFarField->Width != 0)
+	{
+		ovrFramebuffer_SetViewport(monoFarField, renderer->FrameBuffer[0].ViewportWidth, renderer->FrameBuffer[0].ViewportHeight);
+	}
+	if (renderer->FrameBuffer[0].ViewportWidth != previousViewportWidth || renderer->FrameBuffer[0].ViewportHeight != previousViewportHeight)
+	{
+		renderer->EyeBuffersDirty = true;
+	}
+}
+
+// Returns true if the eye buffers rendered last would look the same as new ones, except
+// for a pose change that is small enough for time warp to correct.
+static bool ovrRenderer_CanReuseEyeBuffers(const ovrRenderer * renderer, const ovrSimulation * simulation, const ovrTracking * tracking)
+{
+	if (!renderer->ReuseEyeBuffers || renderer->EyeBuffersDirty ||
+		renderer->EyeBuffersRotation.x != simulation->CurrentRotation.x ||
+		renderer->EyeBuffersRotation.y != simulation->CurrentRotation.y ||
+		renderer->EyeBuffersRotation.z != simulation->CurrentRotation.z)
+	{
+		return false;
+	}
+
+	const ovrPosef * renderedPose = &renderer->EyeBuffersLayer.Textures[0].HeadPose.Pose;
+	const ovrPosef * pose = &tracking->HeadPose.Pose;
+	const float dot = fabsf(renderedPose->Orientation.x * pose->Orientation.x + renderedPose->Orientation.y * pose->Orientation.y +
+		renderedPose->Orientation.z * pose->Orientation.z + renderedPose->Orientation.w * pose->Orientation.w);
+	const float degrees = 2.0f * acosf((dot < 1.0f) ? dot : 1.0f) * (180.0f / VRAPI_PI);
+	const float dx = renderedPose->Position.x - pose->Position.x;
+	const float dy = renderedPose->Position.y - pose->Position.y;
+	const float dz = renderedPose->Position.z - pose->Position.z;
+	return degrees < EYE_BUFFER_REUSE_MAX_DEGREES && dx * dx + dy * dy + dz * dz < EYE_BUFFER_REUSE_MAX_METERS * EYE_BUFFER_REUSE_MAX_METERS;
+}
+
+// Widens the field of view of the eye buffers by the angle the head turns while they are
+// shown, plus one frame of prediction error, so time warp does not pull in black at the
+// edges during fast head turns. The eye buffers keep their resolution, so the margin
+// spreads the same pixel budget over a wider field of view rather than adding pixels.
+// The margin grows right away, and shrinks one step at a time once the head slows down.
+static void ovrRenderer_UpdateOverscan(ovrRenderer * renderer, const ovrScene * scene, const ovrTracking * tracking,
+	const int minimumVsyncs)
+{
+	if (!renderer->Overscan)
+	{
+		return;
+	}
+
+	// The angular velocity is in world space, the margins are in view space.
+	const ovrMatrix4f rotation = ovrMatrix4f_CreateFromQuaternion(&tracking->HeadPose.Pose.Orientation);
+	const ovrVector3f * worldVelocity = &tracking->HeadPose.AngularVelocity;
+	float velocity[3];
+	for (int i = 0; i < 3; i++)
+	{
+		velocity[i] = rotation.M[0][i] * worldVelocity->x + rotation.M[1][i] * worldVelocity->y + rotation.M[2][i] * worldVelocity->z;
+	}
+	const float seconds = (minimumVsyncs + 1) / renderer->DisplayRefreshRate;
+	const float degreesX = sqrtf(velocity[1] * velocity[1] + velocity[2] * velocity[2]) * seconds * (180.0f / VRAPI_PI);
+	const float degreesY = sqrtf(velocity[0] * velocity[0] + velocity[2] * velocity[2]) * seconds * (180.0f / VRAPI_PI);
+	int stepsX = (int)ceilf(degreesX / OVERSCAN_STEP_DEGREES);
+	int stepsY = (int)ceilf(degreesY / OVERSCAN_STEP_DEGREES);
+	stepsX = (stepsX < OVERSCAN_MAX_STEPS) ? stepsX : OVERSCAN_MAX_STEPS;
+	stepsY = (stepsY < OVERSCAN_MAX_STEPS) ? stepsY : OVERSCAN_MAX_STEPS;
+
+	const bool release = ++renderer->OverscanFrames >= OVERSCAN_RELEASE_FRAMES;
+	if (stepsX < renderer->OverscanStepsX)
+	{
+		stepsX = release ? renderer->OverscanStepsX - 1 : renderer->OverscanStepsX;
+	}
+	if (stepsY < renderer->OverscanStepsY)
+	{
+		stepsY = release ? renderer->OverscanStepsY - 1 : renderer->OverscanStepsY;
+	}
+	renderer->OverscanDegrees += OVERSCAN_STEP_DEGREES * stepsX;
+	if (stepsX == renderer->OverscanStepsX && stepsY == renderer->OverscanStepsY)
+	{
+		return;
+	}
+
+	renderer->OverscanStepsX = stepsX;
+	renderer->OverscanStepsY = stepsY;
+	renderer->OverscanFrames = 0;
+	ovrRenderer_SetProjection(renderer);
+
+	// Only the scene shaders without a view-projection matrix record the projection.
+	if ((scene->ShaderKey & (SCENE_SHADER_VIEW_PROJECTION | SCENE_SHADER_UNIFORM_BLOCKS)) == 0)
+	{
+		ovrCommandBuffer_Reset(&renderer->EyeCommands);
+		if (renderer->MonoFarField)
+		{
+			ovrCommandBuffer_Reset(&renderer->FarFieldCommands);
+		}
+	}
+	renderer->MonoFarFieldViewportWidth = 0;
+	renderer->EyeBuffersDirty = true;
+}
+
+// Chooses the distance beyond which the cubes are rendered once from the center eye and
+// composited into both eye images. Seen from either eye, an object at distance z is offset
+// by (IPD / 2) / z in tangent space from where the center eye sees it, which is less than
+// MONO_FAR_FIELD_MAX_DISPARITY texels beyond the split. The split follows the eye viewport
+// as dynamic resolution changes it, and a cube is only far when all of its corners are.
+static void ovrRenderer_UpdateMonoFarField(ovrRenderer * renderer, const ovrScene * scene)
+{
+	const int viewportWidth = renderer->FrameBuffer[0].ViewportWidth;
+	if (renderer->MonoFarFieldFrameBuffer.Width == 0 || !scene->CreatedVAOs || viewportWidth == renderer->MonoFarFieldViewportWidth)
+	{
+		return;
+	}
+	renderer->MonoFarFieldViewportWidth = viewportWidth;
+
+	const ovrHeadModelParms headModelParms = vrapi_DefaultHeadModelParms();
+	const float fovDegreesX = renderer->FovDegreesX + 2.0f * OVERSCAN_STEP_DEGREES * renderer->OverscanStepsX;
+	const float texelTanAngle = 2.0f * tanf(fovDegreesX * (VRAPI_PI / 360.0f)) / viewportWidth;
+	const float splitDistance = 0.5f * headModelParms.InterpupillaryDistance / (texelTanAngle * MONO_FAR_FIELD_MAX_DISPARITY);
+	const int firstInstance = ovrScene_CountInstancesWithin(scene, splitDistance + sqrtf(3.0f));
+
+	// GLES 3.0 has no base instance, so the far cubes get a vertex array of their own.
+	if (renderer->MonoFarFieldVertexArray == 0)
+	{
+		ovrGeometry cube = scene->Cube;
+		ovrGeometry_CreateVAO(&cube);
+		renderer->MonoFarFieldVertexArray = cube.VertexArrayObject;
+		renderer->MonoFarFieldFirstInstance = -1;
+	}
+	if (firstInstance != renderer->MonoFarFieldFirstInstance)
+	{
+		ovrScene_SetInstanceAttribs(scene, renderer->MonoFarFieldVertexArray, firstInstance);
+		renderer->MonoFarFieldFirstInstance = firstInstance;
+		ovrCommandBuffer_Reset(&renderer->FarFieldCommands);
+		LOGI("Mono far field: %d of %d cubes beyond %1.1f m at %d texels wide, %1.0f%% of the cube draws saved",
+			NUM_INSTANCES - firstInstance, NUM_INSTANCES, splitDistance, viewportWidth,
+			100.0f * (NUM_INSTANCES - firstInstance) / (VRAPI_FRAME_LAYER_EYE_MAX * NUM_INSTANCES));
+	}
+}
+
+// Draws a row of cells on the HUD with the first litCells lit.
+static void ovrRenderer_DrawHudCells(ovrRenderer * renderer, const int y, const int cells, const int litCells)
+{
+	const int cellWidth = (HUD_WIDTH - 8) / cells;
+	for (int i = 0; i < cells; i++)
+	{
+		const float lit = (i < litCells) ? 1.0f : 0.25f;
+		ovrOverlayPanel_FillRect(&renderer->HudPanel, 4 + i * cellWidth, y, cellWidth - 4, 12, 0.2f * lit, 0.6f * lit, 1.0f * lit, 1.0f);
+	}
+}
+
+// Redraws the performance HUD if any of the bars changed since it was last drawn.
+static void ovrRenderer_UpdateHud(ovrRenderer * renderer, const int minimumVsyncs)
+{
+	if (renderer->HudPanel.FrameBuffer.Width == 0)
+	{
+		return;
+	}
+	if (++renderer->HudFrames >= HUD_GPU_TIME_FRAMES)
+	{
+		const float frameBudget = (float)minimumVsyncs / renderer->DisplayRefreshRate;
+		const float gpuFraction = renderer->GpuTimer.GpuTime / frameBudget;
+		renderer->HudGpuSteps = (int)(((gpuFraction < 1.0f) ? gpuFraction : 1.0f) * HUD_GPU_TIME_STEPS + 0.5f);
+		renderer->HudFrames = 0;
+	}
+	const int gpuSteps = renderer->HudGpuSteps;
+	const int scalePercent = (int)(renderer->DynamicResolution.Scale * 100.0f + 0.5f);
+	const int samples = renderer->FrameBuffer[0].Multisamples;
+	const int sampleCells = (samples >= 4) ? 3 : ((samples >= 2) ? 2 : 1);
+	const unsigned int contentKey = gpuSteps | (scalePercent << 8) | (minimumVsyncs << 16) | (sampleCells << 20);
+	if (!ovrOverlayPanel_BeginUpdate(&renderer->HudPanel, contentKey))
+	{
+		return;
+	}
+
+	const int barWidth = HUD_WIDTH - 8;
+	ovrOverlayPanel_FillRect(&renderer->HudPanel, 1, 1, HUD_WIDTH - 2, HUD_HEIGHT - 2, 0.0f, 0.0f, 0.0f, 0.6f);
+
+	// GPU time in the frame budget, turning yellow and red where dynamic resolution kicks in.
+	const float gpuBar = (float)gpuSteps / HUD_GPU_TIME_STEPS;
+	const bool overHighWater = gpuBar > DYNAMIC_RESOLUTION_HIGH_WATER;
+	const bool overLowWater = gpuBar > DYNAMIC_RESOLUTION_LOW_WATER;
+	ovrOverlayPanel_FillRect(&renderer->HudPanel, 4, 4, (int)(barWidth * gpuBar), 12,
+		overLowWater ? 1.0f : 0.2f, overHighWater ? 0.2f : 1.0f, 0.2f, 1.0f);
+	ovrOverlayPanel_FillRect(&renderer->HudPanel, 4 + (int)(barWidth * DYNAMIC_RESOLUTION_HIGH_WATER), 4, 1, 12, 1.0f, 1.0f, 1.0f, 1.0f);
+
+	// Resolution scale.
+	ovrOverlayPanel_FillRect(&renderer->HudPanel, 4, 19, barWidth * scalePercent / 100, 12, 0.2f, 0.6f, 1.0f, 1.0f);
+
+	// Frame rate, one cell per step above the lowest rate, and the MSAA samples.
+	ovrRenderer_DrawHudCells(renderer, 34, FRAME_RATE_MAX_VSYNCS, FRAME_RATE_MAX_VSYNCS + 1 - minimumVsyncs);
+	ovrRenderer_DrawHudCells(renderer, 49, 3, sampleCells);
+
+	ovrOverlayPanel_EndUpdate(&renderer->HudPanel);
+}
+
+// Records the draws of the scene instances in the vertex array, with the view matrix patched in on replay.
+static void ovrRenderer_RecordSceneCommands(ovrCommandBuffer * commands, const ovrScene * scene,
+	const GLuint vertexArrayObject, const int instanceCount, const ovrMatrix4f * projectionMatrix)
+{
+	ovrCommandBuffer_Reset(commands);
+
+	ovrCommandBuffer_DepthMask(commands, GL_TRUE);
+	ovrCommandBuffer_Enable(commands, GL_DEPTH_TEST);
+	ovrCommandBuffer_DepthFunc(commands, GL_LEQUAL);
+	const ovrProgram * program = ovrScene_GetProgram(scene);
+	ovrCommandBuffer_UseProgram(commands, program->Program);
+	if ((scene->ShaderKey & SCENE_SHADER_UNIFORM_BLOCKS) != 0)
+	{
+		// The uniforms come from the blocks bound by ovrRenderer_RenderFrame.
+	}
+	else if ((scene->ShaderKey & SCENE_SHADER_VIEW_PROJECTION) != 0)
+	{
+		ovrCommandBuffer_UniformMatrix4Patched(commands, program->Uniforms[UNIFORM_VIEW_PROJECTION_MATRIX], COMMAND_PATCH_VIEW_PROJECTION_MATRIX);
+	}
+	else
+	{
+		ovrCommandBuffer_UniformMatrix4Patched(commands, program->Uniforms[UNIFORM_VIEW_MATRIX], COMMAND_PATCH_VIEW_MATRIX);
+		ovrCommandBuffer_UniformMatrix4(commands, program->Uniforms[UNIFORM_PROJECTION_MATRIX], projectionMatrix);
+	}
+	ovrCommandBuffer_BindVertexArray(commands, vertexArrayObject);
+	ovrCommandBuffer_DrawElementsInstanced(commands, GL_TRIANGLES, scene->Cube.IndexCount, GL_UNSIGNED_SHORT, instanceCount);
+	ovrCommandBuffer_BindVertexArray(commands, 0);
+	ovrCommandBuffer_UseProgram(commands, 0);
+}
+
+// Records the draws of the eye pass. Everything except the view matrix is the same
+// for both eyes, so the commands are only recorded again when the scene changes.
+static void ovrRenderer_RecordEyeCommands(ovrRenderer * renderer, const ovrScene * scene, const int instanceCount)
+{
+	const double startTime = vrapi_GetTimeInSeconds();
+
+	ovrCommandBuffer * commands = &renderer->EyeCommands;
+	ovrRenderer_RecordSceneCommands(commands, scene, scene->Cube.VertexArrayObject, instanceCount, &renderer->ProjectionMatrix);
+
+	renderer->EyeCommandsProgram = ovrScene_GetProgram(scene)->Program;
+	renderer->EyeCommandsVertexArray = scene->Cube.VertexArrayObject;
+	renderer->EyeCommandsInstanceCount = instanceCount;
+	renderer->EyeBuffersDirty = true;
+
+	LOGI("Recorded eye pass: %d commands, %d bytes in %1.3f ms", commands->CommandCount,
+		commands->WordCount * (int)sizeof(unsigned int), (vrapi_GetTimeInSeconds() - startTime) * 1000.0);
+
+	if (DUMP_COMMAND_BUFFERS)
+	{
+		ovrCommandBuffer_Log(commands, "eye pass");
+		ovrCommandBuffer_Save(commands, COMMAND_BUFFER_DUMP_FILE);
+	}
+}
+
+#if LATE_LATCH
+// Overwrites the view matrices in the uniform block of the eye with the latest predicted
+// pose, right before the eye pass is flushed. The GPU only reads the block when it runs
+// the draws, so they use a pose that is several milliseconds fresher than the one they
+// were issued with. Like REDUCED_LATENCY, only the orientation is updated.
+static void ovrRenderer_LatchPose(ovrRenderer * renderer, ovrMobile * ovr, const ovrTracking * tracking,
+	const int eye, ovrTracking * latchedTracking)
+{
+	*latchedTracking = vrapi_GetPredictedTracking(ovr, tracking->HeadPose.TimeInSeconds);
+	latchedTracking->HeadPose.Pose.Position = tracking->HeadPose.Pose.Position;
+
+	const ovrHeadModelParms headModelParms = vrapi_DefaultHeadModelParms();
+	const ovrMatrix4f centerEyeViewMatrix = vrapi_GetCenterEyeViewMatrix(&headModelParms, latchedTracking, NULL);
+	const ovrMatrix4f eyeViewMatrix = vrapi_GetEyeViewMatrix(&headModelParms, &centerEyeViewMatrix, eye);
+
+	ovrSceneViewUniforms * uniforms = (ovrSceneViewUniforms *)ovrUniformRing_MapBlock(&renderer->SceneViewUniforms, eye,
+		offsetof(ovrSceneViewUniforms, AnimationRotation));
+	uniforms->ViewMatrix = eyeViewMatrix;
+	uniforms->ViewProjectionMatrix = ovrMatrix4f_Multiply(&renderer->ProjectionMatrix, &eyeViewMatrix);
+	ovrUniformRing_Unmap(&renderer->SceneViewUniforms);
+
+	renderer->LatchedPredictionSeconds += tracking->HeadPose.TimeInSeconds - vrapi_GetTimeInSeconds();
+}
+#endif
+
+static ovrFrameParms ovrRenderer_RenderFrame(ovrRenderer * renderer, const ovrJava * java,
+	long long frameIndex, int minimumVsyncs, const ovrPerformanceParms * perfParms,
+	const ovrScene * scene, const ovrSimulation * simulation,
+	const ovrTracking * tracking, ovrMobile * ovr)
+{
+	PROFILE_ZONE("ovrRenderer_RenderFrame");
+
+	ovrFrameParms parms = vrapi_DefaultFrameParms(java, VRAPI_FRAME_INIT_DEFAULT, NULL);
+	parms.FrameIndex = frameIndex;
+	parms.MinimumVsyncs = minimumVsyncs;
+	parms.PerformanceParms = *perfParms;
+	if (renderer->BeamRacing)
+	{
+		parms.WarpOptions |= VRAPI_FRAME_OPTION_USE_SLICED_WARP;
+	}
+
+	if (renderer->RetiredFrames > 0 && --renderer->RetiredFrames == 0)
+	{
+		ovrRenderer_DestroyRetiredFrameBuffers(renderer);
+	}
+
+	ovrProgram_Poll(&renderer->BlitProgram, renderer->ProgramCache);
+	ovrProgram_Poll(&renderer->HiddenAreaProgram, renderer->ProgramCache);
+
+	ovrFrameStats * stats = &renderer->FrameStats;
+	const double updateStartTime = vrapi_GetTimeInSeconds();
+	PROFILE_BEGIN("Update");
+
+	// Decide on reuse first. A reused frame renders next to nothing, so it is not measured
+	// by the GPU timer, and the controllers that act on the GPU time leave it alone, or the
+	// resolution would climb and mark the eye buffers dirty, which defeats the reuse.
+	ovrGpuTimer_Poll(&renderer->GpuTimer);
+	bool reuseEyeBuffers = ovrRenderer_CanReuseEyeBuffers(renderer, simulation, tracking);
+	const bool measured = !reuseEyeBuffers;
+	if (measured)
+	{
+		ovrRenderer_UpdateMsaaPolicy(renderer, minimumVsyncs);
+		ovrGpuTimer_BeginFrame(&renderer->GpuTimer);
+		ovrRenderer_UpdateResolution(renderer, minimumVsyncs);
+		ovrRenderer_UpdateOverscan(renderer, scene, tracking, minimumVsyncs);
+	}
+	ovrRenderer_UpdateHud(renderer, minimumVsyncs);
+
+	PROFILE_END();
+	const double splitStartTime = vrapi_GetTimeInSeconds();
+	stats->CpuTime[FRAME_STAGE_UPDATE] = (float)(splitStartTime - updateStartTime);
+	PROFILE_BEGIN("SplitFarField");
+
+	// The far cubes are left out of the eye passes while the far field is on. The mono far field
+	// is composited into the eye buffers, which foveation does on its own terms.
+	if (measured)
+	{
+		ovrFarField_UpdateComparison(&renderer->FarField, renderer->GpuTimer.GpuTime, renderer->DynamicResolution.Scale);
+	}
+	ovrRenderer_UpdateMonoFarField(renderer, scene);
+	const bool farField = renderer->FarField.Enabled;
+	const int farFieldFaces = ovrFarField_GetUpdateFaces(&renderer->FarField);
+	const int firstFarFieldFace = renderer->FarField.NextFace;
+	const bool updateFarField = (farFieldFaces > 0);
+	const bool monoFarField = renderer->MonoFarFieldVertexArray != 0 && renderer->MonoFarFieldFrameBuffer.Width != 0 &&
+		renderer->FoveationLevel == FOVEATION_LEVEL_OFF && ovrProgram_IsReady(&renderer->BlitProgram);
+	const int eyeInstanceCount = farField ? scene->NearInstanceCount : (monoFarField ? renderer->MonoFarFieldFirstInstance : NUM_INSTANCES);
+	stats->EyeInstanceCount = eyeInstanceCount;
+
+	PROFILE_END();
+	const double uploadStartTime = vrapi_GetTimeInSeconds();
+	stats->CpuTime[FRAME_STAGE_RECORD] = (float)(uploadStartTime - splitStartTime);
+	PROFILE_BEGIN("InstanceUpload");
+
+	// Update the instance transform attributes, or let the vertex shader animate the instances.
+	const ovrSceneInstanceFormat instanceFormat = ovrScene_GetInstanceFormat(scene);
+	const bool useUniformBlocks = (scene->ShaderKey & SCENE_SHADER_UNIFORM_BLOCKS) != 0;
+	if (instanceFormat == SCENE_INSTANCE_FORMAT_ANIMATED)
+	{
+		if (!useUniformBlocks)
+		{
+			const ovrProgram * program = ovrScene_GetProgram(scene);
+			GL(glUseProgram(program->Program));
+			GL(glUniform4f(program->Uniforms[UNIFORM_ANIMATION_ROTATION], simulation->CurrentRotation.x,
+				simulation->CurrentRotation.y, simulation->CurrentRotation.z, 0.0f));
+			GL(glUseProgram(0));
+		}
+	}
+	else
+	{
+		const int instanceFloats = SceneInstanceVectors[instanceFormat] * 4;
+		GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
+		GL(float * cubeTransforms = (float *)glMapBufferRange(GL_ARRAY_BUFFER, 0,
+			NUM_INSTANCES * instanceFloats * sizeof(float), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+		for (int i = 0; i < NUM_INSTANCES; i++)
+		{
+			const ovrMatrix4f rotation = ovrMatrix4f_CreateRotation(
+				scene->CubeRotations[i].x * simulation->CurrentRotation.x,
+				scene->CubeRotations[i].y * simulation->CurrentRotation.y,
+				scene->CubeRotations[i].z * simulation->CurrentRotation.z);
+			const ovrMatrix4f translation = ovrMatrix4f_CreateTranslation(
+				scene->CubePositions[i].x,
+				scene->CubePositions[i].y,
+				scene->CubePositions[i].z);
+			const ovrMatrix4f transform = ovrMatrix4f_Multiply(&translation, &rotation);
+			if (instanceFormat == SCENE_INSTANCE_FORMAT_AFFINE)
 			{
-				continue;
+				// The rows become the columns of the mat3x4 attribute.
+				memcpy(&cubeTransforms[i * instanceFloats], transform.M, instanceFloats * sizeof(float));
 			}
-			// Test for overlap with any of the existing cubes.
-			bool overlap = false;
-			for (int j = 0; j < i; j++)
+			else
 			{
-				if (fabsf(rx - scene->CubePositions[j].x) < 4.0f &&
-					fabsf(ry - scene->CubePositions[j].y) < 4.0f &&
-					fabsf(rz - scene->CubePositions[j].z) < 4.0f)
-				{
-					overlap = true;
-					break;
-				}
+				const ovrMatrix4f transposed = ovrMatrix4f_Transpose(&transform);
+				memcpy(&cubeTransforms[i * instanceFloats], transposed.M, instanceFloats * sizeof(float));
 			}
-			if (!overlap)
+		}
+		GL(glUnmapBuffer(GL_ARRAY_BUFFER));
+		GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+	}
+
+	PROFILE_END();
+	const double recordStartTime = vrapi_GetTimeInSeconds();
+	stats->CpuTime[FRAME_STAGE_INSTANCE_UPLOAD] = (float)(recordStartTime - uploadStartTime);
+	PROFILE_BEGIN("RecordCommands");
+
+	// Calculate the center view matrix.
+	const ovrHeadModelParms headModelParms = vrapi_DefaultHeadModelParms();
+
+	// Record the eye pass if it was never recorded or the scene changed.
+	if (ovrCommandBuffer_IsEmpty(&renderer->EyeCommands) ||
+		renderer->EyeCommandsProgram != ovrScene_GetProgram(scene)->Program ||
+		renderer->EyeCommandsVertexArray != scene->Cube.VertexArrayObject ||
+		renderer->EyeCommandsInstanceCount != eyeInstanceCount)
+	{
+		ovrRenderer_RecordEyeCommands(renderer, scene, eyeInstanceCount);
+	}
+	if (updateFarField &&
+		(ovrCommandBuffer_IsEmpty(&renderer->FarFieldCommands) ||
+		renderer->FarFieldCommandsProgram != ovrScene_GetProgram(scene)->Program ||
+		renderer->FarFieldCommandsVertexArray != scene->FarFieldVertexArrayObject))
+	{
+		ovrRenderer_RecordSceneCommands(&renderer->FarFieldCommands, scene, scene->FarFieldVertexArrayObject,
+			NUM_INSTANCES - scene->NearInstanceCount, &renderer->FarFieldProjectionMatrix);
+		renderer->FarFieldCommandsProgram = ovrScene_GetProgram(scene)->Program;
+		renderer->FarFieldCommandsVertexArray = scene->FarFieldVertexArrayObject;
+	}
+	if (monoFarField &&
+		(ovrCommandBuffer_IsEmpty(&renderer->FarFieldCommands) ||
+		renderer->FarFieldCommandsProgram != ovrScene_GetProgram(scene)->Program))
+	{
+		ovrRenderer_RecordSceneCommands(&renderer->FarFieldCommands, scene, renderer->MonoFarFieldVertexArray,
+			NUM_INSTANCES - renderer->MonoFarFieldFirstInstance, &renderer->ProjectionMatrix);
+		renderer->FarFieldCommandsProgram = ovrScene_GetProgram(scene)->Program;
+		renderer->FarFieldCommandsVertexArray = renderer->MonoFarFieldVertexArray;
+		renderer->EyeBuffersDirty = true;
+	}
+
+	// Time warp corrects the small pose change if the eye buffers are resubmitted, unless
+	// recording the commands found that the scene changed after all. Such a frame is rendered
+	// without being measured.
+	reuseEyeBuffers = reuseEyeBuffers && !renderer->EyeBuffersDirty;
+
+	PROFILE_END();
+	const double eyePassStartTime = vrapi_GetTimeInSeconds();
+	stats->CpuTime[FRAME_STAGE_RECORD] += (float)(eyePassStartTime - recordStartTime);
+	stats->ReusedEyeBuffers = reuseEyeBuffers;
+	renderer->PredictionSeconds += VRAPI_FRAME_LAYER_EYE_MAX * (tracking->HeadPose.TimeInSeconds - eyePassStartTime);
+#if LATE_LATCH
+	// The pose can only be latched late if the draws read it from a uniform block, and not
+	// when the near cubes have to line up with a mono far field rendered with the old pose.
+	const bool latchPose = useUniformBlocks && !monoFarField;
+#endif
+
+	// Calculate the view matrices.
+	PROFILE_BEGIN("ViewUniforms");
+	ovrTracking updatedTracking[VRAPI_FRAME_LAYER_EYE_MAX];
+	ovrMatrix4f eyeViewMatrix[VRAPI_FRAME_LAYER_EYE_MAX];
+	ovrMatrix4f eyeViewProjectionMatrix[VRAPI_FRAME_LAYER_EYE_MAX];
+	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		// updated sensor prediction for each eye (updates orientation, not position)
+		// The mono far field is shared by both eyes, so they have to use the same pose.
+#if REDUCED_LATENCY
+		if (!monoFarField)
+		{
+			updatedTracking[eye] = vrapi_GetPredictedTracking(ovr, tracking->HeadPose.TimeInSeconds);
+			updatedTracking[eye].HeadPose.Pose.Position = tracking->HeadPose.Pose.Position;
+		}
+		else
+#endif
+		{
+			updatedTracking[eye] = *tracking;
+		}
+
+		// Calculate the center view matrix.
+		const ovrMatrix4f centerEyeViewMatrix = vrapi_GetCenterEyeViewMatrix(&headModelParms, &updatedTracking[eye], NULL);
+		eyeViewMatrix[eye] = vrapi_GetEyeViewMatrix(&headModelParms, &centerEyeViewMatrix, eye);
+		eyeViewProjectionMatrix[eye] = ovrMatrix4f_Multiply(&renderer->ProjectionMatrix, &eyeViewMatrix[eye]);
+	}
+	const ovrMatrix4f centerEyeViewMatrix = vrapi_GetCenterEyeViewMatrix(&headModelParms, &updatedTracking[0], NULL);
+	const ovrMatrix4f centerEyeViewProjectionMatrix = ovrMatrix4f_Multiply(&renderer->ProjectionMatrix, &centerEyeViewMatrix);
+
+	// Write the view uniforms of both eyes in one go.
+	if (useUniformBlocks)
+	{
+		unsigned char * blocks = ovrUniformRing_MapFrame(&renderer->SceneViewUniforms);
+		for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+		{
+			ovrSceneViewUniforms * uniforms = (ovrSceneViewUniforms *)(blocks + eye * renderer->SceneViewUniforms.BlockSize);
+			uniforms->ViewMatrix = eyeViewMatrix[eye];
+			uniforms->ViewProjectionMatrix = eyeViewProjectionMatrix[eye];
+			uniforms->AnimationRotation[0] = simulation->CurrentRotation.x;
+			uniforms->AnimationRotation[1] = simulation->CurrentRotation.y;
+			uniforms->AnimationRotation[2] = simulation->CurrentRotation.z;
+			uniforms->AnimationRotation[3] = 0.0f;
+		}
+		for (int face = firstFarFieldFace; face < firstFarFieldFace + farFieldFaces; face++)
+		{
+			const int block = SCENE_VIEW_BLOCK_FAR_FIELD + face;
+			ovrSceneViewUniforms * uniforms = (ovrSceneViewUniforms *)(blocks + block * renderer->SceneViewUniforms.BlockSize);
+			uniforms->ViewMatrix = CubeFaceViewMatrix(face);
+			uniforms->ViewProjectionMatrix = ovrMatrix4f_Multiply(&renderer->FarFieldProjectionMatrix, &uniforms->ViewMatrix);
+			uniforms->AnimationRotation[0] = simulation->CurrentRotation.x;
+			uniforms->AnimationRotation[1] = simulation->CurrentRotation.y;
+			uniforms->AnimationRotation[2] = simulation->CurrentRotation.z;
+			uniforms->AnimationRotation[3] = 0.0f;
+		}
+		if (monoFarField)
+		{
+			ovrSceneViewUniforms * uniforms = (ovrSceneViewUniforms *)(blocks + SCENE_VIEW_BLOCK_FAR_FIELD * renderer->SceneViewUniforms.BlockSize);
+			uniforms->ViewMatrix = centerEyeViewMatrix;
+			uniforms->ViewProjectionMatrix = centerEyeViewProjectionMatrix;
+			uniforms->AnimationRotation[0] = simulation->CurrentRotation.x;
+			uniforms->AnimationRotation[1] = simulation->CurrentRotation.y;
+			uniforms->AnimationRotation[2] = simulation->CurrentRotation.z;
+			uniforms->AnimationRotation[3] = 0.0f;
+		}
+		ovrUniformRing_Unmap(&renderer->SceneViewUniforms);
+	}
+	PROFILE_END();
+
+	// Render the far cubes into the next faces of the cube map around the viewer.
+	if (updateFarField)
+	{
+		PROFILE_ZONE("FarFieldCubeMap");
+		if (useUniformBlocks)
+		{
+			GL(glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_SCENE_STATIC, renderer->FarFieldStaticUniforms));
+		}
+		ovrFarField_BeginUpdate(&renderer->FarField);
+		for (int face = firstFarFieldFace; face < firstFarFieldFace + farFieldFaces; face++)
+		{
+			if (useUniformBlocks)
 			{
-				break;
+				ovrUniformRing_BindBlock(&renderer->SceneViewUniforms, UNIFORM_BLOCK_SCENE_VIEW, SCENE_VIEW_BLOCK_FAR_FIELD + face);
+			}
+			ovrCommandPatches patches;
+			patches.Matrices[COMMAND_PATCH_VIEW_MATRIX] = CubeFaceViewMatrix(face);
+			patches.Matrices[COMMAND_PATCH_VIEW_PROJECTION_MATRIX] = ovrMatrix4f_Multiply(&renderer->FarFieldProjectionMatrix,
+				&patches.Matrices[COMMAND_PATCH_VIEW_MATRIX]);
+			ovrFarField_BeginFace(&renderer->FarField, face);
+			ovrCommandBuffer_Execute(&renderer->FarFieldCommands, &patches);
+			ovrFarField_EndFace(&renderer->FarField);
+		}
+		ovrFarField_EndUpdate(&renderer->FarField, farFieldFaces);
+	}
+	if (useUniformBlocks)
+	{
+		GL(glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_SCENE_STATIC, renderer->SceneStaticUniforms));
+	}
+
+	// Time warp shows the far field where the eye buffers are transparent.
+	ovrRenderPass eyeRenderPass = renderer->EyeRenderPass;
+	ovrRenderPass peripheryRenderPass = renderer->PeripheryRenderPass;
+	if (farField)
+	{
+		eyeRenderPass.ClearColor[3] = 0.0f;
+		peripheryRenderPass.ClearColor[3] = 0.0f;
+	}
+
+	// Render the far cubes once from the center eye. The composite covers every pixel of the
+	// eye buffers, so they do not need their color cleared.
+	if (monoFarField && !reuseEyeBuffers)
+	{
+		PROFILE_ZONE("MonoFarField");
+		if (useUniformBlocks)
+		{
+			ovrUniformRing_BindBlock(&renderer->SceneViewUniforms, UNIFORM_BLOCK_SCENE_VIEW, SCENE_VIEW_BLOCK_FAR_FIELD);
+		}
+		ovrCommandPatches patches;
+		patches.Matrices[COMMAND_PATCH_VIEW_MATRIX] = centerEyeViewMatrix;
+		patches.Matrices[COMMAND_PATCH_VIEW_PROJECTION_MATRIX] = centerEyeViewProjectionMatrix;
+		ovrFramebuffer * monoFrameBuffer = &renderer->MonoFarFieldFrameBuffer;
+		ovrRenderPass_Begin(&peripheryRenderPass, monoFrameBuffer);
+		ovrRenderer_DrawHiddenAreaMask(renderer, monoFrameBuffer);
+		ovrCommandBuffer_Execute(&renderer->FarFieldCommands, &patches);
+		ovrRenderPass_End(&peripheryRenderPass, monoFrameBuffer);
+		eyeRenderPass.ColorLoadOp = RENDER_PASS_LOAD_DONT_CARE;
+	}
+
+	// Render the eye images.
+	for (int eye = 0; !reuseEyeBuffers && eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	{
+		PROFILE_ZONE("EyePass");
+		ovrFramebuffer * frameBuffer = &renderer->FrameBuffer[eye];
+
+		if (useUniformBlocks)
+		{
+			ovrUniformRing_BindBlock(&renderer->SceneViewUniforms, UNIFORM_BLOCK_SCENE_VIEW, eye);
+		}
+
+		// Replay the recorded eye pass with this eye's view matrix.
+		ovrCommandPatches patches;
+		patches.Matrices[COMMAND_PATCH_VIEW_MATRIX] = eyeViewMatrix[eye];
+		patches.Matrices[COMMAND_PATCH_VIEW_PROJECTION_MATRIX] = eyeViewProjectionMatrix[eye];
+
+		// The periphery cannot be composited until the blit program is ready.
+		if (renderer->FoveationLevel == FOVEATION_LEVEL_OFF || !ovrProgram_IsReady(&renderer->BlitProgram))
+		{
+			ovrRenderPass_Begin(&eyeRenderPass, frameBuffer);
+			if (monoFarField)
+			{
+				ovrRenderer_Composite(renderer, &renderer->MonoFarFieldFrameBuffer);
+			}
+			ovrRenderer_DrawHiddenAreaMask(renderer, frameBuffer);
+			ovrCommandBuffer_Execute(&renderer->EyeCommands, &patches);
+#if LATE_LATCH
+			if (latchPose)
+			{
+				ovrRenderer_LatchPose(renderer, ovr, tracking, eye, &updatedTracking[eye]);
+			}
+#endif
+			ovrRenderPass_End(&eyeRenderPass, frameBuffer);
+		}
+		else
+		{
+			// Render the whole field of view at the periphery resolution.
+			ovrFramebuffer * periphery = &renderer->PeripheryFrameBuffer[eye];
+			ovrRenderPass_Begin(&peripheryRenderPass, periphery);
+			ovrRenderer_DrawHiddenAreaMask(renderer, periphery);
+			ovrCommandBuffer_Execute(&renderer->EyeCommands, &patches);
+			ovrRenderPass_End(&peripheryRenderPass, periphery);
+
+			// The composite covers every pixel, so the eye buffer color does not need to be cleared.
+			ovrRenderPass compositeRenderPass = eyeRenderPass;
+			compositeRenderPass.ColorLoadOp = RENDER_PASS_LOAD_DONT_CARE;
+			ovrRenderPass_Begin(&compositeRenderPass, frameBuffer);
+			ovrRenderer_Composite(renderer, periphery);
+			ovrRenderer_DrawHiddenAreaMask(renderer, frameBuffer);
+
+			// Render the center at full resolution on top.
+			const float centerFraction = FoveationParms[renderer->FoveationLevel].CenterFraction;
+			const int centerWidth = (int)(frameBuffer->ViewportWidth * centerFraction);
+			const int centerHeight = (int)(frameBuffer->ViewportHeight * centerFraction);
+			GL(glScissor((frameBuffer->ViewportWidth - centerWidth) / 2, (frameBuffer->ViewportHeight - centerHeight) / 2, centerWidth, centerHeight));
+			ovrCommandBuffer_Execute(&renderer->EyeCommands, &patches);
+#if LATE_LATCH
+			if (latchPose)
+			{
+				ovrRenderer_LatchPose(renderer, ovr, tracking, eye, &updatedTracking[eye]);
 			}
+#endif
+			ovrRenderPass_End(&compositeRenderPass, frameBuffer);
+		}
+
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].ColorTextureSwapChain = frameBuffer->ColorTextureSwapChain;
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].TextureSwapChainIndex = frameBuffer->TextureSwapChainIndex;
+		// Only the viewport in the lower left corner of the texture holds the eye image.
+		const float viewportScaleX = (float)frameBuffer->ViewportWidth / frameBuffer->Width;
+		const float viewportScaleY = (float)frameBuffer->ViewportHeight / frameBuffer->Height;
+		ovrMatrix4f texCoordsTanAnglesMatrix = renderer->TexCoordsTanAnglesMatrix;
+		for (int i = 0; i < 4; i++)
+		{
+			texCoordsTanAnglesMatrix.M[0][i] *= viewportScaleX;
+			texCoordsTanAnglesMatrix.M[1][i] *= viewportScaleY;
+		}
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].TexCoordsFromTanAngles = texCoordsTanAnglesMatrix;
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].TextureRect.x = 0.0f;
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].TextureRect.y = 0.0f;
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].TextureRect.width = viewportScaleX;
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].TextureRect.height = viewportScaleY;
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].HeadPose = updatedTracking[eye].HeadPose;
+
+		ovrFramebuffer_Advance(frameBuffer);
+	}
+
+	// Resubmit the swap chain images and poses of the eye buffers rendered last.
+	if (reuseEyeBuffers)
+	{
+		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD] = renderer->EyeBuffersLayer;
+		renderer->ReusedFrames++;
+	}
+	else
+	{
+		renderer->EyeBuffersLayer = parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD];
+		renderer->EyeBuffersRotation = simulation->CurrentRotation;
+		renderer->EyeBuffersDirty = false;
+	}
+
+	if (useUniformBlocks)
+	{
+		ovrUniformRing_EndFrame(&renderer->SceneViewUniforms);
+	}
+
+	// Time warp draws the HUD on top of the eye images, whether it was redrawn this frame or not.
+	// The far field cube map takes the only overlay layer while it is on.
+	if (farField)
+	{
+		ovrFarField_Submit(&renderer->FarField, &parms, eyeViewMatrix, updatedTracking);
+	}
+	else
+	{
+		ovrOverlayPanel_Submit(&renderer->HudPanel, &parms, eyeViewMatrix, updatedTracking);
+	}
+
+	// Report the CPU cost of the eye passes, to compare the ways of setting the scene uniforms.
+	stats->CpuTime[FRAME_STAGE_EYE_RENDER] = (float)(vrapi_GetTimeInSeconds() - eyePassStartTime);
+	renderer->EyePassSeconds += stats->CpuTime[FRAME_STAGE_EYE_RENDER];
+	if (monoFarField)
+	{
+		renderer->MonoFarFieldSavedFraction += (double)(NUM_INSTANCES - renderer->MonoFarFieldFirstInstance) / (VRAPI_FRAME_LAYER_EYE_MAX * NUM_INSTANCES);
+	}
+	if (++renderer->EyePassFrames >= EYE_PASS_STATS_FRAMES)
+	{
+		LOGI("Eye passes: %1.3f ms CPU per frame with %s", renderer->EyePassSeconds * 1000.0 / renderer->EyePassFrames,
+			useUniformBlocks ? "uniform blocks" : "uniforms");
+		if (renderer->MonoFarField)
+		{
+			LOGI("Mono far field: %1.1f%% of the cube draws saved per frame", renderer->MonoFarFieldSavedFraction * 100.0 / renderer->EyePassFrames);
 		}
-
-		// Insert into list sorted based on distance.
-		int insert = 0;
-		const float distSqr = rx * rx + ry * ry + rz * rz;
-		for (int j = i; j > 0; j--)
+		if (renderer->ReusedFrames > 0)
 		{
-			const ovrVector3f * otherPos = &scene->CubePositions[j - 1];
-			const float otherDistSqr = otherPos->x * otherPos->x + otherPos->y * otherPos->y + otherPos->z * otherPos->z;
-			if (distSqr > otherDistSqr)
-			{
-				insert = j;
-				break;
-			}
-			scene->CubePositions[j] = scene->CubePositions[j - 1];
-			scene->CubeRotations[j] = scene->CubeRotations[j - 1];
+			LOGI("Eye buffers reused in %d of %d frames", renderer->ReusedFrames, renderer->EyePassFrames);
 		}
+		if (renderer->Overscan)
+		{
+			LOGI("Overscan: %1.1f degrees on each side on average", renderer->OverscanDegrees / renderer->EyePassFrames);
+		}
+		const double views = (double)(VRAPI_FRAME_LAYER_EYE_MAX * renderer->EyePassFrames);
+#if LATE_LATCH
+		if (latchPose)
+		{
+			LOGI("Late latch: poses predicted %1.2f ms ahead instead of %1.2f ms",
+				renderer->LatchedPredictionSeconds * 1000.0 / views, renderer->PredictionSeconds * 1000.0 / views);
+		}
+		else
+#endif
+		{
+			LOGI("Poses predicted %1.2f ms ahead", renderer->PredictionSeconds * 1000.0 / views);
+		}
+		renderer->EyePassSeconds = 0.0;
+		renderer->EyePassFrames = 0;
+		renderer->PredictionSeconds = 0.0;
+		renderer->LatchedPredictionSeconds = 0.0;
+		renderer->MonoFarFieldSavedFraction = 0.0;
+		renderer->ReusedFrames = 0;
+		renderer->OverscanDegrees = 0.0;
+	}
 
-		scene->CubePositions[insert].x = rx;
-		scene->CubePositions[insert].y = ry;
-		scene->CubePositions[insert].z = rz;
-
-		scene->CubeRotations[insert].x = ovrScene_RandomFloat(scene);
-		scene->CubeRotations[insert].y = ovrScene_RandomFloat(scene);
-		scene->CubeRotations[insert].z = ovrScene_RandomFloat(scene);
+	if (measured)
+	{
+		ovrGpuTimer_EndFrame(&renderer->GpuTimer);
 	}
 
-	scene->CreatedScene = true;
+	ovrFramebuffer_SetNone();
 
-#if !MULTI_THREADED
-	ovrScene_CreateVAOs(scene);
-#endif
+	return parms;
 }
 
-static void ovrScene_Destroy(ovrScene * scene)
-{
-#if !MULTI_THREADED
-	ovrScene_DestroyVAOs(scene);
-#endif
+//================================================================================
+//
+// ovrHeadTrajectory
+//
+//================================================================================
 
-	ovrProgram_Destroy(&scene->Program);
-	ovrGeometry_Destroy(&scene->Cube);
-	GL(glDeleteBuffers(1, &scene->InstanceTransformBuffer));
-	scene->CreatedScene = false;
+/*
+A head motion that replaces the tracked head pose, so the same frames can be rendered on
+every run. The trajectories and the key pose files are those of HeadTrajectory.h, which the
+host vrapi stand-in simulates the head with as well. ovrHeadMotionRecorder writes a key pose
+file from the tracked head poses.
+*/
+
+// Returns the head pose at the trajectory time, with the world space angular velocity.
+static ovrRigidBodyPosef ovrHeadTrajectory_GetPose(const ovrHeadTrajectory * trajectory, const double time)
+{
+	const ovrHeadKeyPose key = ovrHeadTrajectory_GetKeyPose(trajectory, time);
+	const ovrHeadKeyPose next = ovrHeadTrajectory_GetKeyPose(trajectory, time + HEAD_TRAJECTORY_VELOCITY_SECONDS);
+
+	ovrRigidBodyPosef pose;
+	memset(&pose, 0, sizeof(pose));
+	pose.Pose.Orientation = QuatFromYawPitchRoll(key.Yaw, key.Pitch, key.Roll);
+	pose.Pose.Position = key.Position;
+	const ovrQuatf nextOrientation = QuatFromYawPitchRoll(next.Yaw, next.Pitch, next.Roll);
+	pose.AngularVelocity = AngularVelocityBetween(&pose.Pose.Orientation, &nextOrientation, HEAD_TRAJECTORY_VELOCITY_SECONDS);
+	return pose;
 }
 
 //================================================================================
 //
-// ovrSimulation
+// ovrHeadMotionRecorder
 //
 //================================================================================
 
+/*
+Writes the tracked head pose of every frame to a file that ovrHeadTrajectory can replay,
+for instance to benchmark with the head motion of a real session:
+
+adb shell "echo dev_headMotionRecord /sdcard/vrsample_head.txt > /sdcard/.oculusprefs"
+*/
+
+#define LOCAL_PREF_HEAD_MOTION_RECORD		"dev_headMotionRecord"		// file to record the head poses to, off by default
+
 typedef struct
 {
-	ovrVector3f			CurrentRotation;
-} ovrSimulation;
+	FILE *		File;
+	double		StartTime;
+	double		LastTime;
+} ovrHeadMotionRecorder;
 
-static void ovrSimulation_Clear(ovrSimulation * simulation)
+static void ovrHeadMotionRecorder_Clear(ovrHeadMotionRecorder * recorder)
 {
-	simulation->CurrentRotation.x = 0.0f;
-	simulation->CurrentRotation.y = 0.0f;
-	simulation->CurrentRotation.z = 0.0f;
+	recorder->File = NULL;
+	recorder->StartTime = 0.0;
+	recorder->LastTime = 0.0;
 }
 
-static void ovrSimulation_Advance(ovrSimulation * simulation, double predictedDisplayTime)
+static void ovrHeadMotionRecorder_Create(ovrHeadMotionRecorder * recorder)
 {
-	// Update rotation.
-	simulation->CurrentRotation.x = (float)(predictedDisplayTime);
-	simulation->CurrentRotation.y = (float)(predictedDisplayTime);
-	simulation->CurrentRotation.z = (float)(predictedDisplayTime);
+	ovrHeadMotionRecorder_Clear(recorder);
+	const char * fileName = ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_HEAD_MOTION_RECORD, "");
+	if (fileName[0] == '\0')
+	{
+		return;
+	}
+	recorder->File = fopen(fileName, "w");
+	if (recorder->File == NULL)
+	{
+		LOGE("ovrHeadMotionRecorder_Create: failed to open %s", fileName);
+		return;
+	}
+	fprintf(recorder->File, "# time yaw pitch roll x y z\n");
+	LOGI("Recording the head motion to %s", fileName);
+}
+
+static void ovrHeadMotionRecorder_Destroy(ovrHeadMotionRecorder * recorder)
+{
+	if (recorder->File != NULL)
+	{
+		fclose(recorder->File);
+	}
+	ovrHeadMotionRecorder_Clear(recorder);
+}
+
+static void ovrHeadMotionRecorder_Record(ovrHeadMotionRecorder * recorder, const ovrTracking * tracking)
+{
+	if (recorder->File == NULL)
+	{
+		return;
+	}
+	const double time = tracking->HeadPose.TimeInSeconds;
+	if (recorder->StartTime == 0.0)
+	{
+		recorder->StartTime = time;
+	}
+	else if (time <= recorder->LastTime)
+	{
+		return;
+	}
+	recorder->LastTime = time;
+
+	// The inverse of QuatFromYawPitchRoll.
+	const ovrMatrix4f m = ovrMatrix4f_CreateFromQuaternion(&tracking->HeadPose.Pose.Orientation);
+	const float toDegrees = 180.0f / VRAPI_PI;
+	const float sinPitch = -m.M[1][2];
+	const float yaw = atan2f(m.M[0][2], m.M[2][2]) * toDegrees;
+	const float pitch = asinf((sinPitch < -1.0f) ? -1.0f : ((sinPitch > 1.0f) ? 1.0f : sinPitch)) * toDegrees;
+	const float roll = atan2f(m.M[1][0], m.M[1][1]) * toDegrees;
+	const ovrVector3f * position = &tracking->HeadPose.Pose.Position;
+	fprintf(recorder->File, "%1.4f %1.3f %1.3f %1.3f %1.4f %1.4f %1.4f\n", time - recorder->StartTime,
+		yaw, pitch, roll, position->x, position->y, position->z);
 }
 
 //================================================================================
 //
-// ovrRenderer
+// ovrBenchmark
 //
 //================================================================================
 
-#define NUM_MULTI_SAMPLES	4
+/*
+Renders a fixed number of frames that are the same on every run, and writes a JSON report
+with the CPU time of every frame stage and the GPU time. The scene is created from a fixed
+seed, the head follows an ovrHeadTrajectory instead of the tracking, and the animation and
+the trajectory advance by exactly one frame period per frame. Dynamic resolution, the frame
+rate controller and the MSAA policy are held, so the work is the same however long it takes.
+The first BENCHMARK_WARMUP_FRAMES frames are not measured. When the report is written the
+activity finishes. For instance:
+
+adb shell "echo dev_benchmarkFrames 1800 dev_benchmarkMotion sine > /sdcard/.oculusprefs"
+
+The report holds the percentiles and every sample of each stage in milliseconds, so runs
+can be compared statistically. The stages are those of ovrFrameStage, and "gpu". The
+"record" stage only splits the far cubes off the eye passes and records the draws; every
+cube is drawn, there is no frustum culling:
 
-typedef struct
 {
-	ovrFramebuffer	FrameBuffer[VRAPI_FRAME_LAYER_EYE_MAX];
-	ovrMatrix4f		ProjectionMatrix;
-	ovrMatrix4f		TexCoordsTanAnglesMatrix;
-} ovrRenderer;
+	"version": 1,
+	"profile": "note4_adreno420_60hz",
+	"config": { "frames": 1800, "seed": 2, "motion": "sine", ... },
+	"frames": { "measured": 1800, "late": 0, "missed_vsyncs": 0, ... },
+	"instances": { "total": 1500, "eye_pass_mean": 1500.0, ... },
+	"stages": {
+		"update": { "count": 1800, "mean": 0.02, "p50": 0.02, "p95": 0.03, "p99": 0.04, "max": 0.10, "samples": [ ... ] },
+		...
+		"gpu": { ... }
+	}
+}
 
-static void ovrRenderer_Clear(ovrRenderer * renderer)
+A frame counts as late, with the vsyncs it missed, when its predicted display time is
+further after that of the previous frame than MinimumVsyncs.
+*/
+
+#define LOCAL_PREF_BENCHMARK_FRAMES			"dev_benchmarkFrames"		// frames to measure, "0" (default) runs normally
+#define LOCAL_PREF_BENCHMARK_MOTION			"dev_benchmarkMotion"		// "sine" (default), "turn", "still", "tracked" or a key pose file
+#define LOCAL_PREF_BENCHMARK_SEED			"dev_benchmarkSeed"			// scene seed, default "2"
+#define LOCAL_PREF_BENCHMARK_PROFILE		"dev_benchmarkProfile"		// device profile in the report, derived from the device by default
+#define LOCAL_PREF_BENCHMARK_REPORT			"dev_benchmarkReport"		// default BENCHMARK_REPORT_FILE
+#define BENCHMARK_REPORT_FILE				"/sdcard/vrsample_benchmark.json"
+#define BENCHMARK_WARMUP_FRAMES				60		// the pipeline fills up and the programs get their first use
+#define BENCHMARK_GPU_STAGE					FRAME_STAGE_MAX
+
+typedef struct
 {
-	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	int					FrameCount;			// frames to measure, zero if the benchmark is off
+	bool				Done;
+	int					Frames;				// frames rendered so far, including the warm up
+	int					MeasuredFrames;
+	unsigned int		Seed;
+	char				Motion[128];
+	char				Profile[64];
+	char				ReportFile[256];
+	ovrHeadTrajectory	Trajectory;
+	double				VsyncPeriod;
+	int					MinimumVsyncs;
+	// The samples of the measured frames, in seconds, one array per stage and one for the GPU.
+	float *				Samples[BENCHMARK_GPU_STAGE + 1];
+	int					SampleCount[BENCHMARK_GPU_STAGE + 1];
+	int					GpuMeasuredFrames;
+	double				LastDisplayTime;
+	int					LateFrames;
+	int					MissedVsyncs;
+	int					ReusedFrames;
+	long long			EyeInstances;		// sum over the measured frames
+} ovrBenchmark;
+
+static void ovrBenchmark_Clear(ovrBenchmark * benchmark)
+{
+	benchmark->FrameCount = 0;
+	benchmark->Done = false;
+	benchmark->Frames = 0;
+	benchmark->MeasuredFrames = 0;
+	benchmark->Seed = 0;
+	benchmark->Motion[0] = '\0';
+	benchmark->Profile[0] = '\0';
+	benchmark->ReportFile[0] = '\0';
+	ovrHeadTrajectory_Clear(&benchmark->Trajectory);
+	benchmark->VsyncPeriod = 0.0;
+	benchmark->MinimumVsyncs = 1;
+	for (int stage = 0; stage <= BENCHMARK_GPU_STAGE; stage++)
 	{
-		ovrFramebuffer_Clear(&renderer->FrameBuffer[eye]);
+		benchmark->Samples[stage] = NULL;
+		benchmark->SampleCount[stage] = 0;
 	}
-	renderer->ProjectionMatrix = ovrMatrix4f_CreateIdentity();
-	renderer->TexCoordsTanAnglesMatrix = ovrMatrix4f_CreateIdentity();
+	benchmark->GpuMeasuredFrames = 0;
+	benchmark->LastDisplayTime = 0.0;
+	benchmark->LateFrames = 0;
+	benchmark->MissedVsyncs = 0;
+	benchmark->ReusedFrames = 0;
+	benchmark->EyeInstances = 0;
 }
 
-static void ovrRenderer_Create(ovrRenderer * renderer, const ovrHmdInfo * hmdInfo)
+static const char * DeviceTypeName(const int deviceType)
 {
-	// Create the frame buffers.
-	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	switch (deviceType)
 	{
-		ovrFramebuffer_Create(&renderer->FrameBuffer[eye],
-			VRAPI_TEXTURE_FORMAT_8888,
-			hmdInfo->SuggestedEyeResolutionWidth,
-			hmdInfo->SuggestedEyeResolutionHeight,
-			NUM_MULTI_SAMPLES);
+		case VRAPI_DEVICE_TYPE_NOTE4:	return "note4";
+		case VRAPI_DEVICE_TYPE_S6:		return "s6";
+		default:						return "unknown";
 	}
-
-	// Setup the projection matrix.
-	renderer->ProjectionMatrix = ovrMatrix4f_CreateProjectionFov(
-		hmdInfo->SuggestedEyeFovDegreesX,
-		hmdInfo->SuggestedEyeFovDegreesY,
-		0.0f, 0.0f, 1.0f, 0.0f);
-	renderer->TexCoordsTanAnglesMatrix = ovrMatrix4f_TanAngleMatrixFromProjection(&renderer->ProjectionMatrix);
 }
 
-static void ovrRenderer_Destroy(ovrRenderer * renderer)
+static const char * GpuTypeName(const int gpuType)
 {
-	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	switch (gpuType)
 	{
-		ovrFramebuffer_Destroy(&renderer->FrameBuffer[eye]);
+		case VRAPI_GPU_TYPE_ADRENO_330:				return "adreno330";
+		case VRAPI_GPU_TYPE_ADRENO_420:				return "adreno420";
+		case VRAPI_GPU_TYPE_MALI_T760:				return "malit760";
+		case VRAPI_GPU_TYPE_MALI_T760_EXYNOS_5433:	return "malit760_5433";
+		case VRAPI_GPU_TYPE_MALI_T760_EXYNOS_7420:	return "malit760_7420";
+		default:									return ((gpuType & VRAPI_GPU_TYPE_MALI) != 0) ? "mali" :
+														(((gpuType & VRAPI_GPU_TYPE_ADRENO) != 0) ? "adreno" : "unknown");
 	}
-	renderer->ProjectionMatrix = ovrMatrix4f_CreateIdentity();
-	renderer->TexCoordsTanAnglesMatrix = ovrMatrix4f_CreateIdentity();
 }
 
-static ovrFrameParms ovrRenderer_RenderFrame(ovrRenderer * renderer, const ovrJava * java,
-	long long frameIndex, int minimumVsyncs, const ovrPerformanceParms * perfParms,
-	const ovrScene * scene, const ovrSimulation * simulation,
-	const ovrTracking * tracking, ovrMobile * ovr)
+// Reads the local preferences. The benchmark stays off unless frames are requested.
+static void ovrBenchmark_Create(ovrBenchmark * benchmark, const ovrJava * java, const float refreshRate, const int minimumVsyncs)
 {
-	ovrFrameParms parms = vrapi_DefaultFrameParms(java, VRAPI_FRAME_INIT_DEFAULT, NULL);
-	parms.FrameIndex = frameIndex;
-	parms.MinimumVsyncs = minimumVsyncs;
-	parms.PerformanceParms = *perfParms;
-
-	// Update the instance transform attributes.
-	GL(glBindBuffer(GL_ARRAY_BUFFER, scene->InstanceTransformBuffer));
-	GL(ovrMatrix4f * cubeTransforms = (ovrMatrix4f *)glMapBufferRange(GL_ARRAY_BUFFER, 0,
-		NUM_INSTANCES * sizeof(ovrMatrix4f), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
-	for (int i = 0; i < NUM_INSTANCES; i++)
+	ovrBenchmark_Clear(benchmark);
+	const int frameCount = atoi(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_BENCHMARK_FRAMES, "0"));
+	if (frameCount <= 0)
 	{
-		const ovrMatrix4f rotation = ovrMatrix4f_CreateRotation(
-			scene->CubeRotations[i].x * simulation->CurrentRotation.x,
-			scene->CubeRotations[i].y * simulation->CurrentRotation.y,
-			scene->CubeRotations[i].z * simulation->CurrentRotation.z);
-		const ovrMatrix4f translation = ovrMatrix4f_CreateTranslation(
-			scene->CubePositions[i].x,
-			scene->CubePositions[i].y,
-			scene->CubePositions[i].z);
-		const ovrMatrix4f transform = ovrMatrix4f_Multiply(&translation, &rotation);
-		cubeTransforms[i] = ovrMatrix4f_Transpose(&transform);
-	}
-	GL(glUnmapBuffer(GL_ARRAY_BUFFER));
-	GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+		return;
+	}
 
-	// Calculate the center view matrix.
-	const ovrHeadModelParms headModelParms = vrapi_DefaultHeadModelParms();
+	snprintf(benchmark->Motion, sizeof(benchmark->Motion), "%s", ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_BENCHMARK_MOTION, "sine"));
+	if (!ovrHeadTrajectory_Create(&benchmark->Trajectory, benchmark->Motion))
+	{
+		LOGE("Benchmark: unknown head motion %s", benchmark->Motion);
+		return;
+	}
+	if (benchmark->Trajectory.Type == HEAD_TRAJECTORY_FILE)
+	{
+		LOGI("Head trajectory: %d key poses over %1.2f seconds from %s", benchmark->Trajectory.KeyPoseCount,
+			benchmark->Trajectory.KeyPoses[benchmark->Trajectory.KeyPoseCount - 1].Time, benchmark->Motion);
+	}
 
-	// Render the eye images.
-	for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; eye++)
+	benchmark->FrameCount = frameCount;
+	benchmark->Seed = (unsigned int)strtoul(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_BENCHMARK_SEED, "2"), NULL, 10);
+	snprintf(benchmark->ReportFile, sizeof(benchmark->ReportFile), "%s",
+		ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_BENCHMARK_REPORT, BENCHMARK_REPORT_FILE));
+	char profile[64];
+	snprintf(profile, sizeof(profile), "%s_%s_%1.0fhz", DeviceTypeName(ovr_GetSystemProperty(java, VRAPI_SYS_PROP_DEVICE_TYPE)),
+		GpuTypeName(ovr_GetSystemProperty(java, VRAPI_SYS_PROP_GPU_TYPE)), refreshRate);
+	snprintf(benchmark->Profile, sizeof(benchmark->Profile), "%s", ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_BENCHMARK_PROFILE, profile));
+	benchmark->MinimumVsyncs = minimumVsyncs;
+	benchmark->VsyncPeriod = 1.0 / refreshRate;
+	for (int stage = 0; stage <= BENCHMARK_GPU_STAGE; stage++)
 	{
-		// updated sensor prediction for each eye (updates orientation, not position)
-#if REDUCED_LATENCY
-		ovrTracking updatedTracking = vrapi_GetPredictedTracking(ovr, tracking->HeadPose.TimeInSeconds);
-		updatedTracking.HeadPose.Pose.Position = tracking->HeadPose.Pose.Position;
-#else
-		ovrTracking updatedTracking = *tracking;
-#endif
+		benchmark->Samples[stage] = (float *)malloc(frameCount * sizeof(float));
+	}
+	LOGI("Benchmark: %d frames with seed %u and %s head motion, profile %s", frameCount, benchmark->Seed,
+		benchmark->Motion, benchmark->Profile);
+}
 
-		// Calculate the center view matrix.
-		const ovrMatrix4f centerEyeViewMatrix = vrapi_GetCenterEyeViewMatrix(&headModelParms, &updatedTracking, NULL);
-		const ovrMatrix4f eyeViewMatrix = vrapi_GetEyeViewMatrix(&headModelParms, &centerEyeViewMatrix, eye);
+static void ovrBenchmark_Destroy(ovrBenchmark * benchmark)
+{
+	ovrHeadTrajectory_Destroy(&benchmark->Trajectory);
+	for (int stage = 0; stage <= BENCHMARK_GPU_STAGE; stage++)
+	{
+		free(benchmark->Samples[stage]);
+	}
+	ovrBenchmark_Clear(benchmark);
+}
 
-		ovrFramebuffer * frameBuffer = &renderer->FrameBuffer[eye];
-		ovrFramebuffer_SetCurrent(frameBuffer);
+static bool ovrBenchmark_IsRunning(const ovrBenchmark * benchmark)
+{
+	return benchmark->FrameCount > 0 && !benchmark->Done;
+}
 
-		GL(glEnable(GL_SCISSOR_TEST));
-		GL(glDepthMask(GL_TRUE));
-		GL(glEnable(GL_DEPTH_TEST));
-		GL(glDepthFunc(GL_LEQUAL));
-		GL(glViewport(0, 0, frameBuffer->Width, frameBuffer->Height));
-		GL(glScissor(0, 0, frameBuffer->Width, frameBuffer->Height));
-		GL(glClearColor(0.125f, 0.0f, 0.125f, 1.0f));
-		GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-		GL(glUseProgram(scene->Program.Program));
-		GL(glUniformMatrix4fv(scene->Program.Uniforms[UNIFORM_VIEW_MATRIX], 1, GL_TRUE, (const GLfloat *)eyeViewMatrix.M[0]));
-		GL(glUniformMatrix4fv(scene->Program.Uniforms[UNIFORM_PROJECTION_MATRIX], 1, GL_TRUE, (const GLfloat *)renderer->ProjectionMatrix.M[0]));
-		GL(glBindVertexArray(scene->Cube.VertexArrayObject));
-		GL(glDrawElementsInstanced(GL_TRIANGLES, scene->Cube.IndexCount, GL_UNSIGNED_SHORT, NULL, NUM_INSTANCES));
-		GL(glBindVertexArray(0));
-		GL(glUseProgram(0));
-
-		// Explicitly clear the border texels to black because OpenGL-ES does not support GL_CLAMP_TO_BORDER.
-		{
-			// Clear to fully opaque black.
-			GL(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
-			// bottom
-			GL(glScissor(0, 0, frameBuffer->Width, 1));
-			GL(glClear(GL_COLOR_BUFFER_BIT));
-			// top
-			GL(glScissor(0, frameBuffer->Height - 1, frameBuffer->Width, 1));
-			GL(glClear(GL_COLOR_BUFFER_BIT));
-			// left
-			GL(glScissor(0, 0, 1, frameBuffer->Height));
-			GL(glClear(GL_COLOR_BUFFER_BIT));
-			// right
-			GL(glScissor(frameBuffer->Width - 1, 0, 1, frameBuffer->Height));
-			GL(glClear(GL_COLOR_BUFFER_BIT));
-		}
-
-		ovrFramebuffer_Resolve(frameBuffer);
+// Replaces the tracked head pose with the trajectory, keeping the predicted display time
+// that time warp needs. Returns the time to advance the simulation to.
+static double ovrBenchmark_BeginFrame(ovrBenchmark * benchmark, ovrTracking * tracking)
+{
+	const double time = benchmark->Frames * benchmark->MinimumVsyncs * benchmark->VsyncPeriod;
+	if (benchmark->Trajectory.Type != HEAD_TRAJECTORY_TRACKED)
+	{
+		const double displayTime = tracking->HeadPose.TimeInSeconds;
+		tracking->HeadPose = ovrHeadTrajectory_GetPose(&benchmark->Trajectory, time);
+		tracking->HeadPose.TimeInSeconds = displayTime;
+	}
+	return time;
+}
 
-		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].ColorTextureSwapChain = frameBuffer->ColorTextureSwapChain;
-		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].TextureSwapChainIndex = frameBuffer->TextureSwapChainIndex;
-		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].TexCoordsFromTanAngles = renderer->TexCoordsTanAnglesMatrix;
-		parms.Layers[VRAPI_FRAME_LAYER_TYPE_WORLD].Textures[eye].HeadPose = updatedTracking.HeadPose;
+static void ovrBenchmark_AddSample(ovrBenchmark * benchmark, const int stage, const float seconds)
+{
+	if (benchmark->SampleCount[stage] < benchmark->FrameCount)
+	{
+		benchmark->Samples[stage][benchmark->SampleCount[stage]++] = seconds;
+	}
+}
 
-		ovrFramebuffer_Advance(frameBuffer);
+// Returns true once the last frame was measured.
+static bool ovrBenchmark_EndFrame(ovrBenchmark * benchmark, const ovrFrameStats * stats, const ovrGpuTimer * gpuTimer,
+	const double predictedDisplayTime)
+{
+	const bool measured = ++benchmark->Frames > BENCHMARK_WARMUP_FRAMES;
+	if (measured)
+	{
+		for (int stage = 0; stage < FRAME_STAGE_MAX; stage++)
+		{
+			ovrBenchmark_AddSample(benchmark, stage, stats->CpuTime[stage]);
+		}
+		// The GPU time arrives a few frames late, and only for the frames the timer could measure.
+		if (gpuTimer->MeasuredFrames != benchmark->GpuMeasuredFrames)
+		{
+			ovrBenchmark_AddSample(benchmark, BENCHMARK_GPU_STAGE, gpuTimer->GpuTime);
+		}
+		const int vsyncs = (int)floor((predictedDisplayTime - benchmark->LastDisplayTime) / benchmark->VsyncPeriod + 0.5);
+		if (vsyncs > benchmark->MinimumVsyncs)
+		{
+			benchmark->LateFrames++;
+			benchmark->MissedVsyncs += vsyncs - benchmark->MinimumVsyncs;
+		}
+		benchmark->ReusedFrames += stats->ReusedEyeBuffers ? 1 : 0;
+		benchmark->EyeInstances += stats->EyeInstanceCount;
+		benchmark->MeasuredFrames++;
 	}
+	benchmark->GpuMeasuredFrames = gpuTimer->MeasuredFrames;
+	benchmark->LastDisplayTime = predictedDisplayTime;
+	return benchmark->MeasuredFrames >= benchmark->FrameCount;
+}
 
-	ovrFramebuffer_SetNone();
+static int CompareFloats(const void * a, const void * b)
+{
+	const float fa = *(const float *)a;
+	const float fb = *(const float *)b;
+	return (fa < fb) ? -1 : ((fa > fb) ? 1 : 0);
+}
 
-	return parms;
+// Nearest rank percentile of sorted samples.
+static float SortedPercentile(const float * sorted, const int count, const float percent)
+{
+	int rank = (int)ceilf(percent * 0.01f * count);
+	rank = (rank < 1) ? 1 : ((rank > count) ? count : rank);
+	return sorted[rank - 1];
+}
+
+static void ovrBenchmark_WriteStage(const ovrBenchmark * benchmark, FILE * file, const int stage, const char * name, const bool last)
+{
+	const int count = benchmark->SampleCount[stage];
+	float * sorted = (float *)malloc((count > 0 ? count : 1) * sizeof(float));
+	memcpy(sorted, benchmark->Samples[stage], count * sizeof(float));
+	qsort(sorted, count, sizeof(float), CompareFloats);
+	double sum = 0.0;
+	for (int i = 0; i < count; i++)
+	{
+		sum += sorted[i];
+	}
+	const float p50 = (count > 0) ? SortedPercentile(sorted, count, 50.0f) * 1000.0f : 0.0f;
+	const float p95 = (count > 0) ? SortedPercentile(sorted, count, 95.0f) * 1000.0f : 0.0f;
+	const float p99 = (count > 0) ? SortedPercentile(sorted, count, 99.0f) * 1000.0f : 0.0f;
+	const float max = (count > 0) ? sorted[count - 1] * 1000.0f : 0.0f;
+	const double mean = (count > 0) ? sum * 1000.0 / count : 0.0;
+	free(sorted);
+
+	LOGI("Benchmark: %-16s p50 %7.3f ms  p95 %7.3f ms  p99 %7.3f ms", name, p50, p95, p99);
+	fprintf(file, "\t\t\"%s\": { \"count\": %d, \"mean\": %1.4f, \"p50\": %1.4f, \"p95\": %1.4f, \"p99\": %1.4f, \"max\": %1.4f, \"samples\": [",
+		name, count, mean, p50, p95, p99, max);
+	for (int i = 0; i < count; i++)
+	{
+		fprintf(file, "%s%1.4f", (i > 0) ? ", " : " ", benchmark->Samples[stage][i] * 1000.0f);
+	}
+	fprintf(file, " ] }%s\n", last ? "" : ",");
+}
+
+static bool ovrBenchmark_WriteReport(const ovrBenchmark * benchmark, const ovrRenderer * renderer, const char * farField)
+{
+	FILE * file = fopen(benchmark->ReportFile, "w");
+	if (file == NULL)
+	{
+		LOGE("ovrBenchmark_WriteReport: failed to open %s", benchmark->ReportFile);
+		return false;
+	}
+	const int measured = (benchmark->MeasuredFrames > 0) ? benchmark->MeasuredFrames : 1;
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"version\": 1,\n");
+	fprintf(file, "\t\"profile\": \"%s\",\n", benchmark->Profile);
+	fprintf(file, "\t\"config\": { \"frames\": %d, \"warmup_frames\": %d, \"seed\": %u, \"motion\": \"%s\", "
+		"\"refresh_rate\": %1.0f, \"minimum_vsyncs\": %d, \"eye_width\": %d, \"eye_height\": %d, \"color_format\": \"%s\", "
+		"\"multisamples\": %d, \"foveation\": %d, \"far_field\": \"%s\", \"eye_buffer_reuse\": %s, \"overscan\": %s, \"gpu_timer\": \"%s\" },\n",
+		benchmark->FrameCount, BENCHMARK_WARMUP_FRAMES, benchmark->Seed, benchmark->Motion,
+		renderer->DisplayRefreshRate, benchmark->MinimumVsyncs, renderer->FrameBuffer[0].Width, renderer->FrameBuffer[0].Height,
+		EyeColorFormatName(renderer->Config.ColorFormat), renderer->FrameBuffer[0].Multisamples, (int)renderer->FoveationLevel,
+		farField, renderer->ReuseEyeBuffers ? "true" : "false", renderer->Overscan ? "true" : "false",
+		renderer->GpuTimer.UseTimerQueries ? "timer_query" : "fence");
+	fprintf(file, "\t\"frames\": { \"measured\": %d, \"late\": %d, \"missed_vsyncs\": %d, \"reused_eye_buffers\": %d },\n",
+		benchmark->MeasuredFrames, benchmark->LateFrames, benchmark->MissedVsyncs, benchmark->ReusedFrames);
+	fprintf(file, "\t\"instances\": { \"total\": %d, \"eye_pass_mean\": %1.1f, \"far_mean\": %1.1f },\n",
+		NUM_INSTANCES, (double)benchmark->EyeInstances / measured, NUM_INSTANCES - (double)benchmark->EyeInstances / measured);
+	fprintf(file, "\t\"stages\": {\n");
+	for (int stage = 0; stage < FRAME_STAGE_MAX; stage++)
+	{
+		ovrBenchmark_WriteStage(benchmark, file, stage, FrameStageNames[stage], false);
+	}
+	ovrBenchmark_WriteStage(benchmark, file, BENCHMARK_GPU_STAGE, "gpu", true);
+	fprintf(file, "\t}\n");
+	fprintf(file, "}\n");
+	const bool ok = (ferror(file) == 0);
+	fclose(file);
+	LOGI("Benchmark: %d frames, %d late with %d missed vsyncs, %s %s", benchmark->MeasuredFrames, benchmark->LateFrames,
+		benchmark->MissedVsyncs, ok ? "wrote" : "failed to write", benchmark->ReportFile);
+	return ok;
 }
 
 //================================================================================
@@ -1179,11 +6030,19 @@ typedef struct
 	ovrMobile *			Ovr;
 	ovrScene			Scene;
 	ovrSimulation		Simulation;
+	ovrProgramCache		ProgramCache;
 	long long			FrameIndex;
 	int					MinimumVsyncs;
 	ovrBackButtonState	BackButtonState;
 	bool				BackButtonDown;
 	double				BackButtonDownStartTime;
+	double				NextEyeBufferConfigPollTime;
+	time_t				EyeBufferConfigFileTime;
+	ovrFrameRateController	FrameRateController;
+	double				LastSubmitTime;
+	double				LastDisplayTime;
+	ovrBenchmark		Benchmark;
+	ovrHeadMotionRecorder	HeadMotionRecorder;
 #if MULTI_THREADED
 	ovrRenderThread		RenderThread;
 #else
@@ -1204,10 +6063,18 @@ static void ovrApp_Clear(ovrApp * app)
 	app->BackButtonState = BACK_BUTTON_STATE_NONE;
 	app->BackButtonDown = false;
 	app->BackButtonDownStartTime = 0.0;
+	app->NextEyeBufferConfigPollTime = 0.0;
+	app->EyeBufferConfigFileTime = 0;
+	ovrFrameRateController_Clear(&app->FrameRateController);
+	app->LastSubmitTime = 0.0;
+	app->LastDisplayTime = 0.0;
+	ovrBenchmark_Clear(&app->Benchmark);
+	ovrHeadMotionRecorder_Clear(&app->HeadMotionRecorder);
 
 	ovrEgl_Clear(&app->Egl);
 	ovrScene_Clear(&app->Scene);
 	ovrSimulation_Clear(&app->Simulation);
+	ovrProgramCache_Clear(&app->ProgramCache);
 #if MULTI_THREADED
 	ovrRenderThread_Clear(&app->RenderThread);
 #else
@@ -1215,6 +6082,91 @@ static void ovrApp_Clear(ovrApp * app)
 #endif
 }
 
+#if !MULTI_THREADED
+// Applies changes to the eye buffer configuration file on top of the local preferences.
+static void ovrApp_PollEyeBufferConfig(ovrApp * app)
+{
+	const double now = vrapi_GetTimeInSeconds();
+	if (now < app->NextEyeBufferConfigPollTime)
+	{
+		return;
+	}
+	app->NextEyeBufferConfigPollTime = now + EYE_BUFFER_CONFIG_POLL_SECONDS;
+
+	// Pick up the change at a later poll if the eye buffers were just replaced.
+	struct stat fileStat;
+	if (stat(EYE_BUFFER_CONFIG_FILE, &fileStat) != 0 || fileStat.st_mtime == app->EyeBufferConfigFileTime ||
+		!ovrRenderer_CanRebuildFrameBuffers(&app->Renderer))
+	{
+		return;
+	}
+	app->EyeBufferConfigFileTime = fileStat.st_mtime;
+
+	ovrEyeBufferConfig config;
+	ovrEyeBufferConfig_Default(&config);
+	ovrEyeBufferConfig_LoadLocalPrefs(&config);
+	if (ovrEyeBufferConfig_LoadFile(&config, EYE_BUFFER_CONFIG_FILE))
+	{
+		LOGI("Loaded %s", EYE_BUFFER_CONFIG_FILE);
+		ovrRenderer_Reconfigure(&app->Renderer, &config);
+	}
+}
+#endif
+
+#if !MULTI_THREADED
+// Feeds the CPU time spent on the frame that was just submitted, the latest GPU time and
+// the predicted display time of the frame to the frame rate controller.
+static void ovrApp_UpdateFrameRate(ovrApp * app, const double submitTime, const double predictedDisplayTime)
+{
+	// A frame that reused the eye buffers says nothing about the cost of rendering.
+	if (app->LastSubmitTime > 0.0 && app->LastDisplayTime > 0.0 && !app->Renderer.FrameStats.ReusedEyeBuffers)
+	{
+		const float cpuTime = (float)(submitTime - app->LastSubmitTime);
+		const float displayInterval = (float)(predictedDisplayTime - app->LastDisplayTime);
+		if (ovrFrameRateController_Update(&app->FrameRateController, cpuTime,
+			app->Renderer.GpuTimer.UseTimerQueries, app->Renderer.GpuTimer.GpuTime,
+			app->Renderer.DynamicResolution.Scale, displayInterval, app->Renderer.DisplayRefreshRate))
+		{
+			app->MinimumVsyncs = app->FrameRateController.MinimumVsyncs;
+		}
+	}
+	app->LastSubmitTime = vrapi_GetTimeInSeconds();
+	app->LastDisplayTime = predictedDisplayTime;
+}
+#endif
+
+#if !MULTI_THREADED
+// Holds everything that adapts to the measured frame times, so every benchmark run renders the same work.
+static void ovrApp_StartBenchmark(ovrApp * app)
+{
+	ovrBenchmark_Create(&app->Benchmark, &app->Java, app->Renderer.DisplayRefreshRate, app->MinimumVsyncs);
+	if (!ovrBenchmark_IsRunning(&app->Benchmark))
+	{
+		return;
+	}
+	app->Scene.Random = app->Benchmark.Seed;
+	app->FrameRateController.Enabled = false;
+	app->Renderer.DynamicResolution.Enabled = false;
+	app->Renderer.MsaaPolicy.MinSamples = app->Renderer.MsaaPolicy.Samples;
+	app->Renderer.MsaaPolicy.MaxSamples = app->Renderer.MsaaPolicy.Samples;
+}
+
+// Measures the frame that was just submitted, and writes the report and finishes the
+// activity after the last one.
+static void ovrApp_EndBenchmarkFrame(ovrApp * app, ANativeActivity * activity, const double submitTime, const double predictedDisplayTime)
+{
+	ovrFrameStats * stats = &app->Renderer.FrameStats;
+	stats->CpuTime[FRAME_STAGE_SUBMIT] = (float)(vrapi_GetTimeInSeconds() - submitTime);
+	stats->CpuTime[FRAME_STAGE_FRAME] = (app->LastSubmitTime > 0.0) ? (float)(submitTime - app->LastSubmitTime) : 0.0f;
+	if (ovrBenchmark_EndFrame(&app->Benchmark, stats, &app->Renderer.GpuTimer, predictedDisplayTime))
+	{
+		ovrBenchmark_WriteReport(&app->Benchmark, &app->Renderer, ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_FAR_FIELD, "off"));
+		app->Benchmark.Done = true;
+		ANativeActivity_finish(activity);
+	}
+}
+#endif
+
 static void ovrApp_PushBlackFinal(ovrApp * app, const ovrPerformanceParms * perfParms)
 {
 #if MULTI_THREADED
@@ -1396,6 +6348,8 @@ static void ovrApp_BackButtonAction(ovrApp * app, const ovrPerformanceParms * pe
 	if (app->BackButtonState == BACK_BUTTON_STATE_PENDING_DOUBLE_TAP)
 	{
 		LOGI("back button double tap");
+		ovrSimulation_TogglePause(&app->Simulation);
+		LOGI("        Simulation %s", app->Simulation.Paused ? "paused" : "resumed");
 		app->BackButtonState = BACK_BUTTON_STATE_SKIP_UP;
 	}
 	else if (app->BackButtonState == BACK_BUTTON_STATE_PENDING_SHORT_PRESS && !app->BackButtonDown)
@@ -1468,12 +6422,17 @@ static int ovrApp_HandleTouchEvent(ovrApp * app, const int action, const float x
 	{
 #if 0
 		// Cycle through 60Hz, 30Hz, 20Hz and 15Hz synthesis.
+		app->FrameRateController.Enabled = false;
 		app->MinimumVsyncs++;
 		if (app->MinimumVsyncs > 4)
 		{
 			app->MinimumVsyncs = 1;
 		}
 		LOGI("        MinimumVsyncs = %d", app->MinimumVsyncs);
+#endif
+#if !MULTI_THREADED
+		// Cycle through the foveation levels.
+		ovrRenderer_SetFoveationLevel(&app->Renderer, (ovrFoveationLevel)((app->Renderer.FoveationLevel + 1) % FOVEATION_LEVEL_MAX));
 #endif
 	}
 	return 1;
@@ -1675,6 +6634,8 @@ void android_main(struct android_app* app)
 	LOGI("android_app_entry()");
 	LOGI("    android_main()");
 
+	PROFILE_THREAD_NAME("main");
+
 	ovrJava java;
 	java.Vm = app->activity->vm;
 	java.Vm->AttachCurrentThread(&java.Env, NULL);
@@ -1689,6 +6650,9 @@ void android_main(struct android_app* app)
 
 	ovrEgl_CreateContext(&appState.Egl, NULL);
 
+	ovrProgramCache_Create(&appState.ProgramCache, app->activity->internalDataPath);
+	ovrProgram_EnableParallelCompile();
+
 	ovrPerformanceParms perfParms = vrapi_DefaultPerformanceParms();
 	perfParms.CpuLevel = CPU_LEVEL;
 	perfParms.GpuLevel = GPU_LEVEL;
@@ -1700,8 +6664,13 @@ void android_main(struct android_app* app)
 	perfParms.RenderThreadTid = ovrRenderThread_GetTid(&appState.RenderThread);
 #else
 	const ovrHmdInfo hmdInfo = vrapi_GetHmdInfo(&appState.Java);
-	ovrRenderer_Create(&appState.Renderer, &hmdInfo);
+	ovrEyeBufferConfig eyeBufferConfig;
+	ovrEyeBufferConfig_Default(&eyeBufferConfig);
+	ovrEyeBufferConfig_LoadLocalPrefs(&eyeBufferConfig);
+	ovrRenderer_Create(&appState.Renderer, &appState.Java, &hmdInfo, &eyeBufferConfig, &appState.ProgramCache);
+	ovrApp_StartBenchmark(&appState);
 #endif
+	ovrHeadMotionRecorder_Create(&appState.HeadMotionRecorder);
 
 	app->userData = &appState;
 	app->onAppCmd = app_handle_cmd;
@@ -1709,6 +6678,9 @@ void android_main(struct android_app* app)
 
 	while (app->destroyRequested == 0)
 	{
+		PROFILE_ZONE("Frame");
+
+		PROFILE_BEGIN("Events");
 		for (;;)
 		{
 			int events;
@@ -1722,22 +6694,31 @@ void android_main(struct android_app* app)
 			// Process this event.
 			if (source != NULL)
 			{
+				PROFILE_ZONE((source->id == LOOPER_ID_INPUT) ? "InputEvent" : "AppCommand");
 				source->process(app, source);
 			}
 
 			ovrApp_HandleVrModeChanges(&appState);
 		}
+		PROFILE_END();
 
+		PROFILE_BEGIN("SystemEvents");
 		ovrApp_BackButtonAction(&appState, &perfParms);
 		ovrApp_HandleSystemEvents(&appState);
+		PROFILE_END();
 
 		if (appState.Ovr == NULL)
 		{
 			continue;
 		}
 
-		if (!ovrScene_IsCreated(&appState.Scene))
+#if !MULTI_THREADED
+		ovrApp_PollEyeBufferConfig(&appState);
+#endif
+
+		if (!ovrScene_IsCreated(&appState.Scene) || !ovrScene_IsReady(&appState.Scene, &appState.ProgramCache))
 		{
+			PROFILE_ZONE("LoadingIcon");
 #if MULTI_THREADED
 			// Show a loading icon.
 			ovrRenderThread_Submit(&appState.RenderThread, appState.Ovr,
@@ -1751,8 +6732,12 @@ void android_main(struct android_app* app)
 			vrapi_SubmitFrame(appState.Ovr, &frameParms);
 #endif
 
-			// Create the scene.
-			ovrScene_Create(&appState.Scene);
+			// Create the scene, and keep showing the loading icon until its programs are ready.
+			if (!ovrScene_IsCreated(&appState.Scene))
+			{
+				ovrScene_Create(&appState.Scene, &appState.ProgramCache, &appState.Egl);
+			}
+			continue;
 		}
 		
 		// This is the only place the frame index is incremented, right before
@@ -1763,15 +6748,27 @@ void android_main(struct android_app* app)
 		// the new eye images will be displayed. The number of frames predicted ahead
 		// depends on the pipeline depth of the engine and the synthesis rate.
 		// The better the prediction, the less black will be pulled in at the edges.
+		PROFILE_BEGIN("Tracking");
 		const double predictedDisplayTime = vrapi_GetPredictedDisplayTime(appState.Ovr, appState.FrameIndex);
-		const ovrTracking baseTracking = vrapi_GetPredictedTracking(appState.Ovr, predictedDisplayTime);
+		ovrTracking baseTracking = vrapi_GetPredictedTracking(appState.Ovr, predictedDisplayTime);
+		ovrHeadMotionRecorder_Record(&appState.HeadMotionRecorder, &baseTracking);
+
+		// The benchmark replaces the head pose, and advances the simulation by whole frames.
+		double simulationTime = predictedDisplayTime;
+		if (ovrBenchmark_IsRunning(&appState.Benchmark))
+		{
+			simulationTime = ovrBenchmark_BeginFrame(&appState.Benchmark, &baseTracking);
+		}
 
 		// Apply the head-on-a-stick model if there is no positional tracking.
 		const ovrHeadModelParms headModelParms = vrapi_DefaultHeadModelParms();
 		const ovrTracking tracking = vrapi_ApplyHeadModel(&headModelParms, &baseTracking);
+		PROFILE_END();
 
 		// Advance the simulation based on the predicted display time.
-		ovrSimulation_Advance(&appState.Simulation, predictedDisplayTime);
+		PROFILE_BEGIN("Simulation");
+		ovrSimulation_Advance(&appState.Simulation, simulationTime);
+		PROFILE_END();
 
 #if MULTI_THREADED
 		// Render the eye images on a separate thread.
@@ -1786,7 +6783,19 @@ void android_main(struct android_app* app)
 			appState.Ovr);
 
 		// Hand over the eye images to the time warp.
+		const double submitTime = vrapi_GetTimeInSeconds();
+		PROFILE_BEGIN("SubmitFrame");
 		vrapi_SubmitFrame(appState.Ovr, &frameParms);
+		ovrGpuTimer_PollFences(&appState.Renderer.GpuTimer);
+		PROFILE_END();
+
+		if (ovrBenchmark_IsRunning(&appState.Benchmark))
+		{
+			ovrApp_EndBenchmarkFrame(&appState, app->activity, submitTime, predictedDisplayTime);
+		}
+
+		// Measured from after the previous vrapi_SubmitFrame, which blocks, to this one.
+		ovrApp_UpdateFrameRate(&appState, submitTime, predictedDisplayTime);
 #endif
     }
 
@@ -1796,10 +6805,18 @@ void android_main(struct android_app* app)
 	ovrRenderer_Destroy(&appState.Renderer);
 #endif
 
+	ovrBenchmark_Destroy(&appState.Benchmark);
+	ovrHeadMotionRecorder_Destroy(&appState.HeadMotionRecorder);
 	ovrScene_Destroy(&appState.Scene);
+	ovrProgramCache_Destroy(&appState.ProgramCache);
 	ovrEgl_DestroyContext(&appState.Egl);
 	vrapi_Shutdown();
 
+#if PROFILER
+	// Every other thread has been joined, so the rings are no longer written.
+	ovrProfiler_WriteTrace(ovr_GetLocalPreferenceValueForKey(LOCAL_PREF_PROFILER_TRACE, PROFILER_TRACE_FILE));
+#endif
+
 	java.Vm->DetachCurrentThread();
 }
 //END_INCLUDE(all)